@@ -0,0 +1,87 @@
+// urColo - tests headless batch palette extraction
+#include "urColo/BatchExtract.h"
+#include <doctest/doctest.h>
+#include <filesystem>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+// A scratch directory holding `count` copies of the test image.
+struct ImageDir {
+    fs::path path;
+    ImageDir(const std::string &name, int count)
+        : path(fs::temp_directory_path() / name) {
+        fs::remove_all(path);
+        fs::create_directories(path);
+        fs::path src = fs::path(TEST_ASSETS_DIR) / "test.png";
+        for (int i = 0; i < count; ++i)
+            fs::copy_file(src, path / ("img" + std::to_string(i) + ".png"));
+        std::ofstream(path / "notes.txt") << "not an image";
+    }
+    ~ImageDir() { fs::remove_all(path); }
+};
+} // namespace
+
+TEST_CASE("findImages expands directories and patterns") {
+    ImageDir dir("urcolo_batch_find", 3);
+    auto all = uc::findImages(dir.path.string());
+    REQUIRE(all.size() == 3);
+    CHECK(all.front().filename() == "img0.png");
+
+    CHECK(uc::findImages((dir.path / "img?.png").string()).size() == 3);
+    CHECK(uc::findImages((dir.path / "*1*").string()).size() == 1);
+    CHECK(uc::findImages((dir.path / "*.txt").string()).size() == 1);
+    CHECK(uc::findImages((dir.path / "img0.png").string()).size() == 1);
+    CHECK(uc::findImages((dir.path / "*.jpg").string()).empty());
+}
+
+TEST_CASE("extractPalettes reports every image under back-pressure") {
+    ImageDir dir("urcolo_batch_extract", 6);
+    auto images = uc::findImages(dir.path.string());
+    images.push_back(dir.path / "missing.png");
+
+    uc::BatchSettings settings;
+    settings.clusters.k = 3;
+    settings.workers = 3;
+    settings.queueDepth = 1;
+    std::vector<uc::BatchResult> results;
+    auto failures = uc::extractPalettes(
+        images, settings,
+        [&](uc::BatchResult &&r) { results.push_back(std::move(r)); });
+
+    CHECK(failures == 1);
+    REQUIRE(results.size() == images.size());
+    for (const auto &r : results) {
+        if (r.path.filename() == "missing.png") {
+            CHECK_FALSE(r.error.empty());
+        } else {
+            CHECK(r.error.empty());
+            CHECK(r.colours.size() == 3);
+        }
+    }
+}
+
+TEST_CASE("batch command writes importable palettes") {
+    ImageDir dir("urcolo_batch_command", 2);
+    fs::path out = dir.path / "out";
+    std::vector<std::string> args{(dir.path / "*.png").string(), "--out",
+                                  out.string(), "--colours", "4",
+                                  "--jobs", "2"};
+    CHECK(uc::runBatchCommand(args) == 0);
+
+    std::ifstream in(out / "img1.png.json");
+    REQUIRE(in);
+    nlohmann::json j;
+    in >> j;
+    auto palettes = j.get<std::vector<uc::Palette>>();
+    REQUIRE(palettes.size() == 1);
+    CHECK(palettes[0]._name == "img1");
+    CHECK(palettes[0]._swatches.size() == 4);
+
+    std::vector<std::string> bad{"--colours", "zero"};
+    CHECK(uc::runBatchCommand(bad) == 2);
+}
@@ -0,0 +1,105 @@
+// urColo - tests the generic k-means clustering engine
+#include "urColo/Clustering.h"
+#include "urColo/ImageUtils.h"
+#include <doctest/doctest.h>
+#include <random>
+#include <string>
+
+namespace {
+// Tight blobs of points around each of `centres`.
+std::vector<uc::LAB> blobs(const std::vector<uc::LAB> &centres,
+                           std::size_t perBlob, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> n(0.0, 0.01);
+    std::vector<uc::LAB> pts;
+    for (std::size_t i = 0; i < perBlob; ++i)
+        for (const auto &c : centres)
+            pts.push_back({c.L + n(rng), c.a + n(rng), c.b + n(rng)});
+    return pts;
+}
+
+bool near(const uc::LAB &a, const uc::LAB &b, double tol) {
+    return uc::EuclideanMetric{}(a, b) < tol;
+}
+} // namespace
+
+TEST_CASE("clustering finds separated blobs and keeps fixed centres") {
+    std::vector<uc::LAB> truth{{0.2, 0.1, 0.1}, {0.5, -0.1, 0.0},
+                               {0.8, 0.0, 0.15}};
+    auto pts = blobs(truth, 200, 1);
+    std::mt19937_64 rng(2);
+    std::vector<uc::LAB> fixed{{0.2, 0.1, 0.1}};
+    uc::ClusterEngine<> engine;
+    auto cl = engine.run(pts, fixed, {3, 50}, rng);
+
+    REQUIRE(cl.centres.size() == 3);
+    CHECK(cl.fixed[0]);
+    CHECK(cl.centres[0].L == doctest::Approx(0.2));
+    for (const auto &t : truth) {
+        bool found = false;
+        for (const auto &c : cl.centres)
+            found = found || near(c, t, 0.01);
+        CHECK(found);
+    }
+    CHECK(cl.iterations < 50);
+}
+
+TEST_CASE("refine reports the weight and spread of each cluster") {
+    std::vector<uc::LAB> pts{{0.2, 0.0, 0.0}, {0.4, 0.0, 0.0},
+                             {0.3, 0.0, 0.0}, {0.9, 0.1, 0.0},
+                             {0.9, -0.1, 0.0}};
+    std::mt19937_64 rng(4);
+    uc::ClusterEngine<> engine;
+    auto cl = engine.run(pts, {}, {2, 20}, rng);
+    REQUIRE(cl.weight.size() == 2);
+    REQUIRE(cl.variance.size() == 2);
+
+    std::size_t dark = cl.centres[0].L < cl.centres[1].L ? 0 : 1;
+    CHECK(cl.weight[dark] == doctest::Approx(3.0));
+    CHECK(cl.weight[1 - dark] == doctest::Approx(2.0));
+    CHECK(cl.variance[dark] == doctest::Approx(0.02 / 3.0));
+    CHECK(cl.variance[1 - dark] == doctest::Approx(0.01));
+}
+
+TEST_CASE("weights pull a centre toward heavy points") {
+    std::vector<uc::LAB> pts{{0.2, 0.0, 0.0}, {0.4, 0.0, 0.0}};
+    std::vector<double> w{3.0, 1.0};
+    std::mt19937_64 rng(3);
+    uc::ClusterEngine<uc::EuclideanMetric, std::span<const double>> engine(
+        {}, w);
+    auto cl = engine.run(pts, {}, {1, 10}, rng);
+    REQUIRE(cl.centres.size() == 1);
+    CHECK(cl.centres[0].L == doctest::Approx(0.25));
+}
+
+TEST_CASE("parallel chunks give the same result as a single pass") {
+    std::vector<uc::LAB> truth{{0.3, 0.1, -0.1}, {0.6, -0.1, 0.1},
+                               {0.9, 0.05, 0.05}, {0.1, 0.0, 0.0}};
+    auto pts = blobs(truth, 12000, 4); // several engine chunks
+    uc::ClusterEngine<uc::WeightedMetric> engine({0.5, 1.0});
+
+    std::mt19937_64 a(5), b(5);
+    auto one = engine.run(pts, {}, {4, 20}, a);
+    auto two = engine.run(pts, {}, {4, 20}, b);
+    REQUIRE(one.centres.size() == two.centres.size());
+    for (std::size_t c = 0; c < one.centres.size(); ++c)
+        CHECK(one.centres[c].L == two.centres[c].L);
+
+    // Continuing after moving the centres keeps the bounds valid: the
+    // result matches a fresh assignment.
+    std::vector<uc::LAB> shifted = one.centres;
+    for (auto &c : shifted)
+        c.L += 0.01;
+    engine.move(one, shifted);
+    engine.refine(pts, one, 20);
+    uc::Clustering fresh = engine.seed(pts, one.centres, 4, a);
+    for (std::size_t i = 0; i < pts.size(); i += 997)
+        CHECK(one.assignment[i] == fresh.assignment[i]);
+}
+
+TEST_CASE("image colour extraction takes the cluster count") {
+    auto cols = uc::generateRandomImageColours(8, 8, {3, 10});
+    CHECK(cols.size() == 3);
+    std::string path = std::string(TEST_ASSETS_DIR) + "/test.png";
+    CHECK(uc::loadImageColours(path, {4, 10}).size() == 4);
+}
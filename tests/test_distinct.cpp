@@ -0,0 +1,60 @@
+// urColo - tests distinctness optimiser spacing, locks and time budget
+#include "urColo/DistinctOptimiser.h"
+#include "urColo/PaletteGenerator.h"
+#include <chrono>
+#include <doctest/doctest.h>
+
+TEST_CASE("distinct optimiser spreads colours apart") {
+    uc::DistinctSettings settings;
+    settings.budget = std::chrono::milliseconds(40);
+    settings.replicas = 2;
+
+    auto found = uc::optimiseDistinct({}, 6, settings, 7);
+    REQUIRE(found.size() == 6);
+    for (const auto &lab : found)
+        CHECK(uc::inSRGBGamut(lab));
+
+    // Six colours packed into the sRGB gamut can comfortably sit further
+    // apart than near-duplicates.
+    CHECK(uc::minPairDistance({}, found) > 0.15);
+}
+
+TEST_CASE("distinct optimiser keeps away from locked colours") {
+    std::vector<uc::LAB> locked{uc::Colour::fromSRGB(255, 0, 0).lab,
+                                uc::Colour::fromSRGB(0, 0, 255).lab};
+    uc::DistinctSettings settings;
+    settings.budget = std::chrono::milliseconds(30);
+
+    auto found = uc::optimiseDistinct(locked, 3, settings, 11);
+    REQUIRE(found.size() == 3);
+    CHECK(uc::minPairDistance(locked, found) > 0.1);
+}
+
+TEST_CASE("distinct optimiser respects its time budget") {
+    uc::DistinctSettings settings;
+    settings.budget = std::chrono::milliseconds(20);
+    settings.replicas = 4;
+
+    auto start = std::chrono::steady_clock::now();
+    auto found = uc::optimiseDistinct({}, 12, settings, 3);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    CHECK(found.size() == 12);
+    CHECK(elapsed < std::chrono::milliseconds(500));
+}
+
+TEST_CASE("distinct algorithm returns requested swatches") {
+    uc::PaletteGenerator gen(5);
+    gen.setAlgorithm(uc::PaletteGenerator::Algorithm::Distinct);
+    uc::DistinctSettings settings = gen.distinctSettings();
+    settings.budget = std::chrono::milliseconds(10);
+    gen.setDistinctSettings(settings);
+
+    uc::Swatch sw{"", {0.5f, 0.5f, 0.5f, 1.0f}};
+    sw._locked = true;
+    std::vector<uc::Swatch> locked{sw};
+    auto result = gen.generate(locked, 4);
+    CHECK(result.size() == 4);
+    for (const auto &s : result)
+        CHECK_FALSE(s._locked);
+}
@@ -1,7 +1,12 @@
 // urColo - tests palette generator locking and gradient interpolation
 #include "urColo/PaletteGenerator.h"
+#include "urColo/Random.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <doctest/doctest.h>
-#include <numbers>
+#include <random>
+#include <utility>
 
 // Helper to create a locked swatch from RGB values.
 static uc::Swatch makeSwatch(int r, int g, int b) {
@@ -54,16 +59,12 @@ TEST_CASE("gradient interpolation between two locked colours") {
     if (c1.lab.L > c2.lab.L)
         std::swap(c1, c2);
 
-    auto l1 = c1.toLCh();
-    auto l2 = c2.toLCh();
-
+    // Two anchors give a straight OKLab line, split into equal steps.
     auto interp = [&](double t) {
-        double dh = std::remainder(l2.h - l1.h, 2.0 * std::numbers::pi);
-        uc::LCh lch{l1.L + (l2.L - l1.L) * t, l1.C + (l2.C - l1.C) * t,
-                    l1.h + dh * t};
-        if (lch.h < 0.0)
-            lch.h += 2.0 * std::numbers::pi;
-        uc::Colour cc = uc::Colour::fromLCh(lch);
+        uc::Colour cc;
+        cc.lab = {c1.lab.L + (c2.lab.L - c1.lab.L) * t,
+                  c1.lab.a + (c2.lab.a - c1.lab.a) * t,
+                  c1.lab.b + (c2.lab.b - c1.lab.b) * t};
         cc.alpha = 1.0;
         return cc.toImVec4();
     };
@@ -142,13 +143,37 @@ TEST_CASE("kmeans random image uses generator seed") {
     }
 }
 
+TEST_CASE("kmeans random image follows an explicit sample seed") {
+    // With as many clusters as samples the result is the samples
+    // themselves, whatever seeds the clustering.
+    auto colours = [](std::uint64_t genSeed) {
+        uc::PaletteGenerator g(genSeed);
+        g.setAlgorithm(uc::PaletteGenerator::Algorithm::KMeans);
+        g.setKMeansRandomImage(2, 1, 7);
+        auto out = g.generate({}, 2);
+        std::vector<float> xs;
+        for (const auto &sw : out)
+            xs.push_back(sw._colour.x);
+        std::sort(xs.begin(), xs.end());
+        return xs;
+    };
+    auto first = colours(1);
+    auto second = colours(2);
+    REQUIRE(first.size() == second.size());
+    for (std::size_t i = 0; i < first.size(); ++i)
+        CHECK(first[i] == doctest::Approx(second[i]));
+}
+
 TEST_CASE("learned algorithm forwards to model") {
     uc::PaletteGenerator gen(123);
     gen.setAlgorithm(uc::PaletteGenerator::Algorithm::Learned);
     gen.model() = uc::Model(55);
 
+    // The generator samples the model with its own stream, derived from
+    // the generator's seed.
     uc::Model copy = gen.model();
-    auto expected = copy.suggest(4);
+    std::mt19937_64 rng(uc::deriveSeed(123, 1));
+    auto expected = copy.suggest(4, {}, rng);
 
     auto result = gen.generate({}, 4);
 
@@ -159,3 +184,162 @@ TEST_CASE("learned algorithm forwards to model") {
         CHECK(result[i]._colour.z == doctest::Approx(expected[i]._colour.z));
     }
 }
+
+TEST_CASE("generator copies share the learned model until changed") {
+    uc::PaletteGenerator gen(3);
+    gen.setAlgorithm(uc::PaletteGenerator::Algorithm::Learned);
+    uc::PaletteGenerator copy = gen;
+    const auto &shared = std::as_const(gen).model();
+    CHECK(&std::as_const(copy).model() == &shared);
+    copy.generate({}, 2);
+    CHECK(&std::as_const(copy).model() == &shared);
+
+    copy.model().setComponents(2);
+    CHECK(&std::as_const(copy).model() != &shared);
+    CHECK(shared.components() == 4);
+}
+
+// Build an image made of tight blobs around a few base colours.
+static std::vector<uc::Colour> blobImage(std::size_t perBlob) {
+    const std::array<std::array<int, 3>, 4> bases{
+        {{220, 40, 40}, {40, 200, 60}, {30, 60, 220}, {240, 240, 200}}};
+    std::mt19937_64 rng(17);
+    std::uniform_int_distribution<int> noise(-12, 12);
+    std::vector<uc::Colour> img;
+    for (const auto &b : bases) {
+        for (std::size_t i = 0; i < perBlob; ++i) {
+            auto ch = [&](int v) {
+                return static_cast<std::uint8_t>(std::clamp(v + noise(rng), 0,
+                                                            255));
+            };
+            img.push_back(uc::Colour::fromSRGB(ch(b[0]), ch(b[1]), ch(b[2])));
+        }
+    }
+    return img;
+}
+
+TEST_CASE("kmeans setting the same image keeps its fingerprint") {
+    auto img = blobImage(50);
+    uc::PaletteGenerator gen(1);
+    gen.setKMeansImage(img);
+    auto fp = gen.kMeansFingerprint();
+    CHECK(fp != 0);
+    gen.setKMeansImage(img);
+    CHECK(gen.kMeansFingerprint() == fp);
+
+    img[0] = uc::Colour::fromSRGB(0, 0, 0);
+    gen.setKMeansImage(img);
+    CHECK(gen.kMeansFingerprint() != fp);
+}
+
+TEST_CASE("kmeans warm start converges in fewer iterations") {
+    auto img = blobImage(500);
+    uc::PaletteGenerator gen(21);
+    gen.setAlgorithm(uc::PaletteGenerator::Algorithm::KMeans);
+    gen.setKMeansIterations(100);
+    gen.setKMeansImage(img);
+
+    auto first = gen.generate({}, 4);
+    int coldIters = gen.lastKMeansIterations();
+    REQUIRE(first.size() == 4);
+
+    gen.setKMeansImage(img);
+    auto second = gen.generate({}, 4);
+    int warmIters = gen.lastKMeansIterations();
+    REQUIRE(second.size() == 4);
+
+    CHECK(warmIters <= coldIters);
+    CHECK(warmIters <= 5);
+
+    // The warm run should settle on the same blobs as the cold one.
+    for (const auto &a : first) {
+        auto ca = uc::Colour::fromImVec4(a._colour);
+        double best = 1.0;
+        for (const auto &b : second) {
+            auto cb = uc::Colour::fromImVec4(b._colour);
+            double dL = ca.lab.L - cb.lab.L;
+            double da = ca.lab.a - cb.lab.a;
+            double db = ca.lab.b - cb.lab.b;
+            best = std::min(best, std::sqrt(dL * dL + da * da + db * db));
+        }
+        CHECK(best < 0.05);
+    }
+}
+
+TEST_CASE("kmeans shares image buffers instead of copying") {
+    auto blobs = blobImage(20);
+    auto data = std::make_shared<uc::ImageData>();
+    data->width = static_cast<int>(blobs.size());
+    data->height = 1;
+    for (const auto &c : blobs) {
+        auto rgb = c.toSRGB8();
+        data->rgba.insert(data->rgba.end(), rgb.begin(), rgb.end());
+        data->rgba.push_back(255);
+    }
+    data->fingerprint = uc::fingerprintImage(*data);
+    uc::SharedImage img = data;
+
+    uc::PaletteGenerator gen(8);
+    gen.setAlgorithm(uc::PaletteGenerator::Algorithm::KMeans);
+    gen.setKMeansImage(img);
+    CHECK(gen.kMeansImage().get() == img.get());
+    CHECK(img.use_count() == 3);
+
+    auto shared = gen.generate({}, 3);
+
+    uc::PaletteGenerator copy(8);
+    copy.setAlgorithm(uc::PaletteGenerator::Algorithm::KMeans);
+    copy.setKMeansImage(blobs);
+    CHECK(copy.kMeansFingerprint() == gen.kMeansFingerprint());
+    auto copied = copy.generate({}, 3);
+
+    REQUIRE(shared.size() == copied.size());
+    for (std::size_t i = 0; i < shared.size(); ++i) {
+        CHECK(shared[i]._colour.x == doctest::Approx(copied[i]._colour.x));
+        CHECK(shared[i]._colour.y == doctest::Approx(copied[i]._colour.y));
+        CHECK(shared[i]._colour.z == doctest::Approx(copied[i]._colour.z));
+    }
+}
+
+TEST_CASE("kmeans downsamples images over the pixel budget once") {
+    auto img = std::make_shared<const uc::ImageData>(
+        uc::generateRandomImage(100, 50));
+    uc::PaletteGenerator gen(4);
+    gen.setAlgorithm(uc::PaletteGenerator::Algorithm::KMeans);
+    gen.setKMeansPixelBudget(1000);
+    gen.setKMeansImage(img);
+    REQUIRE(gen.kMeansImage());
+    CHECK(gen.kMeansImage() != img);
+    CHECK(gen.kMeansImage()->pixelCount() <= 1000);
+    CHECK(gen.generate({}, 3).size() == 3);
+
+    // A copy given the same image reuses the downsampled buffer.
+    uc::PaletteGenerator copy = gen;
+    copy.setKMeansImage(img);
+    CHECK(copy.kMeansImage() == gen.kMeansImage());
+
+    gen.setKMeansPixelBudget(0);
+    gen.setKMeansImage(img);
+    CHECK(gen.kMeansImage() == img);
+}
+
+TEST_CASE("kmeans clusters superpixels when enabled") {
+    auto img = std::make_shared<const uc::ImageData>(
+        uc::generateRandomImage(80, 60));
+    uc::PaletteGenerator gen(6);
+    gen.setAlgorithm(uc::PaletteGenerator::Algorithm::KMeans);
+    gen.setKMeansSuperpixels(200);
+    gen.setKMeansImage(img);
+    CHECK(gen.kMeansImage() == img);
+    auto first = gen.generate({}, 4);
+    CHECK(first.size() == 4);
+
+    // A second generation warm-starts from the clustering of the regions.
+    auto second = gen.generate({}, 4);
+    CHECK(second.size() == 4);
+    CHECK(gen.lastKMeansIterations() <= gen.kMeansIterations());
+
+    gen.setKMeansSuperpixels(0);
+    gen.setKMeansImage(img);
+    CHECK(gen.generate({}, 4).size() == 4);
+}
@@ -0,0 +1,62 @@
+// urColo - tests spline gradients, arc-length spacing and colormap export
+#include "urColo/Gradient.h"
+#include <cmath>
+#include <doctest/doctest.h>
+
+namespace {
+double distance(const uc::LAB &a, const uc::LAB &b) {
+    double dL = a.L - b.L;
+    double da = a.a - b.a;
+    double db = a.b - b.b;
+    return std::sqrt(dL * dL + da * da + db * db);
+}
+} // namespace
+
+TEST_CASE("gradient passes through its end anchors") {
+    std::vector<uc::LAB> anchors{uc::Colour::fromSRGB(20, 30, 120).lab,
+                                 uc::Colour::fromSRGB(200, 40, 60).lab,
+                                 uc::Colour::fromSRGB(250, 240, 120).lab};
+    uc::Gradient grad(anchors);
+    auto pts = grad.sample(5);
+    REQUIRE(pts.size() == 5);
+    CHECK(distance(pts.front(), anchors.front()) < 1e-4);
+    CHECK(distance(pts.back(), anchors.back()) < 1e-4);
+}
+
+TEST_CASE("gradient steps are perceptually even") {
+    // The middle anchor sits much closer to the first, so sampling by the
+    // spline parameter would bunch colours up on that side.
+    std::vector<uc::LAB> anchors{
+        {0.2, 0.0, 0.0}, {0.25, 0.05, 0.0}, {0.9, 0.1, 0.1}};
+    uc::Gradient grad(anchors);
+    auto pts = grad.sample(33);
+    double total = 0.0;
+    std::vector<double> steps;
+    for (std::size_t i = 1; i < pts.size(); ++i) {
+        steps.push_back(distance(pts[i - 1], pts[i]));
+        total += steps.back();
+    }
+    double mean = total / static_cast<double>(steps.size());
+    for (double s : steps)
+        CHECK(s == doctest::Approx(mean).epsilon(0.02));
+}
+
+TEST_CASE("colormap has the requested size and matches the anchors") {
+    std::vector<uc::LAB> anchors{uc::Colour::fromSRGB(0, 0, 0).lab,
+                                 uc::Colour::fromSRGB(255, 255, 255).lab};
+    auto map = uc::Gradient(anchors).colormap(uc::Gradient::kMaxColormapSize);
+    REQUIRE(map.size() == uc::Gradient::kMaxColormapSize);
+    CHECK(map.r.front() == doctest::Approx(0.0f).epsilon(0.001));
+    CHECK(map.g.back() == doctest::Approx(1.0f).epsilon(0.001));
+    for (std::size_t i = 1; i < map.size(); ++i)
+        CHECK(map.r[i] >= map.r[i - 1]);
+}
+
+TEST_CASE("single anchor gradient is constant") {
+    std::vector<uc::LAB> anchors{{0.5, 0.1, -0.1}};
+    uc::Gradient grad(anchors);
+    CHECK(grad.length() == 0.0);
+    auto pts = grad.sample(3);
+    for (const auto &p : pts)
+        CHECK(distance(p, anchors[0]) < 1e-6);
+}
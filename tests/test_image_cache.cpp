@@ -0,0 +1,102 @@
+// urColo - tests the persistent decoded image cache
+#include "urColo/ImageCache.h"
+#include <chrono>
+#include <doctest/doctest.h>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+// A fresh, empty directory removed again when the test ends.
+struct TempDir {
+    fs::path path;
+    explicit TempDir(const std::string &name)
+        : path(fs::temp_directory_path() / name) {
+        fs::remove_all(path);
+    }
+    ~TempDir() { fs::remove_all(path); }
+};
+
+fs::path entry(const fs::path &dir, std::uint64_t key) {
+    return dir / std::format("{:016x}.urci", key);
+}
+} // namespace
+
+TEST_CASE("image cache round-trips pixels and planes") {
+    TempDir dir("urcolo_cache_roundtrip");
+    uc::ImageCache cache(dir.path);
+    auto img = uc::generateRandomImage(8, 4);
+    CHECK_FALSE(cache.load(42));
+
+    cache.store(42, img);
+    CHECK(cache.sizeOnDisk() > 0);
+    auto back = cache.load(42);
+    REQUIRE(back);
+    CHECK(back->width == 8);
+    CHECK(back->height == 4);
+    CHECK(back->rgba == img.rgba);
+    CHECK(back->fingerprint == img.fingerprint);
+    CHECK(back->lab()->L == img.lab()->L);
+    CHECK(back->lab()->b == img.lab()->b);
+    CHECK(back->bitDepth == 8);
+    CHECK_FALSE(cache.load(43));
+
+    std::vector<std::uint16_t> deep(8 * 4 * 4, 40000);
+    cache.store(44, uc::ImageData::fromRGBA16(8, 4, deep.data()));
+    auto wide = cache.load(44);
+    REQUIRE(wide);
+    CHECK(wide->bitDepth == 16);
+}
+
+TEST_CASE("image cache drops invalid entries") {
+    TempDir dir("urcolo_cache_invalid");
+    uc::ImageCache cache(dir.path);
+    cache.store(7, uc::generateRandomImage(4, 4));
+    REQUIRE(fs::exists(entry(dir.path, 7)));
+
+    fs::resize_file(entry(dir.path, 7), 10);
+    CHECK_FALSE(cache.load(7));
+    CHECK_FALSE(fs::exists(entry(dir.path, 7)));
+}
+
+TEST_CASE("image cache evicts the least recently used entry") {
+    TempDir dir("urcolo_cache_evict");
+    auto img = uc::generateRandomImage(8, 4);
+    const std::uintmax_t entrySize = 16 + img.pixelCount() * 16;
+    uc::ImageCache cache(dir.path, entrySize * 2 + entrySize / 2);
+
+    cache.store(1, img);
+    cache.store(2, img);
+    auto now = fs::file_time_type::clock::now();
+    fs::last_write_time(entry(dir.path, 1), now - std::chrono::hours(2));
+    fs::last_write_time(entry(dir.path, 2), now - std::chrono::hours(1));
+
+    // A hit marks the entry as recently used.
+    CHECK(cache.load(1));
+    cache.store(3, img);
+    CHECK(cache.sizeOnDisk() <= cache.maxBytes());
+    CHECK(fs::exists(entry(dir.path, 1)));
+    CHECK_FALSE(fs::exists(entry(dir.path, 2)));
+    CHECK(fs::exists(entry(dir.path, 3)));
+}
+
+TEST_CASE("loadSharedImage fills and reads the image cache") {
+    TempDir dir("urcolo_cache_load");
+    auto cache = std::make_shared<uc::ImageCache>(dir.path);
+    uc::setImageCache(cache);
+    std::string path = std::string(TEST_ASSETS_DIR) + "/test.png";
+
+    auto first = uc::loadSharedImage(path);
+    REQUIRE(first);
+    CHECK(cache->sizeOnDisk() > 0);
+    auto rgba = first->rgba;
+    first.reset();
+
+    auto again = uc::loadSharedImage(path);
+    REQUIRE(again);
+    CHECK(again->rgba == rgba);
+    uc::setImageCache(nullptr);
+}
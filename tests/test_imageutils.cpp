@@ -2,8 +2,12 @@
 #include "urColo/Colour.h"
 #include "urColo/ImageUtils.h"
 #include <array>
+#include <cmath>
 #include <doctest/doctest.h>
+#include <filesystem>
+#include <fstream>
 #include <string>
+#include <vector>
 
 TEST_CASE("loadImageColours invalid path") {
     auto cols = uc::loadImageColours("no/such/file.png");
@@ -19,14 +23,14 @@ TEST_CASE("loadImageColours returns dominant colours") {
         uc::Colour::fromSRGB(255, 0, 0), uc::Colour::fromSRGB(0, 255, 0),
         uc::Colour::fromSRGB(0, 0, 255), uc::Colour::fromSRGB(255, 255, 255)};
 
+    // Compared in OKLab: pixels are clustered in single precision, which
+    // leaves white's hue undefined.
     for (const auto &exp : expected) {
         bool found = false;
-        auto expLch = exp.toLCh();
         for (const auto &c : cols) {
-            auto lch = c.toLCh();
-            if (doctest::Approx(lch.L).epsilon(0.001) == expLch.L &&
-                doctest::Approx(lch.C).epsilon(0.001) == expLch.C &&
-                doctest::Approx(lch.h).epsilon(0.001) == expLch.h) {
+            if (std::abs(c.lab.L - exp.lab.L) < 1e-5 &&
+                std::abs(c.lab.a - exp.lab.a) < 1e-5 &&
+                std::abs(c.lab.b - exp.lab.b) < 1e-5) {
                 found = true;
                 break;
             }
@@ -35,6 +39,34 @@ TEST_CASE("loadImageColours returns dominant colours") {
     }
 }
 
+TEST_CASE("extractDominantColours reports coverage most common first") {
+    // Half red, three tenths green and a fifth blue.
+    const int w = 10, h = 10;
+    std::vector<unsigned char> px(static_cast<std::size_t>(w) * h * 4);
+    for (std::size_t i = 0; i < px.size() / 4; ++i) {
+        std::size_t channel = i < 50 ? 0 : i < 80 ? 1 : 2;
+        px[i * 4 + channel] = 255;
+        px[i * 4 + 3] = 255;
+    }
+    auto img = uc::ImageData::fromRGBA(w, h, px.data());
+    auto dom = uc::extractDominantColours(img, {3, 20}, 7);
+    REQUIRE(dom.size() == 3);
+    CHECK(dom[0].share == doctest::Approx(0.5));
+    CHECK(dom[1].share == doctest::Approx(0.3));
+    CHECK(dom[2].share == doctest::Approx(0.2));
+    CHECK(dom[0].colour.lab.L ==
+          doctest::Approx(uc::Colour::fromSRGB(255, 0, 0).lab.L).epsilon(1e-5));
+    for (const auto &d : dom)
+        CHECK(d.variance == doctest::Approx(0.0).epsilon(1e-9));
+
+    auto again = uc::extractDominantColours(img, {3, 20}, 7);
+    REQUIRE(again.size() == dom.size());
+    for (std::size_t i = 0; i < dom.size(); ++i)
+        CHECK(again[i].colour.lab.L == dom[i].colour.lab.L);
+
+    CHECK(uc::extractDominantColours("no/such/file.png").empty());
+}
+
 TEST_CASE("generateRandomImageColours returns five colours") {
     auto cols = uc::generateRandomImageColours(4, 4);
     CHECK(cols.size() == 5);
@@ -46,7 +78,8 @@ TEST_CASE("loadImageData returns image pixels") {
     CHECK(img.width == 2);
     CHECK(img.height == 2);
     CHECK(img.rgba.size() == 16);
-    CHECK(img.colours.size() == 4);
+    CHECK(img.pixelCount() == 4);
+    CHECK(img.lab()->size() == 4);
 }
 
 TEST_CASE("generateRandomImage returns requested size") {
@@ -54,5 +87,241 @@ TEST_CASE("generateRandomImage returns requested size") {
     CHECK(img.width == 3);
     CHECK(img.height == 2);
     CHECK(img.rgba.size() == 24);
-    CHECK(img.colours.size() == 6);
+    CHECK(img.pixelCount() == 6);
+    CHECK(img.lab()->size() == 6);
+}
+
+TEST_CASE("image fingerprint tracks pixel contents") {
+    std::string path = std::string(TEST_ASSETS_DIR) + "/test.png";
+    auto a = uc::loadSharedImage(path);
+    auto b = uc::loadSharedImage(path);
+    REQUIRE(a);
+    CHECK(a->fingerprint != 0);
+    CHECK(a->fingerprint == b->fingerprint);
+
+    uc::ImageData changed = *a;
+    changed.rgba[0] ^= 0xFF;
+    CHECK(uc::fingerprintImage(changed) != a->fingerprint);
+    CHECK(uc::fingerprintImage(uc::ImageData{}) == 0);
+}
+
+TEST_CASE("lab planes match per-pixel conversion") {
+    auto img = uc::generateRandomImage(16, 8);
+    auto planes = img.lab();
+    REQUIRE(planes->size() == img.pixelCount());
+    for (std::size_t i = 0; i < img.pixelCount(); ++i) {
+        const unsigned char *p = img.rgba.data() + i * 4;
+        auto c = uc::Colour::fromSRGB(p[0], p[1], p[2]);
+        CHECK(planes->L[i] == doctest::Approx(c.lab.L).epsilon(1e-4));
+        CHECK(planes->a[i] == doctest::Approx(c.lab.a).epsilon(1e-4));
+        CHECK(planes->b[i] == doctest::Approx(c.lab.b).epsilon(1e-4));
+    }
+}
+
+TEST_CASE("lab planes are cached within the budget") {
+    std::size_t budget = uc::labPlaneBudget();
+    std::size_t before = uc::labPlaneBytesCached();
+    {
+        auto img = uc::generateRandomImage(4, 4);
+        auto first = img.lab();
+        CHECK(img.lab() == first);
+        CHECK(uc::labPlaneBytesCached() == before + 16 * 3 * sizeof(float));
+
+        // Copies do not share the cache.
+        uc::ImageData copy = img;
+        CHECK(copy.lab() != first);
+    }
+    CHECK(uc::labPlaneBytesCached() == before);
+
+    uc::setLabPlaneBudget(0);
+    auto img = uc::generateRandomImage(4, 4);
+    auto first = img.lab();
+    CHECK(img.lab() != first);
+    CHECK(uc::labPlaneBytesCached() == before);
+    uc::setLabPlaneBudget(budget);
+}
+
+TEST_CASE("fromRGBA copies and converts across tiles") {
+    auto src = uc::generateRandomImage(300, 300);
+    uc::LoadProgress progress;
+    CHECK(progress.fraction() < 0.0f);
+    auto img = uc::ImageData::fromRGBA(src.width, src.height,
+                                       src.rgba.data(), &progress);
+    CHECK(img.rgba == src.rgba);
+    CHECK(img.fingerprint == src.fingerprint);
+    CHECK(progress.total == src.pixelCount());
+    CHECK(progress.fraction() == doctest::Approx(1.0f));
+
+    auto planes = img.lab();
+    auto expected = src.lab();
+    REQUIRE(planes->size() == expected->size());
+    CHECK(planes->L == expected->L);
+    CHECK(planes->a == expected->a);
+    CHECK(planes->b == expected->b);
+}
+
+TEST_CASE("downsampleImage fits the pixel budget in linear light") {
+    // Alternating black and white columns average to mid grey in linear
+    // light, which is far brighter than sRGB level 128.
+    const int w = 64, h = 32;
+    std::vector<unsigned char> px(static_cast<std::size_t>(w) * h * 4);
+    for (std::size_t i = 0; i < px.size() / 4; ++i) {
+        unsigned char v = (i % 2) ? 255 : 0;
+        px[i * 4 + 0] = px[i * 4 + 1] = px[i * 4 + 2] = v;
+        px[i * 4 + 3] = 255;
+    }
+    auto img = std::make_shared<const uc::ImageData>(
+        uc::ImageData::fromRGBA(w, h, px.data()));
+    CHECK(uc::downsampleImage(img, 0) == img);
+    CHECK(uc::downsampleImage(img, img->pixelCount()) == img);
+
+    auto small = uc::downsampleImage(img, 128);
+    REQUIRE(small);
+    CHECK(small->pixelCount() <= 128);
+    CHECK(small->width == 2 * small->height);
+    CHECK(small->fingerprint != 0);
+    for (std::size_t i = 0; i < small->pixelCount(); ++i) {
+        CHECK(small->rgba[i * 4 + 0] == 188);
+        CHECK(small->rgba[i * 4 + 3] == 255);
+    }
+}
+
+TEST_CASE("makeThumbnail fits the preview box") {
+    auto img = uc::generateRandomImage(400, 100);
+    auto cached = uc::labPlaneBytesCached();
+    auto thumb = uc::makeThumbnail(img, 200, 40);
+    CHECK(thumb.width == 160);
+    CHECK(thumb.height == 40);
+    CHECK(thumb.rgba.size() == thumb.pixelCount() * 4);
+    CHECK(thumb.fingerprint != 0);
+    CHECK(uc::labPlaneBytesCached() == cached);
+
+    auto small = uc::makeThumbnail(img, 1000, 1000);
+    CHECK(small.width == img.width);
+    CHECK(small.rgba == img.rgba);
+    CHECK(uc::makeThumbnail(uc::ImageData{}, 10, 10).empty());
+}
+
+TEST_CASE("loadSharedImage reuses a live decode of the same file") {
+    std::string path = std::string(TEST_ASSETS_DIR) + "/test.png";
+    auto first = uc::loadSharedImage(path);
+    REQUIRE(first);
+    uc::LoadProgress progress;
+    auto again = uc::loadSharedImage(path, &progress);
+    CHECK(again == first);
+    CHECK(progress.fraction() == doctest::Approx(1.0f));
+
+    first.reset();
+    again.reset();
+    auto fresh = uc::loadSharedImage(path);
+    REQUIRE(fresh);
+    CHECK(fresh->pixelCount() == 4);
+}
+
+TEST_CASE("random images and samples are reproducible from a seed") {
+    auto a = uc::generateRandomImage(300, 250, 11);
+    auto b = uc::generateRandomImage(300, 250, 11);
+    CHECK(a.rgba == b.rgba);
+    CHECK(a.fingerprint == b.fingerprint);
+    CHECK(uc::generateRandomImage(300, 250, 12).rgba != a.rgba);
+    for (std::size_t i = 0; i < a.pixelCount(); ++i)
+        REQUIRE(a.rgba[i * 4 + 3] == 255);
+
+    uc::RandomLabSource src{5, 1000};
+    CHECK(src.size() == 1000);
+    double meanL = 0.0;
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        auto p = src[i];
+        REQUIRE(p.L >= 0.0);
+        REQUIRE(p.L < 1.0);
+        REQUIRE(std::abs(p.a) <= 0.5);
+        REQUIRE(std::abs(p.b) <= 0.5);
+        meanL += p.L / 1000.0;
+    }
+    CHECK(meanL == doctest::Approx(0.5).epsilon(0.1));
+    CHECK(src[17].a == uc::RandomLabSource{5, 10}[17].a);
+}
+
+TEST_CASE("16-bit pixels keep their precision in the planes") {
+    // Both levels round to the same byte but must not share a lightness.
+    std::vector<std::uint16_t> px = {30000, 30000, 30000, 65535,
+                                     30100, 30100, 30100, 65535};
+    auto img = uc::ImageData::fromRGBA16(2, 1, px.data());
+    CHECK(img.bitDepth == 16);
+    CHECK(img.rgba[0] == img.rgba[4]);
+    CHECK(img.rgba[3] == 255);
+    auto planes = img.lab();
+    CHECK(planes->L[0] < planes->L[1]);
+
+    std::vector<float> L(2), a(2), b(2);
+    uc::srgb16ToLab(px, L, a, b);
+    CHECK(planes->L == L);
+
+
+    std::vector<std::uint16_t> flat(64 * 64 * 4, 50000);
+    auto big = std::make_shared<const uc::ImageData>(
+        uc::ImageData::fromRGBA16(64, 64, flat.data()));
+    auto small = uc::downsampleImage(big, 256);
+    REQUIRE(small);
+    CHECK(small->bitDepth == 16);
+    CHECK(small->lab()->L[0] ==
+          doctest::Approx(big->lab()->L[0]).epsilon(1e-4));
+}
+
+TEST_CASE("toneMapHDR compresses only bright images") {
+    std::vector<float> ldr = {0.2f, 0.5f, 0.9f, 1.0f};
+    auto before = ldr;
+    uc::toneMapHDR(ldr);
+    CHECK(ldr == before);
+
+    std::vector<float> hdr = {8.0f, 8.0f, 8.0f, 0.5f, 0.5f, 0.25f, 0.1f, 1.0f};
+    uc::toneMapHDR(hdr);
+    CHECK(hdr[0] == doctest::Approx(1.0f));
+    CHECK(hdr[3] == 0.5f);
+    CHECK(hdr[4] < 0.5f);
+    CHECK(hdr[4] / hdr[5] == doctest::Approx(2.0f));
+}
+
+TEST_CASE("loadImageData decodes Radiance HDR files") {
+    // A flat 2x1 image: one pixel at 4.0 and one at 0.5 in every channel.
+    auto path = std::filesystem::temp_directory_path() / "urcolo_test.hdr";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y 1 +X 2\n";
+        const unsigned char px[] = {128, 128, 128, 131, 128, 128, 128, 128};
+        out.write(reinterpret_cast<const char *>(px), sizeof(px));
+    }
+    auto img = uc::loadImageData(path.string());
+    std::filesystem::remove(path);
+    REQUIRE(img.width == 2);
+    CHECK(img.bitDepth == 32);
+    CHECK(img.rgba[0] == 255);
+    CHECK(img.rgba[4] < img.rgba[0]);
+    CHECK(img.rgba[4] > 0);
+    CHECK(img.rgba[7] == 255);
+}
+
+TEST_CASE("loadImageFrames splits an animated GIF") {
+    // Three 4x2 frames, filled red, blue and green in turn.
+    std::string path = std::string(TEST_ASSETS_DIR) + "/frames.gif";
+    uc::LoadProgress progress;
+    auto frames = uc::loadImageFrames(path, &progress);
+    REQUIRE(frames.size() == 3);
+    CHECK(progress.total == 24);
+    CHECK(progress.done == 24);
+    const std::array<std::array<unsigned char, 3>, 3> fills = {
+        {{255, 0, 0}, {0, 0, 255}, {0, 255, 0}}};
+    for (std::size_t f = 0; f < frames.size(); ++f) {
+        const auto &frame = *frames.frames[f];
+        REQUIRE(frame.pixelCount() == 8);
+        CHECK(frame.rgba[0] == fills[f][0]);
+        CHECK(frame.rgba[1] == fills[f][1]);
+        CHECK(frame.rgba[2] == fills[f][2]);
+        CHECK(frame.lab()->L == std::vector<float>(8, frame.lab()->L[0]));
+    }
+
+    auto still = uc::loadImageFrames(std::string(TEST_ASSETS_DIR) +
+                                     "/test.png");
+    REQUIRE(still.size() == 1);
+    CHECK(uc::loadImageFrames("no/such/file.gif").empty());
 }
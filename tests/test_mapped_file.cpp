@@ -0,0 +1,36 @@
+// urColo - tests read-only memory-mapped files
+#include "urColo/MappedFile.h"
+#include <cstring>
+#include <doctest/doctest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+
+TEST_CASE("mapped file exposes the file contents") {
+    std::string path = std::string(TEST_ASSETS_DIR) + "/test.png";
+    uc::MappedFile file(path);
+    REQUIRE(file);
+    CHECK(file.size() == std::filesystem::file_size(path));
+
+    std::string bytes(file.size(), '\0');
+    std::ifstream in(path, std::ios::binary);
+    REQUIRE(in.read(bytes.data(), static_cast<std::streamsize>(bytes.size())));
+    CHECK(std::memcmp(file.data(), bytes.data(), bytes.size()) == 0);
+
+    uc::MappedFile moved = std::move(file);
+    CHECK(moved);
+    CHECK_FALSE(file);
+    CHECK(moved.size() == bytes.size());
+}
+
+TEST_CASE("mapped file reports missing and empty files") {
+    CHECK_FALSE(uc::MappedFile("no/such/file.png"));
+
+    auto path = std::filesystem::temp_directory_path() / "urcolo_empty.bin";
+    std::ofstream(path).close();
+    uc::MappedFile empty(path.string());
+    CHECK(empty);
+    CHECK(empty.size() == 0);
+    std::filesystem::remove(path);
+}
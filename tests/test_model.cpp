@@ -1,7 +1,10 @@
 // urColo - tests model training and colour suggestions via JSON round trip
 #include "urColo/Model.h"
+#include <algorithm>
 #include <doctest/doctest.h>
 #include <nlohmann/json.hpp>
+#include <random>
+#include <sstream>
 
 TEST_CASE("model training and suggestion") {
     uc::Palette p{"p"};
@@ -27,3 +30,194 @@ TEST_CASE("model training and suggestion") {
     double trainedL = j["mean"][0].get<double>();
     CHECK(avg == doctest::Approx(trainedL).epsilon(0.5));
 }
+
+TEST_CASE("mixture separates two palette styles") {
+    // Many dark blues and many light yellows: a single Gaussian would put
+    // its mean in the grey middle where neither style lives.
+    uc::Palette p{"p"};
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> jitter(-0.03f, 0.03f);
+    for (int i = 0; i < 200; ++i) {
+        p.addSwatch("d", {0.08f + jitter(rng), 0.13f + jitter(rng),
+                          0.4f + jitter(rng), 1.0f});
+        p.addSwatch("l", {0.92f + jitter(rng), 0.9f + jitter(rng),
+                          0.5f + jitter(rng), 1.0f});
+    }
+
+    uc::Model m(7);
+    m.setComponents(2);
+    m.train({p});
+    REQUIRE(m.mixture().size() == 2);
+
+    double lo = std::min(m.mixture()[0].mean.L, m.mixture()[1].mean.L);
+    double hi = std::max(m.mixture()[0].mean.L, m.mixture()[1].mean.L);
+    CHECK(lo < 0.4);
+    CHECK(hi > 0.8);
+    for (const auto &c : m.mixture())
+        CHECK(c.weight == doctest::Approx(0.5).epsilon(0.05));
+
+    // Samples should land near one of the two styles, not in between.
+    int between = 0;
+    for (const auto &sw : m.suggest(200)) {
+        double L = uc::Colour::fromImVec4(sw._colour).lab.L;
+        if (L > lo + 0.15 && L < hi - 0.15)
+            ++between;
+    }
+    CHECK(between < 10);
+}
+
+TEST_CASE("mixture survives a JSON round trip") {
+    uc::Palette p{"p"};
+    p.addSwatch("r", {1.0f, 0.0f, 0.0f, 1.0f});
+    p.addSwatch("b", {0.0f, 0.0f, 1.0f, 1.0f});
+    p.addSwatch("w", {1.0f, 1.0f, 1.0f, 1.0f});
+
+    uc::Model m(5);
+    m.setComponents(3);
+    m.train({p});
+    nlohmann::json j = m;
+    auto copy = j.get<uc::Model>();
+    CHECK(copy.components() == 3);
+    REQUIRE(copy.mixture().size() == m.mixture().size());
+    for (std::size_t c = 0; c < m.mixture().size(); ++c) {
+        CHECK(copy.mixture()[c].weight ==
+              doctest::Approx(m.mixture()[c].weight));
+        CHECK(copy.mixture()[c].cov[4] ==
+              doctest::Approx(m.mixture()[c].cov[4]));
+    }
+}
+
+TEST_CASE("model files without a mixture still load") {
+    nlohmann::json j = {{"mean", {0.6, 0.05, -0.05}},
+                        {"stdev", {0.1, 0.02, 0.02}},
+                        {"trained", true}};
+    auto m = j.get<uc::Model>();
+    REQUIRE(m.mixture().size() == 1);
+    CHECK(m.mixture()[0].mean.L == doctest::Approx(0.6));
+    CHECK(m.suggest(4).size() == 4);
+}
+
+TEST_CASE("colour statistics merge like a single pass") {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> u(-0.3, 0.3);
+    uc::ColourStats all, left, right;
+    for (int i = 0; i < 500; ++i) {
+        uc::LAB x{0.5 + u(rng), u(rng), u(rng)};
+        all.add(x);
+        (i < 200 ? left : right).add(x);
+    }
+    left.merge(right);
+    CHECK(left.weight == doctest::Approx(all.weight));
+    CHECK(left.mean.a == doctest::Approx(all.mean.a));
+    auto a = all.covariance();
+    auto b = left.covariance();
+    for (std::size_t i = 0; i < a.size(); ++i)
+        CHECK(b[i] == doctest::Approx(a[i]));
+}
+
+TEST_CASE("sharded ingest matches ingesting one palette at a time") {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> c(0.0f, 1.0f);
+    std::vector<uc::Palette> corpus;
+    for (int i = 0; i < 600; ++i) {
+        uc::Palette p{"p"};
+        for (int s = 0; s < 4; ++s)
+            p.addSwatch("s", {c(rng), c(rng), c(rng), 1.0f});
+        corpus.push_back(p);
+    }
+
+    // Once the mixture is complete, batches only differ from sequential
+    // ingestion in that every palette sees the same parameters.
+    uc::Model seq(1), par(1);
+    seq.setComponents(2);
+    par.setComponents(2);
+    seq.ingest(corpus[0]);
+    par.ingest(corpus[0]);
+    REQUIRE(seq.mixture().size() == 2);
+    auto acc = seq.accumulate(std::span(corpus).subspan(1));
+    seq.absorb(acc);
+    par.ingest(std::span<const uc::Palette>(corpus).subspan(1));
+
+    CHECK(par.colourCount() == doctest::Approx(seq.colourCount()));
+    for (std::size_t k = 0; k < 2; ++k) {
+        CHECK(par.mixture()[k].weight ==
+              doctest::Approx(seq.mixture()[k].weight));
+        CHECK(par.mixture()[k].mean.L ==
+              doctest::Approx(seq.mixture()[k].mean.L));
+        CHECK(par.mixture()[k].cov[1] ==
+              doctest::Approx(seq.mixture()[k].cov[1]));
+    }
+}
+
+TEST_CASE("ingesting a palette moves the model towards it") {
+    uc::Palette dark{"d"};
+    dark.addSwatch("k", {0.05f, 0.05f, 0.05f, 1.0f});
+    uc::Model m(3);
+    m.setComponents(1);
+    m.train({dark});
+    double before = nlohmann::json(m)["mean"][0].get<double>();
+
+    uc::Palette light{"l"};
+    light.addSwatch("w", {0.95f, 0.95f, 0.95f, 1.0f});
+    m.ingest(light);
+    double after = nlohmann::json(m)["mean"][0].get<double>();
+    CHECK(after > before);
+    CHECK(m.colourCount() == doctest::Approx(2.0));
+    CHECK(m.mixture()[0].mean.L == doctest::Approx(after));
+}
+
+TEST_CASE("model trains from JSON and JSON Lines streams") {
+    std::vector<uc::Palette> pals;
+    for (int i = 0; i < 3; ++i) {
+        uc::Palette p{"p"};
+        p.addSwatch("r", {1.0f, 0.2f * static_cast<float>(i), 0.0f, 1.0f});
+        p.addSwatch("b", {0.0f, 0.0f, 1.0f, 1.0f});
+        pals.push_back(p);
+    }
+
+    std::istringstream array{nlohmann::json(pals).dump()};
+    std::string lines;
+    for (const auto &p : pals)
+        lines += nlohmann::json(p).dump() + "\n";
+    std::istringstream jsonl{lines};
+
+    uc::Model a(2), b(2);
+    CHECK(a.ingestStream(array) == 3);
+    CHECK(b.ingestStream(jsonl) == 3);
+    CHECK(a.colourCount() == doctest::Approx(6.0));
+    CHECK(b.colourCount() == doctest::Approx(6.0));
+    REQUIRE(a.mixture().size() == b.mixture().size());
+    CHECK(a.mixture()[0].mean.L == doctest::Approx(b.mixture()[0].mean.L));
+
+    // Statistics survive a save and load, so ingestion can continue.
+    auto copy = nlohmann::json(a).get<uc::Model>();
+    CHECK(copy.colourCount() == doctest::Approx(6.0));
+}
+
+TEST_CASE("model learns each good palette once") {
+    uc::Palette warm{"warm"};
+    warm.addSwatch("r", {0.9f, 0.2f, 0.1f, 1.0f});
+    warm.addSwatch("o", {1.0f, 0.6f, 0.2f, 1.0f});
+    uc::Palette cool{"cool"};
+    cool.addSwatch("b", {0.1f, 0.3f, 0.9f, 1.0f});
+
+    uc::Model m(1);
+    std::vector<uc::Palette> good{warm};
+    CHECK(m.ingestNew(good).size() == 1);
+    CHECK(m.ingestNew(good).empty());
+    good.push_back(cool);
+    CHECK(m.ingestNew(good).size() == 1);
+    CHECK(m.colourCount() == doctest::Approx(3.0));
+
+    // What has been learned is remembered across a save and load.
+    auto copy = nlohmann::json(m).get<uc::Model>();
+    CHECK(copy.ingestNew(good).empty());
+
+    // Without the palettes saved they are learned again, so a reloaded
+    // model does not skip palettes it has no index entry for.
+    m.setSavePalettes(false);
+    CHECK_FALSE(nlohmann::json(m).contains("learned"));
+    auto bare = nlohmann::json(m).get<uc::Model>();
+    CHECK(bare.ingestNew(good).size() == 2);
+    CHECK(bare.paletteCount() == 2);
+}
@@ -0,0 +1,147 @@
+// urColo - tests merging weighted images into a mood board
+#include "urColo/Colour.h"
+#include "urColo/MoodBoard.h"
+#include "urColo/PaletteGenerator.h"
+#include <cmath>
+#include <doctest/doctest.h>
+#include <memory>
+#include <vector>
+
+namespace {
+// Image of `w` by `h` pixels, the first `split` columns in `left` and the
+// rest in `right`.
+uc::SharedImage twoTone(int w, int h, int split, uc::Colour left,
+                        uc::Colour right) {
+    auto l = left.toSRGB8();
+    auto r = right.toSRGB8();
+    std::vector<unsigned char> px;
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            const auto &c = x < split ? l : r;
+            px.insert(px.end(), {c[0], c[1], c[2], 255});
+        }
+    }
+    return std::make_shared<const uc::ImageData>(
+        uc::ImageData::fromRGBA(w, h, px.data()));
+}
+
+const uc::Colour red = uc::Colour::fromSRGB(255, 0, 0);
+const uc::Colour blue = uc::Colour::fromSRGB(0, 0, 255);
+const uc::Colour green = uc::Colour::fromSRGB(0, 255, 0);
+
+// Total weight the board gives to colours near `c`.
+double weightNear(const uc::WeightedColours &w, const uc::Colour &c) {
+    double total = 0.0;
+    for (std::size_t i = 0; i < w.size(); ++i) {
+        double dL = w[i].L - c.lab.L;
+        double da = w[i].a - c.lab.a;
+        double db = w[i].b - c.lab.b;
+        if (dL * dL + da * da + db * db < 1e-4)
+            total += w.weights[i];
+    }
+    return total;
+}
+} // namespace
+
+TEST_CASE("histogramOf bins pixels by OKLab cell") {
+    auto img = twoTone(8, 4, 2, red, blue);
+    auto hist = uc::histogramOf(img);
+    CHECK(hist.fingerprint == img->fingerprint);
+    CHECK(hist.pixels == 32);
+    REQUIRE(hist.cells.size() == 2);
+    CHECK(hist.counts[0] + hist.counts[1] == 32.0);
+    for (std::size_t i = 0; i < hist.cells.size(); ++i) {
+        uc::LAB mean{hist.sums[i].L / hist.counts[i],
+                     hist.sums[i].a / hist.counts[i],
+                     hist.sums[i].b / hist.counts[i]};
+        const auto &want = hist.counts[i] == 8.0 ? red : blue;
+        CHECK(mean.L == doctest::Approx(want.lab.L).epsilon(1e-5));
+        CHECK(mean.b == doctest::Approx(want.lab.b).epsilon(1e-5));
+    }
+    CHECK(uc::histogramOf(nullptr).empty());
+    CHECK(uc::histogramOf(img, 8).pixels <= 8);
+}
+
+TEST_CASE("mood board merges weighted images incrementally") {
+    auto a = twoTone(8, 8, 8, red, red);
+    auto b = twoTone(64, 64, 32, blue, green);
+    uc::MoodBoard board;
+    CHECK(board.colours()->size() == 0);
+    CHECK(board.colours()->fingerprint == 0);
+    CHECK_FALSE(board.add(uc::histogramOf(nullptr)));
+    CHECK_FALSE(board.add(uc::histogramOf(a), 0.0));
+
+    REQUIRE(board.add(uc::histogramOf(a), 2.0));
+    REQUIRE(board.add(uc::histogramOf(b)));
+    CHECK(board.size() == 2);
+    CHECK(board.weight(a->fingerprint) == 2.0);
+    auto merged = board.colours();
+    CHECK(board.colours() == merged);
+    // The small image counts for its weight, not its pixel count.
+    CHECK(weightNear(*merged, red) == doctest::Approx(2.0));
+    CHECK(weightNear(*merged, blue) == doctest::Approx(0.5));
+    CHECK(weightNear(*merged, green) == doctest::Approx(0.5));
+
+    REQUIRE(board.setWeight(b->fingerprint, 4.0));
+    auto reweighted = board.colours();
+    CHECK(reweighted != merged);
+    CHECK(reweighted->fingerprint != merged->fingerprint);
+    CHECK(weightNear(*reweighted, blue) == doctest::Approx(2.0));
+    CHECK_FALSE(board.setWeight(b->fingerprint, -1.0));
+    CHECK_FALSE(board.setWeight(42, 1.0));
+
+    REQUIRE(board.remove(a->fingerprint));
+    CHECK_FALSE(board.remove(a->fingerprint));
+    auto rest = board.colours();
+    REQUIRE(rest->size() == 2);
+    CHECK(weightNear(*rest, red) == 0.0);
+    CHECK(weightNear(*rest, green) == doctest::Approx(2.0));
+
+    // Adding an image again replaces it rather than counting it twice.
+    REQUIRE(board.add(uc::histogramOf(b), 1.0));
+    CHECK(board.size() == 1);
+    CHECK(weightNear(*board.colours(), blue) == doctest::Approx(0.5));
+    board.clear();
+    CHECK(board.empty());
+    CHECK(board.colours()->size() == 0);
+}
+
+TEST_CASE("k-means clusters the colours of a mood board") {
+    uc::MoodBoard board;
+    board.add(uc::histogramOf(twoTone(16, 16, 16, red, red)));
+    board.add(uc::histogramOf(twoTone(16, 16, 16, blue, blue)));
+
+    uc::PaletteGenerator gen(7);
+    gen.setAlgorithm(uc::PaletteGenerator::KMeans);
+    gen.setKMeansColours(board.colours());
+    CHECK(gen.kMeansFingerprint() == board.colours()->fingerprint);
+    auto out = gen.generate({}, 2);
+    REQUIRE(out.size() == 2);
+    bool sawRed = false, sawBlue = false;
+    for (const auto &sw : out) {
+        auto rgb = uc::Colour::fromImVec4(sw._colour).toSRGB8();
+        sawRed |= rgb[0] > 250 && rgb[2] < 5;
+        sawBlue |= rgb[2] > 250 && rgb[0] < 5;
+    }
+    CHECK(sawRed);
+    CHECK(sawBlue);
+
+    gen.setKMeansColours(nullptr);
+    CHECK(gen.kMeansFingerprint() == 0);
+}
+
+TEST_CASE("pooled colours weigh images by their pixels") {
+    auto big = twoTone(16, 16, 16, red, red);
+    auto small = twoTone(8, 8, 8, blue, blue);
+    std::vector<uc::SharedImage> frames{big, small, big};
+    auto pooled = uc::pooledColours(frames);
+    REQUIRE(pooled);
+    CHECK(weightNear(*pooled, red) == doctest::Approx(512.0));
+    CHECK(weightNear(*pooled, blue) == doctest::Approx(64.0));
+    CHECK(pooled->fingerprint != 0);
+
+    // Downsampled histograms are scaled back up to the full pixel counts.
+    auto budgeted = uc::pooledColours(frames, 16);
+    CHECK(weightNear(*budgeted, red) == doctest::Approx(512.0));
+    CHECK(uc::pooledColours({})->size() == 0);
+}
@@ -0,0 +1,133 @@
+// urColo - tests the palette index and locked-colour learned suggestions
+#include "urColo/Model.h"
+#include "urColo/PaletteIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <doctest/doctest.h>
+#include <nlohmann/json.hpp>
+#include <random>
+
+namespace {
+double distance(const uc::LAB &a, const uc::LAB &b) {
+    double dL = a.L - b.L;
+    double da = a.a - b.a;
+    double db = a.b - b.b;
+    return std::sqrt(dL * dL + da * da + db * db);
+}
+
+// Mean distance from each query colour to the closest colour of `pal`.
+double score(std::span<const uc::LAB> query, std::span<const uc::LAB> pal) {
+    double total = 0.0;
+    for (const auto &q : query) {
+        double best = 1e9;
+        for (const auto &c : pal)
+            best = std::min(best, distance(q, c));
+        total += best;
+    }
+    return total / static_cast<double>(query.size());
+}
+} // namespace
+
+TEST_CASE("palette index finds the same best match as a linear scan") {
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<double> L(0.0, 1.0);
+    std::uniform_real_distribution<double> ab(-0.3, 0.3);
+    uc::PaletteIndex idx;
+    std::vector<std::vector<uc::LAB>> pals;
+    for (int p = 0; p < 2000; ++p) {
+        std::vector<uc::LAB> cols;
+        for (int s = 0; s < 5; ++s)
+            cols.push_back({L(rng), ab(rng), ab(rng)});
+        idx.add(cols);
+        pals.push_back(cols);
+    }
+    idx.build();
+    REQUIRE(idx.size() == 2000);
+
+    for (int t = 0; t < 20; ++t) {
+        // With one query colour the best palette owns the nearest swatch,
+        // so the tree search must find it.
+        std::vector<uc::LAB> one{{L(rng), ab(rng), ab(rng)}};
+        double best = 1e9;
+        for (const auto &pal : pals)
+            best = std::min(best, score(one, pal));
+        auto found = idx.nearest(one, 4);
+        REQUIRE(found.size() == 4);
+        CHECK(found.front().score == doctest::Approx(best));
+
+        // With several, every reported score is the palette's true score
+        // and results come best first.
+        std::vector<uc::LAB> two{one[0], {L(rng), ab(rng), ab(rng)}};
+        found = idx.nearest(two, 4);
+        REQUIRE(!found.empty());
+        CHECK(std::is_sorted(found.begin(), found.end(),
+                             [](const auto &a, const auto &b) {
+                                 return a.score < b.score;
+                             }));
+        for (const auto &f : found)
+            CHECK(f.score == doctest::Approx(score(two, pals[f.palette])));
+    }
+}
+
+TEST_CASE("palette index survives a JSON round trip") {
+    uc::PaletteIndex idx;
+    idx.add(std::vector<uc::LAB>{{0.2, 0.1, 0.0}, {0.8, 0.0, -0.1}});
+    idx.add(std::vector<uc::LAB>{{0.5, -0.1, 0.1}});
+    idx.build();
+    nlohmann::json j = idx;
+    auto copy = j.get<uc::PaletteIndex>();
+    REQUIRE(copy.size() == 2);
+    CHECK(copy.palette(1).size() == 1);
+    CHECK(copy.palette(0)[1].L == doctest::Approx(0.8));
+    std::vector<uc::LAB> q{{0.5, -0.1, 0.1}};
+    CHECK(copy.nearest(q, 1).front().palette == 1);
+
+    j["starts"] = {0, 2};
+    CHECK_THROWS_AS(j.get<uc::PaletteIndex>(), std::out_of_range);
+}
+
+TEST_CASE("learned suggestions follow palettes matching the locked colour") {
+    // Two styles sharing nothing: reds go with dark blue, greens with pale
+    // yellow. Locking a red should suggest the dark blue.
+    std::vector<uc::Palette> corpus;
+    for (int i = 0; i < 50; ++i) {
+        uc::Palette red{"red"};
+        red.addSwatch("r", {0.9f, 0.1f, 0.1f, 1.0f});
+        red.addSwatch("n", {0.05f, 0.05f, 0.3f, 1.0f});
+        corpus.push_back(red);
+        uc::Palette green{"green"};
+        green.addSwatch("g", {0.1f, 0.8f, 0.2f, 1.0f});
+        green.addSwatch("y", {1.0f, 1.0f, 0.7f, 1.0f});
+        corpus.push_back(green);
+    }
+    uc::Model m(4);
+    m.train(corpus);
+    CHECK(m.paletteCount() == corpus.size());
+
+    std::vector<uc::LAB> locked{
+        uc::Colour::fromImVec4({0.88f, 0.12f, 0.1f, 1.0f}).lab};
+    const uc::LAB navy =
+        uc::Colour::fromImVec4({0.05f, 0.05f, 0.3f, 1.0f}).lab;
+    for (const auto &sw : m.suggest(10, locked))
+        CHECK(distance(uc::Colour::fromImVec4(sw._colour).lab, navy) < 0.06);
+
+    // The index is saved with the model by default, so a reloaded model
+    // still follows the locked colour.
+    auto copy = nlohmann::json(m).get<uc::Model>();
+    CHECK(copy.paletteCount() == corpus.size());
+    CHECK(copy.savePalettes());
+    for (const auto &sw : copy.suggest(10, locked))
+        CHECK(distance(uc::Colour::fromImVec4(sw._colour).lab, navy) < 0.06);
+
+    // Leaving it out is remembered by the reloaded model.
+    m.setSavePalettes(false);
+    auto bare = nlohmann::json(m);
+    CHECK_FALSE(bare.contains("palettes"));
+    CHECK_FALSE(bare.get<uc::Model>().savePalettes());
+
+    // Ingested palettes wait in a buffer but are counted and saved at once.
+    copy.ingest(corpus.front());
+    CHECK(copy.paletteCount() == corpus.size() + 1);
+    auto again = nlohmann::json(copy).get<uc::Model>();
+    CHECK(again.paletteCount() == corpus.size() + 1);
+}
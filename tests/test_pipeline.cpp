@@ -0,0 +1,149 @@
+// urColo - tests background generation pipeline delivery and cancellation
+#include "urColo/GenerationPipeline.h"
+#include "urColo/PaletteGenerator.h"
+#include <chrono>
+#include <doctest/doctest.h>
+#include <thread>
+
+namespace {
+// Poll until a result arrives or the pipeline goes idle.
+bool waitForResult(uc::GenerationPipeline &pipeline,
+                   std::vector<uc::GeneratedColour> &out) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (pipeline.poll(out))
+            return true;
+        if (!pipeline.busy())
+            return pipeline.poll(out);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+// A single generated colour, tagged with `palette` to tell results apart.
+std::vector<uc::GeneratedColour> tagged(std::size_t palette) {
+    return {{palette, 0, {1.0f, 0.0f, 0.0f, 1.0f}}};
+}
+
+// Job that runs until stopped, then returns a colour tagged `palette`.
+uc::GenerationPipeline::Job blockingJob(std::size_t palette) {
+    return [palette](std::stop_token stop, uc::JobProgress &progress) {
+        progress.set(0.5f);
+        while (!stop.stop_requested())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return tagged(palette);
+    };
+}
+} // namespace
+
+TEST_CASE("pipeline delivers job results") {
+    uc::GenerationPipeline pipeline;
+    pipeline.submit([](std::stop_token, uc::JobProgress &progress) {
+        progress.set(1.0f);
+        return tagged(1);
+    });
+
+    std::vector<uc::GeneratedColour> out;
+    REQUIRE(waitForResult(pipeline, out));
+    REQUIRE(out.size() == 1);
+    CHECK(out[0].palette == 1);
+    CHECK_FALSE(pipeline.busy());
+    CHECK_FALSE(pipeline.poll(out));
+}
+
+TEST_CASE("pipeline supersedes running jobs") {
+    uc::GenerationPipeline pipeline;
+    auto first = pipeline.submit(blockingJob(1));
+    auto second = pipeline.submit(
+        [](std::stop_token, uc::JobProgress &) { return tagged(2); });
+    CHECK(second > first);
+
+    std::vector<uc::GeneratedColour> out;
+    REQUIRE(waitForResult(pipeline, out));
+    REQUIRE(out.size() == 1);
+    CHECK(out[0].palette == 2);
+}
+
+TEST_CASE("pipeline cancellation drops the result") {
+    uc::GenerationPipeline pipeline;
+    pipeline.submit(blockingJob(1));
+    CHECK(pipeline.busy());
+    pipeline.cancel();
+
+    std::vector<uc::GeneratedColour> out;
+    CHECK_FALSE(waitForResult(pipeline, out));
+    CHECK(out.empty());
+    CHECK_FALSE(pipeline.busy());
+}
+
+TEST_CASE("generated colours keep edits made while the job ran") {
+    std::vector<uc::Palette> palettes(2);
+    for (auto &p : palettes) {
+        p.addSwatch("a", {0.0f, 0.0f, 0.0f, 1.0f});
+        p.addSwatch("b", {0.0f, 0.0f, 0.0f, 1.0f});
+    }
+    const ImVec4 red{1.0f, 0.0f, 0.0f, 1.0f};
+    std::vector<uc::GeneratedColour> result{
+        {0, 0, red}, {0, 1, red}, {1, 0, red}, {1, 1, red}, {2, 0, red}};
+
+    // Meanwhile one swatch was locked, one removed and a palette deleted.
+    palettes[0]._swatches[1]._locked = true;
+    palettes[1]._swatches.pop_back();
+    CHECK(uc::applyGenerated(palettes, result) == 2);
+    CHECK(palettes[0]._swatches[0]._colour.x == 1.0f);
+    CHECK(palettes[0]._swatches[1]._colour.x == 0.0f);
+    CHECK(palettes[1]._swatches[0]._colour.x == 1.0f);
+    CHECK(palettes[1]._swatches.size() == 1);
+}
+
+TEST_CASE("stopped k-means still returns colours") {
+    uc::PaletteGenerator gen(5);
+    gen.setAlgorithm(uc::PaletteGenerator::KMeans);
+    gen.setKMeansIterations(50);
+    gen.setKMeansRandomImage(32, 32);
+
+    std::stop_source source;
+    source.request_stop();
+    auto out = gen.generate({}, 4, source.get_token());
+    CHECK(out.size() == 4);
+    CHECK(gen.lastKMeansIterations() == 0);
+}
+
+TEST_CASE("generator copies share k-means warm state") {
+    uc::PaletteGenerator gen(9);
+    gen.setAlgorithm(uc::PaletteGenerator::KMeans);
+    gen.setKMeansIterations(50);
+    gen.setKMeansRandomImage(32, 32);
+    gen.generate({}, 4);
+    int cold = gen.lastKMeansIterations();
+
+    uc::PaletteGenerator copy = gen;
+    copy.reseed(gen.drawSeed());
+    copy.generate({}, 4);
+    CHECK(copy.lastKMeansIterations() <= cold);
+}
+
+TEST_CASE("k-means warm state stays in its own slot") {
+    // Palette 2 comes out the same whether or not palette 1 ran first on
+    // a copy sharing the warm-start cache.
+    auto run = [](bool otherFirst) {
+        uc::PaletteGenerator gen(9);
+        gen.setAlgorithm(uc::PaletteGenerator::KMeans);
+        gen.setKMeansRandomImage(32, 32, 5);
+        if (otherFirst) {
+            uc::PaletteGenerator other = gen;
+            other.reseed(1);
+            other.setKMeansSlot(1);
+            other.generate({}, 4);
+        }
+        uc::PaletteGenerator local = gen;
+        local.reseed(2);
+        local.setKMeansSlot(2);
+        return local.generate({}, 4);
+    };
+    auto alone = run(false);
+    auto after = run(true);
+    REQUIRE(alone.size() == after.size());
+    for (std::size_t i = 0; i < alone.size(); ++i)
+        CHECK(alone[i]._colour.x == after[i]._colour.x);
+}
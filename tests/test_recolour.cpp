@@ -0,0 +1,75 @@
+// urColo - tests palette-mapped image recolouring
+#include "urColo/Colour.h"
+#include "urColo/Recolour.h"
+#include <doctest/doctest.h>
+#include <vector>
+
+namespace {
+// Image of `w` by `h` pixels all of one 8-bit grey level.
+uc::ImageData grey(int w, int h, unsigned char v) {
+    std::vector<unsigned char> px(static_cast<std::size_t>(w) * h * 4, v);
+    for (std::size_t i = 3; i < px.size(); i += 4)
+        px[i] = 255;
+    return uc::ImageData::fromRGBA(w, h, px.data());
+}
+
+// Fraction of white pixels in a black-and-white image.
+double whiteShare(const uc::ImageData &img) {
+    std::size_t white = 0;
+    for (std::size_t i = 0; i < img.pixelCount(); ++i) {
+        unsigned char v = img.rgba[i * 4];
+        REQUIRE((v == 0 || v == 255));
+        white += v == 255;
+    }
+    return static_cast<double>(white) / static_cast<double>(img.pixelCount());
+}
+
+const std::vector<uc::LAB> blackWhite{uc::Colour::fromSRGB(0, 0, 0).lab,
+                                      uc::Colour::fromSRGB(255, 255, 255).lab};
+} // namespace
+
+TEST_CASE("palette lut maps colours to their nearest entry") {
+    std::vector<uc::LAB> palette{uc::Colour::fromSRGB(0, 0, 0).lab,
+                                 uc::Colour::fromSRGB(255, 255, 255).lab,
+                                 uc::Colour::fromSRGB(255, 0, 0).lab,
+                                 uc::Colour::fromSRGB(0, 0, 255).lab};
+    uc::PaletteLut lut(palette);
+    for (std::size_t i = 0; i < palette.size(); ++i)
+        CHECK(lut.nearest(palette[i]) == i);
+    CHECK(lut.nearest(uc::Colour::fromSRGB(230, 20, 30).lab) == 2);
+    CHECK(lut.nearest({2.0, 0.0, 0.0}) == 1);
+    CHECK(uc::PaletteLut{}.empty());
+}
+
+TEST_CASE("recolouring without dithering keeps palette colours") {
+    std::vector<unsigned char> px{255, 0, 0, 255, 0, 0, 255, 128};
+    auto img = uc::ImageData::fromRGBA(2, 1, px.data());
+    std::vector<uc::LAB> palette{uc::Colour::fromSRGB(255, 0, 0).lab,
+                                 uc::Colour::fromSRGB(0, 0, 255).lab};
+    auto out = uc::recolourImage(img, palette);
+    CHECK(out.width == 2);
+    CHECK(out.rgba == px);
+    CHECK(uc::recolourImage(img, {}).empty());
+}
+
+TEST_CASE("dithering mixes palette colours to match the mean") {
+    auto img = grey(128, 96, 128);
+    const double L = uc::Colour::fromSRGB(128, 128, 128).lab.L;
+
+    auto flat = uc::recolourImage(img, blackWhite);
+    CHECK(whiteShare(flat) == doctest::Approx(1.0));
+
+    auto fs = uc::recolourImage(img, blackWhite, uc::Dither::FloydSteinberg);
+    CHECK(whiteShare(fs) == doctest::Approx(L).epsilon(0.03));
+
+    auto noise = uc::recolourImage(img, blackWhite, uc::Dither::BlueNoise);
+    double share = whiteShare(noise);
+    CHECK(share > 0.05);
+    CHECK(share < 0.95);
+
+    std::stop_source stop;
+    stop.request_stop();
+    CHECK(uc::recolourImage(img, blackWhite, uc::Dither::FloydSteinberg,
+                            stop.get_token())
+              .empty());
+}
@@ -0,0 +1,59 @@
+// urColo - tests SLIC superpixel segmentation
+#include "urColo/Colour.h"
+#include "urColo/Superpixels.h"
+#include <cmath>
+#include <doctest/doctest.h>
+#include <vector>
+
+namespace {
+// Image whose left `split` columns are red and the rest blue.
+uc::ImageData halves(int w, int h, int split) {
+    std::vector<unsigned char> px(static_cast<std::size_t>(w) * h * 4);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            auto i = static_cast<std::size_t>(y * w + x) * 4;
+            px[i + (x < split ? 0 : 2)] = 255;
+            px[i + 3] = 255;
+        }
+    }
+    return uc::ImageData::fromRGBA(w, h, px.data());
+}
+
+bool near(const uc::LAB &a, const uc::LAB &b) {
+    return std::abs(a.L - b.L) < 1e-4 && std::abs(a.a - b.a) < 1e-4 &&
+           std::abs(a.b - b.b) < 1e-4;
+}
+} // namespace
+
+TEST_CASE("superpixels follow colour edges and cover every pixel") {
+    // The edge falls inside a grid cell, so the seed straddling it must
+    // give up the pixels of the other colour.
+    auto img = halves(90, 60, 37);
+    uc::SuperpixelSettings settings;
+    settings.count = 54;
+    auto regions = uc::segmentSuperpixels(img, settings);
+    REQUIRE(regions.size() >= 40);
+    CHECK(regions.size() <= 60);
+    REQUIRE(regions.weights.size() == regions.size());
+
+    double pixels = 0.0;
+    auto red = uc::Colour::fromSRGB(255, 0, 0).lab;
+    auto blue = uc::Colour::fromSRGB(0, 0, 255).lab;
+    for (std::size_t i = 0; i < regions.size(); ++i) {
+        pixels += regions.weights[i];
+        CHECK((near(regions[i], red) || near(regions[i], blue)));
+        CHECK(regions.variance[i] == doctest::Approx(0.0).epsilon(1e-9));
+    }
+    CHECK(pixels == doctest::Approx(90.0 * 60.0));
+}
+
+TEST_CASE("superpixel extraction weights regions by area") {
+    auto img = halves(90, 60, 60);
+    auto dom = uc::extractDominantColours(img, {2, 20}, 3, 100);
+    REQUIRE(dom.size() == 2);
+    CHECK(dom[0].share == doctest::Approx(2.0 / 3.0));
+    CHECK(dom[1].share == doctest::Approx(1.0 / 3.0));
+    CHECK(near(dom[0].colour.lab, uc::Colour::fromSRGB(255, 0, 0).lab));
+
+    CHECK(uc::segmentSuperpixels(uc::ImageData{}).size() == 0);
+}
@@ -0,0 +1,67 @@
+// urColo - tests thread pool coverage, nesting and error propagation
+#include "urColo/PaletteGenerator.h"
+#include "urColo/Random.h"
+#include "urColo/ThreadPool.h"
+#include <atomic>
+#include <doctest/doctest.h>
+#include <stdexcept>
+
+TEST_CASE("parallelFor visits every index exactly once") {
+    uc::ThreadPool pool(3);
+    std::vector<std::atomic<int>> hits(1000);
+    pool.parallelFor(hits.size(), [&](std::size_t i) { ++hits[i]; });
+    for (const auto &h : hits)
+        CHECK(h.load() == 1);
+}
+
+TEST_CASE("parallelFor runs inline without workers") {
+    uc::ThreadPool pool(0);
+    CHECK(pool.workers() == 0);
+    std::size_t sum = 0;
+    pool.parallelFor(10, [&](std::size_t i) { sum += i; });
+    CHECK(sum == 45);
+}
+
+TEST_CASE("nested parallelFor completes") {
+    uc::ThreadPool pool(2);
+    std::atomic<int> total{0};
+    pool.parallelFor(8, [&](std::size_t) {
+        pool.parallelFor(8, [&](std::size_t) { ++total; });
+    });
+    CHECK(total.load() == 64);
+}
+
+TEST_CASE("parallelFor rethrows the first failure") {
+    uc::ThreadPool pool(2);
+    std::atomic<int> ran{0};
+    CHECK_THROWS_AS(pool.parallelFor(16,
+                                     [&](std::size_t i) {
+                                         ++ran;
+                                         if (i == 3)
+                                             throw std::runtime_error("x");
+                                     }),
+                    std::runtime_error);
+    CHECK(ran.load() == 16);
+}
+
+TEST_CASE("derived seeds make parallel generation reproducible") {
+    uc::ThreadPool pool(3);
+    auto run = [&pool](std::uint64_t master) {
+        std::vector<std::vector<uc::Swatch>> out(6);
+        uc::PaletteGenerator base(1);
+        pool.parallelFor(out.size(), [&](std::size_t i) {
+            uc::PaletteGenerator local = base;
+            local.reseed(uc::deriveSeed(master, i));
+            out[i] = local.generate({}, 4);
+        });
+        return out;
+    };
+    auto a = run(42);
+    auto b = run(42);
+    for (std::size_t p = 0; p < a.size(); ++p) {
+        REQUIRE(a[p].size() == b[p].size());
+        for (std::size_t i = 0; i < a[p].size(); ++i)
+            CHECK(a[p][i]._colour.x == b[p][i]._colour.x);
+    }
+    CHECK(a[0][0]._colour.x != a[1][0]._colour.x);
+}
@@ -0,0 +1,121 @@
+// urColo - tests alias sampling and the palette-order transition model
+#include "urColo/Model.h"
+#include "urColo/TransitionModel.h"
+#include <algorithm>
+#include <cmath>
+#include <doctest/doctest.h>
+#include <nlohmann/json.hpp>
+
+namespace {
+double distance(const uc::LAB &a, const uc::LAB &b) {
+    double dL = a.L - b.L;
+    double da = a.a - b.a;
+    double db = a.b - b.b;
+    return std::sqrt(dL * dL + da * da + db * db);
+}
+
+// A fixed three-step ramp: dark blue, mid teal, pale yellow.
+std::vector<uc::LAB> ramp() {
+    return {uc::Colour::fromSRGB(20, 30, 90).lab,
+            uc::Colour::fromSRGB(40, 140, 140).lab,
+            uc::Colour::fromSRGB(250, 240, 170).lab};
+}
+} // namespace
+
+TEST_CASE("alias table draws in proportion to the weights") {
+    std::vector<double> w{1.0, 0.0, 3.0, 6.0};
+    uc::AliasTable table(w);
+    std::mt19937_64 rng(1);
+    std::vector<int> hits(w.size(), 0);
+    const int draws = 100000;
+    for (int i = 0; i < draws; ++i)
+        ++hits[table.sample(rng)];
+    CHECK(hits[1] == 0);
+    for (std::size_t i = 0; i < w.size(); ++i)
+        CHECK(static_cast<double>(hits[i]) / draws ==
+              doctest::Approx(w[i] / 10.0).epsilon(0.03));
+
+    std::vector<double> none{0.0, 0.0};
+    CHECK_THROWS_AS(uc::AliasTable{none}, std::invalid_argument);
+}
+
+TEST_CASE("transition walk follows the training order") {
+    uc::TransitionModel m;
+    auto cols = ramp();
+    for (int i = 0; i < 20; ++i)
+        m.add(cols);
+    m.build();
+    REQUIRE(!m.empty());
+    CHECK(m.binsUsed() == 3);
+
+    // Starting from the first colour, the most common continuation is the
+    // next one in the ramp.
+    std::mt19937_64 rng(2);
+    std::vector<uc::LAB> locked{cols[0]};
+    int next = 0;
+    for (int i = 0; i < 200; ++i) {
+        auto out = m.walk(1, locked, rng);
+        REQUIRE(out.size() == 1);
+        if (distance(out[0], cols[1]) < 1e-9)
+            ++next;
+    }
+    CHECK(next > 140);
+
+    // An unlocked walk begins where the palettes began.
+    auto fresh = m.walk(3, {}, rng);
+    REQUIRE(fresh.size() == 3);
+    CHECK(distance(fresh[0], cols[0]) < 1e-9);
+}
+
+TEST_CASE("transition model survives a JSON round trip") {
+    uc::TransitionModel m;
+    m.add(ramp());
+    m.build();
+    nlohmann::json j = m;
+    auto copy = j.get<uc::TransitionModel>();
+    CHECK(copy.binsUsed() == m.binsUsed());
+    std::mt19937_64 a(3), b(3);
+    auto x = m.walk(4, {}, a);
+    auto y = copy.walk(4, {}, b);
+    REQUIRE(x.size() == y.size());
+    for (std::size_t i = 0; i < x.size(); ++i)
+        CHECK(distance(x[i], y[i]) < 1e-12);
+
+    j["transitions"].push_back(1.0);
+    CHECK_THROWS_AS(j.get<uc::TransitionModel>(), std::out_of_range);
+}
+
+TEST_CASE("ordered model suggestions continue from the locked colour") {
+    uc::Palette p{"ramp"};
+    for (const auto &c : ramp()) {
+        uc::Colour col;
+        col.lab = c;
+        col.alpha = 1.0;
+        p.addSwatch("s", col.toImVec4());
+    }
+    uc::Model m(6);
+    m.setOrdered(true);
+    m.train({p});
+    auto copy = nlohmann::json(m).get<uc::Model>();
+    CHECK(copy.ordered());
+
+    // The first suggestion is usually the colour that followed the locked
+    // one; every suggestion is one of the training colours.
+    std::vector<uc::LAB> locked{ramp()[1]};
+    int follows = 0;
+    for (int i = 0; i < 50; ++i) {
+        auto out = copy.suggest(2, locked);
+        REQUIRE(out.size() == 2);
+        for (const auto &sw : out) {
+            auto lab = uc::Colour::fromImVec4(sw._colour).lab;
+            double best = 1e9;
+            for (const auto &c : ramp())
+                best = std::min(best, distance(lab, c));
+            CHECK(best < 0.01);
+        }
+        auto first = uc::Colour::fromImVec4(out[0]._colour).lab;
+        if (distance(first, ramp()[2]) < 0.01)
+            ++follows;
+    }
+    CHECK(follows > 30);
+}
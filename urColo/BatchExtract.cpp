@@ -0,0 +1,260 @@
+// urColo - headless batch palette extraction
+#include "BatchExtract.h"
+#include "Logger.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <print>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+using namespace uc;
+
+// File extensions stb_image can decode, lower case.
+constexpr std::array<std::string_view, 12> IMAGE_EXTENSIONS{
+    ".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif",
+    ".psd", ".hdr", ".pic",  ".pnm", ".ppm", ".pgm"};
+
+constexpr std::string_view USAGE =
+    "usage: urColo --extract <directory|pattern> [--out <directory>]\n"
+    "              [--colours N] [--iterations N] [--jobs N] [--queue N]\n"
+    "              [--budget PIXELS]\n";
+
+bool isImage(const fs::path &p) {
+    std::string ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+    });
+    return std::find(IMAGE_EXTENSIONS.begin(), IMAGE_EXTENSIONS.end(),
+                     ext) != IMAGE_EXTENSIONS.end();
+}
+
+// Match `name` against a pattern where `*` is any run of characters and
+// `?` any single one. Backtracks only to the most recent `*`.
+bool wildcardMatch(std::string_view pattern, std::string_view name) {
+    std::size_t p = 0, n = 0;
+    std::size_t star = std::string_view::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() &&
+            (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = n;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+    return p == pattern.size();
+}
+
+BatchResult extractOne(const fs::path &path, const BatchSettings &settings) {
+    BatchResult r{path, {}, {}};
+    try {
+        r.colours = loadImageColours(path.string(), settings.clusters,
+                                     settings.pixelBudget);
+        if (r.colours.empty())
+            r.error = "could not decode image";
+    } catch (const std::exception &e) {
+        r.error = e.what();
+    }
+    return r;
+}
+
+// Parse a positive integer option value.
+template <typename T> bool parseCount(std::string_view text, T &out) {
+    T value{};
+    auto [end, ec] =
+        std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{} || end != text.data() + text.size() || value <= 0)
+        return false;
+    out = value;
+    return true;
+}
+} // namespace
+
+namespace uc {
+
+std::vector<fs::path> findImages(const std::string &pattern) {
+    std::vector<fs::path> out;
+    std::error_code ec;
+    fs::path target(pattern);
+    if (fs::is_directory(target, ec)) {
+        for (fs::directory_iterator it(target, ec), end; !ec && it != end;
+             it.increment(ec))
+            if (it->is_regular_file(ec) && isImage(it->path()))
+                out.push_back(it->path());
+    } else if (fs::is_regular_file(target, ec)) {
+        out.push_back(target);
+    } else {
+        fs::path dir = target.parent_path();
+        std::string name = target.filename().string();
+        for (fs::directory_iterator it(dir.empty() ? fs::path(".") : dir, ec),
+             end;
+             !ec && it != end; it.increment(ec))
+            if (it->is_regular_file(ec) &&
+                wildcardMatch(name, it->path().filename().string()))
+                out.push_back(dir / it->path().filename());
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Workers come from a private ThreadPool driven by a producer thread, so
+// the calling thread is free to consume results while they are made.
+std::size_t extractPalettes(std::span<const fs::path> images,
+                            const BatchSettings &settings,
+                            const std::function<void(BatchResult &&)> &sink) {
+    const unsigned workers =
+        settings.workers != 0
+            ? settings.workers
+            : std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t depth = settings.queueDepth != 0
+                                  ? settings.queueDepth
+                                  : 2 * std::size_t{workers};
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<BatchResult> ready; //< Guarded by mutex
+    bool producing = true;         //< Guarded by mutex
+    std::atomic<bool> cancelled{false};
+
+    ThreadPool pool(workers - 1); // The producer thread is the last worker
+    std::jthread producer([&] {
+        pool.parallelFor(images.size(), [&](std::size_t i) {
+            if (cancelled)
+                return;
+            BatchResult r = extractOne(images[i], settings);
+            std::unique_lock lock(mutex);
+            changed.wait(lock,
+                         [&] { return ready.size() < depth || cancelled; });
+            if (cancelled)
+                return;
+            ready.push_back(std::move(r));
+            changed.notify_all();
+        });
+        std::lock_guard lock(mutex);
+        producing = false;
+        changed.notify_all();
+    });
+
+    std::size_t failures = 0;
+    for (;;) {
+        std::unique_lock lock(mutex);
+        changed.wait(lock, [&] { return !ready.empty() || !producing; });
+        if (ready.empty())
+            break;
+        BatchResult r = std::move(ready.front());
+        ready.pop_front();
+        changed.notify_all();
+        lock.unlock();
+
+        if (!r.error.empty())
+            ++failures;
+        try {
+            sink(std::move(r));
+        } catch (...) {
+            std::lock_guard stop(mutex);
+            cancelled = true;
+            changed.notify_all();
+            throw;
+        }
+    }
+    return failures;
+}
+
+fs::path writePalette(const BatchResult &result, const fs::path &outDir) {
+    Palette pal(result.path.stem().string());
+    for (const auto &c : result.colours) {
+        ImVec4 col = c.toImVec4();
+        pal.addSwatch(std::format("p0-{}", toHexString(col)), col);
+    }
+    fs::path out = outDir / (result.path.filename().string() + ".json");
+    std::ofstream file(out);
+    if (!file)
+        return {};
+    file << nlohmann::json(std::vector<Palette>{pal}).dump(4);
+    return file ? out : fs::path{};
+}
+
+int runBatchCommand(std::span<const std::string> args) {
+    BatchSettings settings;
+    std::string source;
+    fs::path outDir{"."};
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const std::string &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        bool ok = true;
+        if (arg == "--out" && hasValue)
+            outDir = args[++i];
+        else if (arg == "--colours" && hasValue)
+            ok = parseCount(args[++i], settings.clusters.k);
+        else if (arg == "--iterations" && hasValue)
+            ok = parseCount(args[++i], settings.clusters.maxIterations);
+        else if (arg == "--jobs" && hasValue)
+            ok = parseCount(args[++i], settings.workers);
+        else if (arg == "--queue" && hasValue)
+            ok = parseCount(args[++i], settings.queueDepth);
+        else if (arg == "--budget" && hasValue)
+            ok = parseCount(args[++i], settings.pixelBudget);
+        else if (source.empty() && !arg.starts_with("--"))
+            source = arg;
+        else
+            ok = false;
+        if (!ok) {
+            std::print(stderr, "{}", USAGE);
+            return 2;
+        }
+    }
+    if (source.empty()) {
+        std::print(stderr, "{}", USAGE);
+        return 2;
+    }
+
+    auto images = findImages(source);
+    if (images.empty()) {
+        Logger::log(Logger::Level::Error, "No images found for {}", source);
+        return 1;
+    }
+    std::error_code ec;
+    fs::create_directories(outDir, ec);
+
+    std::size_t written = 0;
+    std::size_t failures =
+        extractPalettes(images, settings, [&](BatchResult &&r) {
+            if (!r.error.empty()) {
+                Logger::log(Logger::Level::Error, "{}: {}", r.path.string(),
+                            r.error);
+                return;
+            }
+            if (writePalette(r, outDir).empty()) {
+                Logger::log(Logger::Level::Error, "{}: could not write palette",
+                            r.path.string());
+                return;
+            }
+            ++written;
+        });
+    Logger::log(Logger::Level::Ok, "Extracted {} of {} palettes into {}",
+                written, images.size(), outDir.string());
+    return failures == 0 && written == images.size() ? 0 : 1;
+}
+
+} // namespace uc
@@ -0,0 +1,69 @@
+// urColo - headless batch palette extraction interface
+#pragma once
+#include "Clustering.h"
+#include "Colour.h"
+#include "ImageUtils.h"
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace uc {
+// Options for extracting palettes from many images.
+//
+// Member variables:
+// - `clusters`    Colours per palette and k-means iteration limit.
+// - `pixelBudget` Images are downsampled to at most this many pixels.
+// - `workers`     Images processed at once; 0 uses every hardware thread.
+// - `queueDepth`  Finished palettes allowed to wait for the writer before
+//                 workers pause; 0 uses twice the worker count.
+struct BatchSettings {
+    ClusterSettings clusters{};
+    std::size_t pixelBudget{kDefaultPixelBudget};
+    unsigned workers{0};
+    std::size_t queueDepth{0};
+};
+
+// Palette extracted from one image.
+//
+// Member variables:
+// - `path`    Source image.
+// - `colours` Dominant colours, empty on failure.
+// - `error`   Why extraction failed, empty on success.
+struct BatchResult {
+    std::filesystem::path path;
+    std::vector<Colour> colours;
+    std::string error;
+};
+
+// Expand a directory, a single file or a file-name pattern into image
+// paths, sorted. A directory yields its files with a known image
+// extension; a pattern may use `*` and `?` in its last component only.
+std::vector<std::filesystem::path> findImages(const std::string &pattern);
+
+// Decode and cluster `images` on a bounded set of workers. Each result is
+// handed to `sink` on the calling thread as soon as it is ready, so results
+// arrive out of order. Workers wait while `queueDepth` results are
+// pending, which keeps memory bounded when `sink` is slower than decoding.
+//
+// \return Number of images that failed.
+std::size_t extractPalettes(std::span<const std::filesystem::path> images,
+                            const BatchSettings &settings,
+                            const std::function<void(BatchResult &&)> &sink);
+
+// Write `result` as a one-palette JSON array named after the image, so the
+// file can be imported from the GUI.
+//
+// \return Path of the written file, or empty when writing failed.
+std::filesystem::path writePalette(const BatchResult &result,
+                                   const std::filesystem::path &outDir);
+
+// Run the `--extract` command line mode. `args` are the arguments after
+// `--extract`.
+//
+// \return Process exit code: 0 on success, 1 if any image failed and 2 for
+//         invalid arguments.
+int runBatchCommand(std::span<const std::string> args);
+} // namespace uc
@@ -0,0 +1,341 @@
+// urColo - generic k-means clustering engine
+#pragma once
+#include "Colour.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace uc {
+// Straight-line distance in OKLab.
+struct EuclideanMetric {
+    double operator()(const LAB &a, const LAB &b) const {
+        double dL = a.L - b.L;
+        double da = a.a - b.a;
+        double db = a.b - b.b;
+        return std::sqrt(dL * dL + da * da + db * db);
+    }
+};
+
+// OKLab distance with the luminance difference scaled by `lWeight` and the
+// a/b plane by the square root of `abWeight`. It is still a true metric, so
+// the Hamerly bounds hold, and because the scaling is linear the mean of a
+// cluster is its plain OKLab mean: centres never leave OKLab.
+struct WeightedMetric {
+    double lWeight{1.0};
+    double abWeight{1.0};
+
+    double operator()(const LAB &a, const LAB &b) const {
+        double dL = (a.L - b.L) * lWeight;
+        double da = a.a - b.a;
+        double db = a.b - b.b;
+        return std::sqrt(dL * dL + abWeight * (da * da + db * db));
+    }
+};
+
+// Every point counts once. Any type with `double operator[](size_t)` can
+// be used instead, e.g. a std::span<const double> of per-point weights.
+struct UnitWeights {
+    double operator[](std::size_t) const { return 1.0; }
+};
+
+// k-means++: each new centre is a point drawn with probability proportional
+// to its weighted squared distance from the nearest centre so far.
+struct KMeansPlusPlusSeeding {
+    template <class Points, class Metric, class Weights>
+    void operator()(const Points &pts, const Metric &metric,
+                    const Weights &weights, std::vector<LAB> &centres,
+                    std::size_t k, std::mt19937_64 &rng) const {
+        std::uniform_int_distribution<std::size_t> pick(0, pts.size() - 1);
+        if (centres.size() < k)
+            centres.push_back(pts[pick(rng)]);
+        std::vector<double> dist(pts.size(),
+                                 std::numeric_limits<double>::infinity());
+        std::size_t measured = 0; //< Centres already folded into `dist`
+        while (centres.size() < k) {
+            double sum = 0.0;
+            for (std::size_t i = 0; i < pts.size(); ++i) {
+                const LAB p = pts[i];
+                for (std::size_t c = measured; c < centres.size(); ++c) {
+                    double d = metric(p, centres[c]);
+                    dist[i] = std::min(dist[i], d * d);
+                }
+                sum += dist[i] * weights[i];
+            }
+            measured = centres.size();
+            std::uniform_real_distribution<double> target(0.0, sum);
+            double t = target(rng);
+            double accum = 0.0;
+            std::size_t idx = 0;
+            for (; idx < pts.size(); ++idx) {
+                accum += dist[idx] * weights[idx];
+                if (accum >= t)
+                    break;
+            }
+            centres.push_back(pts[std::min(idx, pts.size() - 1)]);
+        }
+    }
+};
+
+// Plain random initialisation: centres are points picked uniformly.
+struct RandomSeeding {
+    template <class Points, class Metric, class Weights>
+    void operator()(const Points &pts, const Metric &, const Weights &,
+                    std::vector<LAB> &centres, std::size_t k,
+                    std::mt19937_64 &rng) const {
+        std::uniform_int_distribution<std::size_t> pick(0, pts.size() - 1);
+        while (centres.size() < k)
+            centres.push_back(pts[pick(rng)]);
+    }
+};
+
+// Number of clusters and the most Lloyd iterations to run.
+struct ClusterSettings {
+    std::size_t k{5};
+    int maxIterations{5};
+};
+
+// A clustering in progress. Besides the centres it keeps each point's
+// assignment and Hamerly bounds, so a later run on the same points can
+// continue from it instead of starting over.
+//
+// Member variables:
+// - `centres`    Cluster centres in OKLab, fixed ones first.
+// - `fixed`      Centres that never move, such as locked colours.
+// - `assignment` Index of the nearest centre for every point.
+// - `upper`      Upper bound on each point's distance to its centre.
+// - `lower`      Lower bound on its distance to any other centre.
+// - `weight`     Total weight of the points each centre received in the
+//                last assignment pass of refine().
+// - `variance`   Weighted mean squared OKLab distance of those points from
+//                their final centre.
+// - `iterations` Iterations performed by the most recent refine().
+struct Clustering {
+    std::vector<LAB> centres;
+    std::vector<bool> fixed;
+    std::vector<std::uint32_t> assignment;
+    std::vector<double> upper;
+    std::vector<double> lower;
+    std::vector<double> weight;
+    std::vector<double> variance;
+    int iterations{0};
+};
+
+// Lloyd's k-means accelerated with Hamerly's bounds, generic over the
+// point source, the distance metric and per-point weights. `Points` needs
+// size() and operator[] returning a LAB.
+//
+// Large inputs are split into chunks that the shared thread pool assigns
+// and accumulates in parallel; partial sums are combined in chunk order so
+// results do not depend on scheduling.
+template <class Metric = EuclideanMetric, class Weights = UnitWeights>
+class ClusterEngine {
+  public:
+    // Points per parallel task in refine().
+    static constexpr std::size_t kChunk = 16384;
+
+    explicit ClusterEngine(Metric metric = {}, Weights weights = {})
+        : _metric(metric), _weights(weights) {}
+
+    // Start a clustering of `pts` with `k` centres: the `fixed` centres
+    // followed by ones chosen by `seeding`.
+    template <class Points, class Seeding = KMeansPlusPlusSeeding>
+    Clustering seed(const Points &pts, std::span<const LAB> fixed,
+                    std::size_t k, std::mt19937_64 &rng,
+                    const Seeding &seeding = {}) const {
+        Clustering cl;
+        cl.centres.assign(fixed.begin(), fixed.end());
+        cl.fixed.assign(cl.centres.size(), true);
+        if (pts.size() > 0 && cl.centres.size() < k)
+            seeding(pts, _metric, _weights, cl.centres, k, rng);
+        cl.fixed.resize(cl.centres.size(), false);
+
+        cl.assignment.resize(pts.size());
+        cl.upper.resize(pts.size());
+        cl.lower.resize(pts.size());
+        if (!cl.centres.empty())
+            for (std::size_t i = 0; i < pts.size(); ++i)
+                nearestTwo(pts[i], cl.centres, cl.assignment[i], cl.upper[i],
+                           cl.lower[i]);
+        return cl;
+    }
+
+    // Replace the centres of `cl`, which must have the same count, and
+    // loosen the bounds by how far each moved so they stay valid without
+    // rescanning the points.
+    void move(Clustering &cl, std::span<const LAB> centres) const {
+        std::vector<double> drift(centres.size());
+        for (std::size_t c = 0; c < centres.size(); ++c) {
+            drift[c] = _metric(cl.centres[c], centres[c]);
+            cl.centres[c] = centres[c];
+        }
+        loosen(drift, cl);
+    }
+
+    // Run up to `maxIter` iterations. Stops early once no centre moves or
+    // `stop` is requested. The weight and variance of every cluster are
+    // gathered in the same pass as the assignment, so they describe the
+    // final clustering without another scan of the points.
+    //
+    // \return Number of iterations performed.
+    template <class Points>
+    int refine(const Points &pts, Clustering &cl, int maxIter,
+               const std::stop_token &stop = {}) const {
+        const std::size_t k = cl.centres.size();
+        const std::size_t n = pts.size();
+        const std::size_t chunks = (n + kChunk - 1) / kChunk;
+        std::vector<double> half(k);
+        std::vector<double> drift(k);
+        std::vector<std::vector<LAB>> sum(chunks, std::vector<LAB>(k));
+        std::vector<std::vector<double>> count(chunks,
+                                               std::vector<double>(k));
+        std::vector<std::vector<double>> squares(chunks,
+                                                 std::vector<double>(k));
+        cl.iterations = 0;
+        if (k == 0)
+            return 0;
+        while (cl.iterations < maxIter && !stop.stop_requested()) {
+            ++cl.iterations;
+            // Half the gap from each centre to its closest neighbour. A
+            // point nearer than this to its own centre cannot be closer to
+            // another.
+            for (std::size_t c = 0; c < k; ++c) {
+                half[c] = std::numeric_limits<double>::infinity();
+                for (std::size_t o = 0; o < k; ++o)
+                    if (o != c)
+                        half[c] = std::min(
+                            half[c], 0.5 * _metric(cl.centres[c],
+                                                   cl.centres[o]));
+            }
+
+            ThreadPool::shared().parallelFor(chunks, [&](std::size_t ch) {
+                auto &s = sum[ch];
+                auto &w = count[ch];
+                auto &sq = squares[ch];
+                std::fill(s.begin(), s.end(), LAB{});
+                std::fill(w.begin(), w.end(), 0.0);
+                std::fill(sq.begin(), sq.end(), 0.0);
+                std::size_t end = std::min(n, (ch + 1) * kChunk);
+                for (std::size_t i = ch * kChunk; i < end; ++i) {
+                    const LAB p = pts[i];
+                    auto &a = cl.assignment[i];
+                    double bound = std::max(half[a], cl.lower[i]);
+                    if (cl.upper[i] > bound) {
+                        cl.upper[i] = _metric(p, cl.centres[a]);
+                        if (cl.upper[i] > bound)
+                            nearestTwo(p, cl.centres, a, cl.upper[i],
+                                       cl.lower[i]);
+                    }
+                    double wt = _weights[i];
+                    s[a].L += p.L * wt;
+                    s[a].a += p.a * wt;
+                    s[a].b += p.b * wt;
+                    w[a] += wt;
+                    sq[a] += (p.L * p.L + p.a * p.a + p.b * p.b) * wt;
+                }
+            });
+
+            // Move centres to the weighted mean of their points, skipping
+            // those that are fixed or received none. The spread about the
+            // final centre c follows from the sums as
+            // sum|p|^2 / w - 2 c.mean + |c|^2.
+            bool moved = false;
+            cl.weight.assign(k, 0.0);
+            cl.variance.assign(k, 0.0);
+            for (std::size_t c = 0; c < k; ++c) {
+                drift[c] = 0.0;
+                LAB total{};
+                double weight = 0.0;
+                double sq = 0.0;
+                for (std::size_t ch = 0; ch < chunks; ++ch) {
+                    total.L += sum[ch][c].L;
+                    total.a += sum[ch][c].a;
+                    total.b += sum[ch][c].b;
+                    weight += count[ch][c];
+                    sq += squares[ch][c];
+                }
+                if (weight <= 0.0)
+                    continue;
+                LAB mean{total.L / weight, total.a / weight,
+                         total.b / weight};
+                if (!cl.fixed[c]) {
+                    drift[c] = _metric(cl.centres[c], mean);
+                    cl.centres[c] = mean;
+                    moved = moved || drift[c] > 0.0;
+                }
+                const LAB &m = cl.centres[c];
+                cl.weight[c] = weight;
+                cl.variance[c] = std::max(
+                    0.0, sq / weight -
+                             2.0 * (m.L * mean.L + m.a * mean.a +
+                                    m.b * mean.b) +
+                             m.L * m.L + m.a * m.a + m.b * m.b);
+            }
+            if (!moved)
+                break;
+            loosen(drift, cl);
+        }
+        return cl.iterations;
+    }
+
+    // Seed and refine in one call.
+    template <class Points, class Seeding = KMeansPlusPlusSeeding>
+    Clustering run(const Points &pts, std::span<const LAB> fixed,
+                   const ClusterSettings &settings, std::mt19937_64 &rng,
+                   const std::stop_token &stop = {},
+                   const Seeding &seeding = {}) const {
+        Clustering cl = seed(pts, fixed, settings.k, rng, seeding);
+        refine(pts, cl, settings.maxIterations, stop);
+        return cl;
+    }
+
+  private:
+    // Find the closest and second-closest centre to a point.
+    void nearestTwo(const LAB &p, std::span<const LAB> centres,
+                    std::uint32_t &best, double &d1, double &d2) const {
+        d1 = std::numeric_limits<double>::infinity();
+        d2 = std::numeric_limits<double>::infinity();
+        for (std::size_t c = 0; c < centres.size(); ++c) {
+            double d = _metric(p, centres[c]);
+            if (d < d1) {
+                d2 = d1;
+                d1 = d;
+                best = static_cast<std::uint32_t>(c);
+            } else if (d < d2) {
+                d2 = d;
+            }
+        }
+    }
+
+    // Widen the bounds after centres moved by `drift`. A point's distance
+    // to its own centre grows by at most that centre's drift, and its
+    // distance to any other shrinks by at most the largest other drift.
+    void loosen(std::span<const double> drift, Clustering &cl) const {
+        std::size_t far = 0;
+        double largest = 0.0;
+        double second = 0.0;
+        for (std::size_t c = 0; c < drift.size(); ++c) {
+            if (drift[c] > largest) {
+                second = largest;
+                largest = drift[c];
+                far = c;
+            } else if (drift[c] > second) {
+                second = drift[c];
+            }
+        }
+        for (std::size_t i = 0; i < cl.assignment.size(); ++i) {
+            cl.upper[i] += drift[cl.assignment[i]];
+            cl.lower[i] -= cl.assignment[i] == far ? second : largest;
+        }
+    }
+
+    Metric _metric;
+    Weights _weights;
+};
+} // namespace uc
@@ -8,10 +8,13 @@
 #include <format>
 #include <numbers>
 #include <string>
+#include <vector>
 
 namespace {
 using namespace uc;
-static std::unordered_map<ImVec4, Colour, ImVec4Hash, ImVec4Equal> cache;
+// Conversion cache for fromImVec4. Kept per thread because generation and
+// training call it from worker threads concurrently.
+thread_local std::unordered_map<ImVec4, Colour, ImVec4Hash, ImVec4Equal> cache;
 /*
  * Convert an sRGB channel to linear RGB.
  *
@@ -81,6 +84,20 @@ inline RGB LABToLinear(LAB c) {
         -0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s,
     };
 }
+
+// Single-precision LinearToLAB shared by the packed-pixel kernels.
+inline void linearPixelToLab(float r, float g, float b, float &L, float &A,
+                             float &B) noexcept {
+    float l_ =
+        std::cbrt(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+    float m_ =
+        std::cbrt(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+    float s_ =
+        std::cbrt(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+    L = 0.2104542553f * l_ + 0.7936177850f * m_ - 0.0040720468f * s_;
+    A = 1.9779984951f * l_ - 2.4285922050f * m_ + 0.4505937099f * s_;
+    B = 0.0259040371f * l_ + 0.7827717662f * m_ - 0.8086757660f * s_;
+}
 } // namespace
 
 namespace uc {
@@ -238,4 +255,127 @@ double relativeLuminance(const Colour &c) {
     const double b = SRGBToLinear(b8 / 255.0);
     return redWeight * r + greenWeight * g + blueWeight * b;
 }
+
+/*
+ * Check whether an OKLab colour maps into the displayable sRGB cube.
+ *
+ * The colour is converted to linear RGB and each channel compared against
+ * the unit range with a small tolerance for rounding.
+ */
+bool inSRGBGamut(const LAB &lab, double eps) noexcept {
+    RGB c = LABToLinear(lab);
+    return c.r >= -eps && c.r <= 1.0 + eps && c.g >= -eps &&
+           c.g <= 1.0 + eps && c.b >= -eps && c.b <= 1.0 + eps;
+}
+
+/*
+ * Convert channel arrays from OKLab to linear sRGB.
+ *
+ * Applies the same matrices as LABToLinear to every element with no
+ * branches, so the loop vectorises.
+ */
+void labToLinear(std::span<const float> L, std::span<const float> a,
+                 std::span<const float> b, std::span<float> r,
+                 std::span<float> g, std::span<float> bl) noexcept {
+    const std::size_t n = L.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        float l_ = L[i] + 0.3963377774f * a[i] + 0.2158037573f * b[i];
+        float m_ = L[i] - 0.1055613458f * a[i] - 0.0638541728f * b[i];
+        float s_ = L[i] - 0.0894841775f * a[i] - 1.2914855480f * b[i];
+        float l = l_ * l_ * l_;
+        float m = m_ * m_ * m_;
+        float s = s_ * s_ * s_;
+        r[i] = +4.0767416621f * l - 3.3077115913f * m + 0.2309699292f * s;
+        g[i] = -1.2684380046f * l + 2.6097574011f * m - 0.3413193965f * s;
+        bl[i] = -0.0041960863f * l - 0.7034186147f * m + 1.7076147010f * s;
+    }
+}
+
+/*
+ * Convert channel arrays from OKLab to display sRGB.
+ *
+ * The first pass is labToLinear; the second clamps and gamma-encodes.
+ */
+void labToSRGB(std::span<const float> L, std::span<const float> a,
+               std::span<const float> b, std::span<float> r,
+               std::span<float> g, std::span<float> bl) noexcept {
+    labToLinear(L, a, b, r, g, bl);
+    auto encode = [](float c) {
+        return static_cast<float>(
+            linearToSRGB(std::clamp(static_cast<double>(c), 0.0, 1.0)));
+    };
+    const std::size_t n = L.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        r[i] = encode(r[i]);
+        g[i] = encode(g[i]);
+        bl[i] = encode(bl[i]);
+    }
+}
+
+const std::array<float, 256> &srgb8LinearTable() noexcept {
+    static const auto table = [] {
+        std::array<float, 256> t{};
+        for (std::size_t i = 0; i < t.size(); ++i)
+            t[i] = static_cast<float>(
+                SRGBToLinear(static_cast<double>(i) / 255.0));
+        return t;
+    }();
+    return table;
+}
+
+std::uint8_t linearToSRGB8(double c) noexcept {
+    return static_cast<std::uint8_t>(
+        std::lround(linearToSRGB(std::clamp(c, 0.0, 1.0)) * 255.0));
+}
+
+/*
+ * Convert packed 8-bit sRGB pixels to OKLab channel arrays.
+ *
+ * Gamma expansion uses a 256-entry table; the matrix and cube root steps
+ * match LinearToLAB but run in single precision.
+ */
+void srgb8ToLab(std::span<const unsigned char> rgba, std::span<float> L,
+                std::span<float> a, std::span<float> b) noexcept {
+    const auto &linear = srgb8LinearTable();
+    const std::size_t n = L.size();
+    for (std::size_t i = 0; i < n; ++i)
+        linearPixelToLab(linear[rgba[i * 4 + 0]], linear[rgba[i * 4 + 1]],
+                         linear[rgba[i * 4 + 2]], L[i], a[i], b[i]);
+}
+
+/*
+ * Convert packed 16-bit sRGB pixels to OKLab channel arrays.
+ *
+ * Every level has its own entry in a 65536-entry table built on first
+ * use, so no precision is lost to an 8-bit step.
+ */
+void srgb16ToLab(std::span<const std::uint16_t> rgba, std::span<float> L,
+                 std::span<float> a, std::span<float> b) noexcept {
+    static const auto linear = [] {
+        std::vector<float> t(65536);
+        for (std::size_t i = 0; i < t.size(); ++i)
+            t[i] = static_cast<float>(
+                SRGBToLinear(static_cast<double>(i) / 65535.0));
+        return t;
+    }();
+    const std::size_t n = L.size();
+    for (std::size_t i = 0; i < n; ++i)
+        linearPixelToLab(linear[rgba[i * 4 + 0]], linear[rgba[i * 4 + 1]],
+                         linear[rgba[i * 4 + 2]], L[i], a[i], b[i]);
+}
+
+/*
+ * Convert packed linear float pixels to OKLab channel arrays.
+ *
+ * Negative channels, which have no meaning as light, are clamped to zero
+ * before the cube root.
+ */
+void linearToLab(std::span<const float> rgba, std::span<float> L,
+                 std::span<float> a, std::span<float> b) noexcept {
+    const std::size_t n = L.size();
+    for (std::size_t i = 0; i < n; ++i)
+        linearPixelToLab(std::max(rgba[i * 4 + 0], 0.0f),
+                         std::max(rgba[i * 4 + 1], 0.0f),
+                         std::max(rgba[i * 4 + 2], 0.0f), L[i], a[i], b[i]);
+}
 } // namespace uc
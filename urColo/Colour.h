@@ -8,6 +8,7 @@
 
 #include <format>
 #include <nlohmann/json.hpp>
+#include <span>
 #include <string>
 #include <unordered_map>
 
@@ -233,4 +234,62 @@ struct Colour {
 // \param sRGB Colour in OKLab/linear space.
 // \return Luminance value in the range [0,1].
 double relativeLuminance(const Colour &sRGB);
+
+// Determine whether an OKLab colour lies inside the sRGB gamut.
+//
+// \param lab OKLab colour to test.
+// \param eps Tolerance applied to each linear channel.
+// \return True when every linear sRGB channel is within [-eps, 1 + eps].
+bool inSRGBGamut(const LAB &lab, double eps = 1e-4) noexcept;
+
+// Convert OKLab colours held as separate channel arrays to linear sRGB,
+// without clamping. All spans must have equal length.
+//
+// \param L,a,b Input OKLab channels.
+// \param r,g,bl Output linear sRGB channels.
+void labToLinear(std::span<const float> L, std::span<const float> a,
+                 std::span<const float> b, std::span<float> r,
+                 std::span<float> g, std::span<float> bl) noexcept;
+
+// Convert OKLab colours held as separate channel arrays to display sRGB.
+// Works a whole channel at a time so the matrix steps vectorise; values
+// outside the gamut are clamped to [0,1]. All spans must have equal length.
+//
+// \param L,a,b Input OKLab channels.
+// \param r,g,bl Output sRGB channels in the range [0,1].
+void labToSRGB(std::span<const float> L, std::span<const float> a,
+               std::span<const float> b, std::span<float> r,
+               std::span<float> g, std::span<float> bl) noexcept;
+
+// Linear-light value of every 8-bit sRGB level, for converting bytes
+// without evaluating the gamma curve per pixel.
+const std::array<float, 256> &srgb8LinearTable() noexcept;
+
+// Gamma-encode a linear channel to the nearest 8-bit sRGB level. Values
+// outside [0,1] are clamped.
+std::uint8_t linearToSRGB8(double c) noexcept;
+
+// Convert packed 8-bit RGBA pixels to OKLab channel arrays. The inverse of
+// labToSRGB, but reading bytes: gamma expansion is a table lookup and alpha
+// is ignored. Each output span holds one value per pixel.
+//
+// \param rgba  Input pixels, four bytes each.
+// \param L,a,b Output OKLab channels.
+void srgb8ToLab(std::span<const unsigned char> rgba, std::span<float> L,
+                std::span<float> a, std::span<float> b) noexcept;
+
+// As srgb8ToLab for 16-bit sRGB channels, such as those of a 16-bit PNG.
+//
+// \param rgba  Input pixels, four 16-bit values each.
+// \param L,a,b Output OKLab channels.
+void srgb16ToLab(std::span<const std::uint16_t> rgba, std::span<float> L,
+                 std::span<float> a, std::span<float> b) noexcept;
+
+// As srgb8ToLab for linear-light float channels, such as a tone-mapped HDR
+// image. Values above 1 are kept; negative ones are treated as 0.
+//
+// \param rgba  Input pixels, four floats each.
+// \param L,a,b Output OKLab channels.
+void linearToLab(std::span<const float> rgba, std::span<float> L,
+                 std::span<float> a, std::span<float> b) noexcept;
 } // namespace uc
@@ -0,0 +1,283 @@
+// urColo - palette distinctness optimiser
+#include "DistinctOptimiser.h"
+#include "Random.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace {
+using namespace uc;
+
+// Softness of the minimum used for the repulsion energy. Smaller values track
+// the true minimum distance more closely but make the landscape more rugged.
+constexpr double SOFTMIN_SCALE = 0.01;
+
+// Moves each replica attempts between exchange rounds. Large enough that the
+// per-round scheduling cost is negligible, small enough to check the
+// deadline often.
+constexpr int MOVES_PER_ROUND = 512;
+
+// Proposal step sizes for the coldest and hottest replicas. Cold chains refine
+// a good state with small nudges while hot chains jump across the gamut.
+constexpr double STEP_MIN = 0.004;
+constexpr double STEP_MAX = 0.12;
+
+// OKLab a/b extent used when drawing random starting colours. The sRGB gamut
+// sits well inside this box so rejection sampling terminates quickly.
+constexpr double AB_RANGE = 0.35;
+constexpr int MAX_SAMPLE_TRIES = 64;
+
+// Upper bound on the number of replicas.
+constexpr int MAX_REPLICAS = 16;
+
+double distance(const LAB &a, const LAB &b) {
+    double dL = a.L - b.L;
+    double da = a.a - b.a;
+    double db = a.b - b.b;
+    return std::sqrt(dL * dL + da * da + db * db);
+}
+
+// One annealing chain. Points are stored locked first, followed by the free
+// colours being optimised; `pair` caches exp(-d/scale) for every pair that
+// involves a free colour so a move only touches one row.
+struct Replica {
+    std::vector<LAB> pts;
+    std::vector<double> pair;
+    std::vector<double> anchor; //< Anchor penalty per free colour
+    double pairSum{0.0};
+    double anchorSum{0.0};
+    double energy{0.0};
+    double temperature{0.0};
+    double step{0.0};
+    std::mt19937_64 rng;
+    std::vector<LAB> best;
+    double bestEnergy{std::numeric_limits<double>::infinity()};
+};
+
+class Annealer {
+  public:
+    Annealer(std::span<const LAB> locked, std::size_t want,
+             const DistinctSettings &settings)
+        : _locked(locked.size()), _free(want), _n(locked.size() + want),
+          _weight(settings.anchorWeight) {}
+
+    // Energy of a state given its cached pair and anchor sums.
+    double energy(double pairSum, double anchorSum) const {
+        double rep = pairSum > 0.0 ? SOFTMIN_SCALE * std::log(pairSum) : 0.0;
+        return rep + _weight * anchorSum / static_cast<double>(_free);
+    }
+
+    // Squared distance from a colour to the nearest locked colour.
+    double anchorPenalty(const Replica &r, const LAB &p) const {
+        double best = 0.0;
+        for (std::size_t l = 0; l < _locked; ++l) {
+            double d = distance(p, r.pts[l]);
+            if (l == 0 || d * d < best)
+                best = d * d;
+        }
+        return best;
+    }
+
+    // Recompute every cached term from scratch. Called on start-up and after
+    // each round to stop incremental updates drifting.
+    void rebuild(Replica &r) const {
+        r.pair.assign(_n * _n, 0.0);
+        r.pairSum = 0.0;
+        for (std::size_t i = _locked; i < _n; ++i) {
+            for (std::size_t j = 0; j < i; ++j) {
+                double t = std::exp(-distance(r.pts[i], r.pts[j]) /
+                                    SOFTMIN_SCALE);
+                r.pair[i * _n + j] = t;
+                r.pair[j * _n + i] = t;
+                r.pairSum += t;
+            }
+        }
+        r.anchor.assign(_free, 0.0);
+        r.anchorSum = 0.0;
+        for (std::size_t f = 0; f < _free; ++f) {
+            r.anchor[f] = anchorPenalty(r, r.pts[_locked + f]);
+            r.anchorSum += r.anchor[f];
+        }
+        r.energy = energy(r.pairSum, r.anchorSum);
+    }
+
+    // Attempt a single Metropolis move of one free colour.
+    void move(Replica &r, std::vector<double> &row) const {
+        std::uniform_int_distribution<std::size_t> pick(_locked, _n - 1);
+        std::normal_distribution<double> nudge(0.0, r.step);
+        std::size_t i = pick(r.rng);
+        LAB cand{r.pts[i].L + nudge(r.rng), r.pts[i].a + nudge(r.rng),
+                 r.pts[i].b + nudge(r.rng)};
+        if (!inSRGBGamut(cand))
+            return;
+
+        double delta = 0.0;
+        for (std::size_t j = 0; j < _n; ++j) {
+            if (j == i) {
+                row[j] = 0.0;
+                continue;
+            }
+            row[j] = std::exp(-distance(cand, r.pts[j]) / SOFTMIN_SCALE);
+            delta += row[j] - r.pair[i * _n + j];
+        }
+        double newPairSum = std::max(r.pairSum + delta, 0.0);
+        double newAnchor = anchorPenalty(r, cand);
+        double newAnchorSum = r.anchorSum - r.anchor[i - _locked] + newAnchor;
+        double newEnergy = energy(newPairSum, newAnchorSum);
+        double dE = newEnergy - r.energy;
+        if (dE > 0.0) {
+            std::uniform_real_distribution<double> u(0.0, 1.0);
+            if (u(r.rng) >= std::exp(-dE / r.temperature))
+                return;
+        }
+
+        r.pts[i] = cand;
+        for (std::size_t j = 0; j < _n; ++j) {
+            r.pair[i * _n + j] = row[j];
+            r.pair[j * _n + i] = row[j];
+        }
+        r.pairSum = newPairSum;
+        r.anchor[i - _locked] = newAnchor;
+        r.anchorSum = newAnchorSum;
+        r.energy = newEnergy;
+        record(r);
+    }
+
+    // Remember the current state if it is the best this replica has seen.
+    void record(Replica &r) const {
+        if (r.energy < r.bestEnergy) {
+            r.bestEnergy = r.energy;
+            r.best.assign(r.pts.begin() + static_cast<std::ptrdiff_t>(_locked),
+                          r.pts.end());
+        }
+    }
+
+    // Run one round of moves on a replica.
+    void sweep(Replica &r) const {
+        std::vector<double> row(_n);
+        for (int m = 0; m < MOVES_PER_ROUND; ++m)
+            move(r, row);
+        rebuild(r);
+        record(r);
+    }
+
+  private:
+    std::size_t _locked;
+    std::size_t _free;
+    std::size_t _n;
+    double _weight;
+};
+
+// Draw a random in-gamut colour, preferring the neighbourhood of a locked
+// colour when any exist.
+LAB randomStart(std::span<const LAB> locked, std::mt19937_64 &rng) {
+    std::uniform_real_distribution<double> Ld(0.05, 0.95);
+    std::uniform_real_distribution<double> ab(-AB_RANGE, AB_RANGE);
+    std::normal_distribution<double> near(0.0, 0.05);
+    for (int t = 0; t < MAX_SAMPLE_TRIES; ++t) {
+        LAB p{Ld(rng), ab(rng), ab(rng)};
+        if (!locked.empty()) {
+            std::uniform_int_distribution<std::size_t> pick(0,
+                                                            locked.size() - 1);
+            const LAB &l = locked[pick(rng)];
+            p = {l.L + near(rng), l.a + near(rng), l.b + near(rng)};
+        }
+        if (inSRGBGamut(p))
+            return p;
+    }
+    return {Ld(rng), 0.0, 0.0};
+}
+} // namespace
+
+namespace uc {
+
+double minPairDistance(std::span<const LAB> locked,
+                       std::span<const LAB> fresh) {
+    double best = std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < fresh.size(); ++i) {
+        for (const auto &l : locked)
+            best = std::min(best, distance(fresh[i], l));
+        for (std::size_t j = i + 1; j < fresh.size(); ++j)
+            best = std::min(best, distance(fresh[i], fresh[j]));
+    }
+    return std::isinf(best) ? 0.0 : best;
+}
+
+std::vector<LAB> optimiseDistinct(std::span<const LAB> locked,
+                                  std::size_t want,
+                                  const DistinctSettings &settings,
+                                  std::uint64_t seed, std::stop_token stop) {
+    if (want == 0)
+        return {};
+
+    const auto deadline = std::chrono::steady_clock::now() + settings.budget;
+    const int count = std::clamp(settings.replicas, 1, MAX_REPLICAS);
+    Annealer annealer(locked, want, settings);
+
+    // Temperatures and step sizes follow a geometric ladder from the coldest
+    // to the hottest chain so exchanges between neighbours stay likely.
+    std::vector<Replica> replicas(static_cast<std::size_t>(count));
+    for (int r = 0; r < count; ++r) {
+        auto &rep = replicas[static_cast<std::size_t>(r)];
+        double t = count == 1 ? 0.0
+                              : static_cast<double>(r) /
+                                    static_cast<double>(count - 1);
+        rep.temperature = settings.tMin * std::pow(settings.tMax /
+                                                       settings.tMin,
+                                                   t);
+        rep.step = STEP_MIN * std::pow(STEP_MAX / STEP_MIN, t);
+        rep.rng.seed(deriveSeed(seed, static_cast<std::uint64_t>(r)));
+        rep.pts.assign(locked.begin(), locked.end());
+        for (std::size_t i = 0; i < want; ++i)
+            rep.pts.push_back(randomStart(locked, rep.rng));
+        annealer.rebuild(rep);
+        annealer.record(rep);
+    }
+
+    // After every round the calling thread attempts replica exchanges
+    // between neighbouring temperatures and checks the deadline and stop
+    // token.
+    std::mt19937_64 swapRng{splitmix64(~seed)};
+    bool done = false;
+    auto exchange = [&]() noexcept {
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        for (std::size_t r = 0; r + 1 < replicas.size(); ++r) {
+            auto &a = replicas[r];
+            auto &b = replicas[r + 1];
+            double x = (a.energy - b.energy) *
+                       (1.0 / a.temperature - 1.0 / b.temperature);
+            if (x >= 0.0 || u(swapRng) < std::exp(x)) {
+                std::swap(a.pts, b.pts);
+                std::swap(a.pair, b.pair);
+                std::swap(a.anchor, b.anchor);
+                std::swap(a.pairSum, b.pairSum);
+                std::swap(a.anchorSum, b.anchorSum);
+                std::swap(a.energy, b.energy);
+            }
+        }
+        done = std::chrono::steady_clock::now() >= deadline ||
+               stop.stop_requested();
+    };
+
+    // Replicas sweep as tasks on the shared pool. The caller works through
+    // them too, so a search started from a pool worker, as when palettes
+    // are generated in parallel, needs no extra threads.
+    auto &pool = ThreadPool::shared();
+    do {
+        pool.parallelFor(replicas.size(), [&](std::size_t r) {
+            annealer.sweep(replicas[r]);
+        });
+        exchange();
+    } while (!done);
+
+    const Replica &winner = *std::min_element(
+        replicas.begin(), replicas.end(),
+        [](const Replica &a, const Replica &b) {
+            return a.bestEnergy < b.bestEnergy;
+        });
+    return winner.best;
+}
+} // namespace uc
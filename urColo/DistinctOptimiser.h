@@ -0,0 +1,54 @@
+// urColo - palette distinctness optimiser interface
+#pragma once
+#include "Colour.h"
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace uc {
+// Settings for the parallel tempering search used by the Distinct algorithm.
+//
+// Member variables:
+// - `budget`       Wall-clock time the search may run for.
+// - `replicas`     Number of annealing chains, swept in parallel on the
+//                  shared thread pool.
+// - `tMin`/`tMax`  Temperatures of the coldest and hottest chains.
+// - `anchorWeight` Strength of the pull keeping new colours near locked ones.
+struct DistinctSettings {
+    std::chrono::milliseconds budget{60}; //< Search time limit
+    int replicas{4};                      //< Parallel tempering chains
+    double tMin{1e-4};                    //< Coldest chain temperature
+    double tMax{2e-2};                    //< Hottest chain temperature
+    double anchorWeight{1.0};             //< Attraction toward locked colours
+};
+
+// Search for `want` in-gamut OKLab colours that are as easy as possible to
+// tell apart from each other and from the locked colours.
+//
+// The energy is a soft minimum of the pairwise OKLab distances between every
+// pair involving an unlocked colour, plus a penalty on each unlocked colour's
+// squared distance to its nearest locked colour.  Several replicas anneal at
+// different temperatures and periodically exchange states; single-colour
+// moves only recompute the affected row of pair terms so each step is O(n).
+//
+// \param locked   Colours that must be kept, in OKLab.
+// \param want     Number of new colours to produce.
+// \param settings Search parameters and time budget.
+// \param seed     Seed for the replicas' random streams.
+// \param stop     Ends the search early, as if the budget had run out.
+// \return The lowest-energy set of new colours found within the budget.
+std::vector<LAB> optimiseDistinct(std::span<const LAB> locked,
+                                  std::size_t want,
+                                  const DistinctSettings &settings,
+                                  std::uint64_t seed,
+                                  std::stop_token stop = {});
+
+// Smallest OKLab distance between any pair that involves a colour from
+// `fresh`, i.e. fresh/fresh and fresh/locked pairs.
+//
+// \return Zero when there are no such pairs.
+double minPairDistance(std::span<const LAB> locked,
+                       std::span<const LAB> fresh);
+} // namespace uc
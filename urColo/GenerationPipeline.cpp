@@ -0,0 +1,130 @@
+// urColo - background palette generation pipeline
+#include "GenerationPipeline.h"
+#include "Logger.h"
+
+#include <exception>
+
+namespace {
+// Flag stored alongside the middle slot index to mark an unread result.
+constexpr unsigned DIRTY = 4u;
+constexpr unsigned INDEX_MASK = 3u;
+} // namespace
+
+namespace uc {
+
+std::size_t applyGenerated(std::vector<Palette> &palettes,
+                           std::span<const GeneratedColour> colours) {
+    std::size_t written = 0;
+    for (const auto &g : colours) {
+        if (g.palette >= palettes.size())
+            continue;
+        auto &swatches = palettes[g.palette]._swatches;
+        if (g.swatch >= swatches.size() || swatches[g.swatch]._locked)
+            continue;
+        swatches[g.swatch]._colour = g.colour;
+        ++written;
+    }
+    return written;
+}
+
+GenerationPipeline::GenerationPipeline()
+    : _worker([this](std::stop_token stop) { run(stop); }) {}
+
+GenerationPipeline::~GenerationPipeline() {
+    // Stop the job first: the worker cannot notice its own stop request
+    // until the job it is running returns.
+    cancel();
+    _worker.request_stop();
+    _worker.join();
+}
+
+std::uint64_t GenerationPipeline::submit(Job job) {
+    std::uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _current.request_stop();
+        _current = std::stop_source{};
+        if (_pending)
+            markFinished(_pendingId);
+        id = _latest.load() + 1;
+        _pending = std::move(job);
+        _pendingId = id;
+        _latest.store(id);
+    }
+    _wake.notify_one();
+    return id;
+}
+
+void GenerationPipeline::cancel() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _current.request_stop();
+    if (_pending) {
+        _pending = nullptr;
+        markFinished(_pendingId);
+    }
+}
+
+bool GenerationPipeline::poll(std::vector<GeneratedColour> &out) {
+    if ((_middle.load(std::memory_order_acquire) & DIRTY) == 0)
+        return false;
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX_MASK;
+    auto &slot = _slots[_front];
+    if (slot.id != _latest.load())
+        return false;
+    out = std::move(slot.colours);
+    slot.colours.clear();
+    return true;
+}
+
+bool GenerationPipeline::busy() const {
+    return _finished.load() < _latest.load();
+}
+
+// Worker loop: wait for a job, run it, and publish its result unless it was
+// cancelled or superseded in the meantime.
+void GenerationPipeline::run(std::stop_token stop) {
+    while (true) {
+        Job job;
+        std::uint64_t id = 0;
+        std::stop_token jobStop;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!_wake.wait(lock, stop,
+                            [this] { return static_cast<bool>(_pending); }))
+                return;
+            job = std::move(_pending);
+            _pending = nullptr;
+            id = _pendingId;
+            jobStop = _current.get_token();
+        }
+
+        _progress.set(0.0f);
+        try {
+            auto result = job(jobStop, _progress);
+            if (!jobStop.stop_requested() && id == _latest.load())
+                publish(id, std::move(result));
+        } catch (const std::exception &e) {
+            Logger::log(Logger::Level::Error, "Palette generation failed: {}",
+                        e.what());
+        }
+        markFinished(id);
+    }
+}
+
+void GenerationPipeline::publish(std::uint64_t id,
+                                 std::vector<GeneratedColour> &&colours) {
+    _slots[_back].id = id;
+    _slots[_back].colours = std::move(colours);
+    _back = _middle.exchange(_back | DIRTY, std::memory_order_acq_rel) &
+            INDEX_MASK;
+}
+
+// Record that job `id` will not run any further. Jobs can complete out of
+// order when a superseded one is still winding down, so keep the maximum.
+void GenerationPipeline::markFinished(std::uint64_t id) {
+    std::uint64_t prev = _finished.load();
+    while (prev < id && !_finished.compare_exchange_weak(prev, id)) {
+    }
+}
+
+} // namespace uc
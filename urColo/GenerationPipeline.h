@@ -0,0 +1,123 @@
+// urColo - background palette generation pipeline interface
+#pragma once
+#include "Colour.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace uc {
+// A colour produced by a generation job.
+//
+// Member variables:
+// - `palette` Index of the palette when the job was submitted.
+// - `swatch`  Index of the swatch within that palette.
+// - `colour`  Generated colour.
+struct GeneratedColour {
+    std::size_t palette;
+    std::size_t swatch;
+    ImVec4 colour;
+};
+
+// Write generated colours into `palettes`, skipping any whose palette or
+// swatch no longer exists or whose swatch has been locked since the job
+// was submitted. Everything else the user changed meanwhile is kept.
+//
+// \return Number of swatches written.
+std::size_t applyGenerated(std::vector<Palette> &palettes,
+                           std::span<const GeneratedColour> colours);
+
+// Fraction of the running job that has completed, written by the worker and
+// read by the UI without locking.
+class JobProgress {
+  public:
+    // Report progress in the range [0, 1].
+    void set(float fraction) {
+        _value.store(fraction, std::memory_order_relaxed);
+    }
+    // Most recently reported progress.
+    [[nodiscard]] float get() const {
+        return _value.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<float> _value{0.0f};
+};
+
+// Runs palette generation jobs on a single persistent worker thread.
+//
+// Submitting a job requests cancellation of whatever is running or queued, so
+// only the newest job ever delivers a result. Jobs observe cancellation via
+// the stop token they receive. Generated colours are handed to the UI thread
+// through a triple buffer, so neither side blocks on the other.
+class GenerationPipeline {
+  public:
+    // A generation job. It should poll the token between units of work and
+    // report progress as it goes; its result is discarded if it was stopped.
+    using Job = std::function<std::vector<GeneratedColour>(std::stop_token,
+                                                           JobProgress &)>;
+
+    GenerationPipeline();
+    ~GenerationPipeline();
+    GenerationPipeline(const GenerationPipeline &) = delete;
+    GenerationPipeline &operator=(const GenerationPipeline &) = delete;
+
+    // Queue a job, superseding any job that is queued or running.
+    //
+    // \return Identifier of the new job; identifiers increase monotonically.
+    std::uint64_t submit(Job job);
+
+    // Cancel the queued and running jobs without starting a new one.
+    void cancel();
+
+    // Collect the newest finished result, if one arrived since the last call.
+    // Results from jobs that have since been superseded are dropped.
+    //
+    // \param out Receives the colours when a result is available.
+    // \return True if `out` was written.
+    bool poll(std::vector<GeneratedColour> &out);
+
+    // Whether the latest submitted job has not finished yet.
+    [[nodiscard]] bool busy() const;
+    // Progress reported by the job currently running.
+    [[nodiscard]] float progress() const { return _progress.get(); }
+
+  private:
+    struct Result {
+        std::uint64_t id{0};
+        std::vector<GeneratedColour> colours;
+    };
+
+    void run(std::stop_token stop);
+    void publish(std::uint64_t id, std::vector<GeneratedColour> &&colours);
+    void markFinished(std::uint64_t id);
+
+    // Job mailbox, guarded by _mutex.
+    std::mutex _mutex;
+    std::condition_variable_any _wake;
+    Job _pending;
+    std::uint64_t _pendingId{0};
+    std::stop_source _current; //< Stops the queued or running job
+
+    std::atomic<std::uint64_t> _latest{0};   //< Newest submitted job
+    std::atomic<std::uint64_t> _finished{0}; //< Newest job done or dropped
+    JobProgress _progress;
+
+    // Triple buffer. The worker fills _slots[_back] and swaps it into
+    // _middle; the UI swaps _middle with _slots[_front] when the dirty bit
+    // is set. Only _middle is shared between the two threads.
+    std::array<Result, 3> _slots;
+    std::atomic<unsigned> _middle{1};
+    unsigned _back{0};  //< Owned by the worker
+    unsigned _front{2}; //< Owned by the UI thread
+
+    // Declared last so it starts after, and stops before, the state above.
+    std::jthread _worker;
+};
+} // namespace uc
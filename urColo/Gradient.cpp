@@ -0,0 +1,209 @@
+// urColo - perceptually uniform gradients and colormaps
+#include "Gradient.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <fstream>
+
+namespace {
+using namespace uc;
+
+// Uniform parameter steps per segment in the arc-length table. Between two
+// steps the curve is treated as straight; 64 keeps the spacing error far
+// below one 8-bit step even for strongly curved segments.
+constexpr std::size_t SAMPLES_PER_SEGMENT = 64;
+
+// Smallest knot interval. Guards the tangent divisions when two adjacent
+// anchors are identical.
+constexpr double KNOT_EPS = 1e-6;
+
+double distance(const LAB &a, const LAB &b) {
+    double dL = a.L - b.L;
+    double da = a.a - b.a;
+    double db = a.b - b.b;
+    return std::sqrt(dL * dL + da * da + db * db);
+}
+
+// Centripetal knot interval: the square root of the chord length.
+double knot(const LAB &a, const LAB &b) {
+    return std::max(std::sqrt(distance(a, b)), KNOT_EPS);
+}
+
+// Knot intervals of one Catmull-Rom segment.
+struct Knots {
+    double d01, d12, d23;
+};
+
+// Convert one channel of a centripetal Catmull-Rom segment from p1 to p2
+// into cubic coefficients over u in [0, 1].
+void segmentCoefficients(double p0, double p1, double p2, double p3,
+                         const Knots &k,
+                         std::array<std::vector<double>, 4> &c,
+                         std::size_t seg) {
+    double m1 = ((p1 - p0) / k.d01 - (p2 - p0) / (k.d01 + k.d12) +
+                 (p2 - p1) / k.d12) *
+                k.d12;
+    double m2 = ((p2 - p1) / k.d12 - (p3 - p1) / (k.d12 + k.d23) +
+                 (p3 - p2) / k.d23) *
+                k.d12;
+    c[0][seg] = p1;
+    c[1][seg] = m1;
+    c[2][seg] = -3.0 * p1 + 3.0 * p2 - 2.0 * m1 - m2;
+    c[3][seg] = 2.0 * p1 - 2.0 * p2 + m1 + m2;
+}
+
+double cubic(const std::array<std::vector<double>, 4> &c, std::size_t seg,
+             double u) {
+    return ((c[3][seg] * u + c[2][seg]) * u + c[1][seg]) * u + c[0][seg];
+}
+} // namespace
+
+namespace uc {
+
+Gradient::Gradient(std::span<const LAB> anchors) {
+    if (anchors.empty())
+        return;
+    if (anchors.size() == 1) {
+        _single = anchors[0];
+        return;
+    }
+
+    const std::size_t n = anchors.size();
+    const std::size_t segs = n - 1;
+    for (auto *channel : {&_L, &_a, &_b})
+        for (auto &c : *channel)
+            c.resize(segs);
+
+    // Missing neighbours at either end are mirrored through the end anchor
+    // so the curve leaves and arrives heading straight at its neighbour.
+    auto at = [&](std::ptrdiff_t i) -> LAB {
+        if (i < 0) {
+            const LAB &e = anchors[0];
+            const LAB &o = anchors[1];
+            return {2.0 * e.L - o.L, 2.0 * e.a - o.a, 2.0 * e.b - o.b};
+        }
+        if (static_cast<std::size_t>(i) >= n) {
+            const LAB &e = anchors[n - 1];
+            const LAB &o = anchors[n - 2];
+            return {2.0 * e.L - o.L, 2.0 * e.a - o.a, 2.0 * e.b - o.b};
+        }
+        return anchors[static_cast<std::size_t>(i)];
+    };
+
+    for (std::size_t s = 0; s < segs; ++s) {
+        auto i = static_cast<std::ptrdiff_t>(s);
+        LAB p0 = at(i - 1);
+        LAB p1 = at(i);
+        LAB p2 = at(i + 1);
+        LAB p3 = at(i + 2);
+        Knots k{knot(p0, p1), knot(p1, p2), knot(p2, p3)};
+        segmentCoefficients(p0.L, p1.L, p2.L, p3.L, k, _L, s);
+        segmentCoefficients(p0.a, p1.a, p2.a, p3.a, k, _a, s);
+        segmentCoefficients(p0.b, p1.b, p2.b, p3.b, k, _b, s);
+    }
+
+    // Accumulate chord lengths over a fine uniform grid of the parameter.
+    _cum.reserve(segs * SAMPLES_PER_SEGMENT + 1);
+    _cum.push_back(0.0);
+    LAB prev = anchors[0];
+    for (std::size_t s = 0; s < segs; ++s) {
+        for (std::size_t j = 1; j <= SAMPLES_PER_SEGMENT; ++j) {
+            double u = static_cast<double>(j) /
+                       static_cast<double>(SAMPLES_PER_SEGMENT);
+            LAB p{cubic(_L, s, u), cubic(_a, s, u), cubic(_b, s, u)};
+            _cum.push_back(_cum.back() + distance(prev, p));
+            prev = p;
+        }
+    }
+}
+
+void Gradient::evaluate(std::span<const double> s, std::span<float> L,
+                        std::span<float> a, std::span<float> b) const {
+    const std::size_t n = s.size();
+    if (_cum.empty()) {
+        std::fill_n(L.begin(), n, static_cast<float>(_single.L));
+        std::fill_n(a.begin(), n, static_cast<float>(_single.a));
+        std::fill_n(b.begin(), n, static_cast<float>(_single.b));
+        return;
+    }
+
+    // Map each arc-length position to a segment and local parameter. The
+    // positions are sorted, so the table is walked once in total.
+    const std::size_t segs = _L[0].size();
+    const std::size_t last = _cum.size() - 1;
+    std::vector<std::uint32_t> seg(n);
+    std::vector<double> u(n);
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        double target = std::clamp(s[i], 0.0, length());
+        while (j + 1 < last && _cum[j + 1] < target)
+            ++j;
+        double step = _cum[j + 1] - _cum[j];
+        double frac = step > 0.0 ? (target - _cum[j]) / step : 0.0;
+        double g = (static_cast<double>(j) + frac) /
+                   static_cast<double>(SAMPLES_PER_SEGMENT);
+        auto k = std::min(static_cast<std::size_t>(g), segs - 1);
+        seg[i] = static_cast<std::uint32_t>(k);
+        u[i] = g - static_cast<double>(k);
+    }
+
+    // Evaluate the cubics one channel at a time.
+    for (std::size_t i = 0; i < n; ++i)
+        L[i] = static_cast<float>(cubic(_L, seg[i], u[i]));
+    for (std::size_t i = 0; i < n; ++i)
+        a[i] = static_cast<float>(cubic(_a, seg[i], u[i]));
+    for (std::size_t i = 0; i < n; ++i)
+        b[i] = static_cast<float>(cubic(_b, seg[i], u[i]));
+}
+
+std::vector<LAB> Gradient::sample(std::size_t n, bool inclusive) const {
+    std::vector<double> pos(n);
+    const double len = length();
+    for (std::size_t i = 0; i < n; ++i) {
+        double t = inclusive ? (n > 1 ? static_cast<double>(i) /
+                                            static_cast<double>(n - 1)
+                                      : 0.0)
+                             : static_cast<double>(i + 1) /
+                                   static_cast<double>(n + 1);
+        pos[i] = t * len;
+    }
+    std::vector<float> L(n), a(n), b(n);
+    evaluate(pos, L, a, b);
+
+    std::vector<LAB> out(n);
+    for (std::size_t i = 0; i < n; ++i)
+        out[i] = {L[i], a[i], b[i]};
+    return out;
+}
+
+Colormap Gradient::colormap(std::size_t n) const {
+    std::vector<double> pos(n);
+    const double step =
+        n > 1 ? length() / static_cast<double>(n - 1) : 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+        pos[i] = step * static_cast<double>(i);
+
+    std::vector<float> L(n), a(n), b(n);
+    evaluate(pos, L, a, b);
+
+    Colormap map;
+    map.r.resize(n);
+    map.g.resize(n);
+    map.b.resize(n);
+    labToSRGB(L, a, b, map.r, map.g, map.b);
+    return map;
+}
+
+bool saveColormapCSV(const Colormap &map, const std::filesystem::path &path) {
+    std::ofstream out{path};
+    if (!out.is_open())
+        return false;
+    for (std::size_t i = 0; i < map.size(); ++i)
+        out << std::format("{:.6f},{:.6f},{:.6f}\n", map.r[i], map.g[i],
+                           map.b[i]);
+    return static_cast<bool>(out);
+}
+
+} // namespace uc
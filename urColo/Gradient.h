@@ -0,0 +1,74 @@
+// urColo - perceptually uniform gradient interface
+#pragma once
+#include "Colour.h"
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+namespace uc {
+// A colormap table stored as separate display sRGB channels in [0,1].
+//
+// Member variables: `r`, `g`, `b`, all of equal length.
+struct Colormap {
+    std::vector<float> r;
+    std::vector<float> g;
+    std::vector<float> b;
+
+    [[nodiscard]] std::size_t size() const { return r.size(); }
+};
+
+// A smooth curve through a sequence of OKLab anchor colours.
+//
+// Consecutive anchors are joined by centripetal Catmull-Rom segments, which
+// pass through every anchor without the loops and cusps a uniform spline
+// can form around unevenly spaced points. The curve is reparametrised by
+// OKLab arc length, so equal steps along it are equally far apart
+// perceptually regardless of how the anchors are spaced.
+class Gradient {
+  public:
+    // Smallest and largest colormap sizes offered for export.
+    static constexpr std::size_t kMinColormapSize = 256;
+    static constexpr std::size_t kMaxColormapSize = 4096;
+
+    // Build the curve through `anchors` in the order given.
+    explicit Gradient(std::span<const LAB> anchors);
+
+    // Total OKLab length of the curve.
+    [[nodiscard]] double length() const {
+        return _cum.empty() ? 0.0 : _cum.back();
+    }
+
+    // Colours at `n` evenly spaced arc-length positions. With `inclusive`
+    // set the first and last samples are the end anchors; otherwise the
+    // samples sit strictly between them at i / (n + 1).
+    [[nodiscard]] std::vector<LAB> sample(std::size_t n,
+                                          bool inclusive = true) const;
+
+    // Evaluate an `n` entry colormap running from the first anchor to the
+    // last. Positions, curve evaluation and colour conversion each run as a
+    // separate pass over channel arrays.
+    [[nodiscard]] Colormap colormap(std::size_t n) const;
+
+    // Evaluate the curve at arc-length positions `s` in [0, length()],
+    // writing OKLab channels to `L`, `a` and `b`. Positions must be sorted
+    // in ascending order.
+    void evaluate(std::span<const double> s, std::span<float> L,
+                  std::span<float> a, std::span<float> b) const;
+
+  private:
+    // Cubic coefficients per segment, p(u) = c0 + c1 u + c2 u^2 + c3 u^3,
+    // one array per channel and power so evaluation reads them linearly.
+    std::array<std::vector<double>, 4> _L, _a, _b;
+    // Cumulative arc length at SAMPLES_PER_SEGMENT uniform steps of u in
+    // every segment, used to map arc length back to the curve parameter.
+    std::vector<double> _cum;
+    LAB _single{}; //< Only colour when built from one anchor
+};
+
+// Write a colormap as CSV, one "r,g,b" line of floats in [0,1] per entry.
+//
+// \return False if the file could not be written.
+bool saveColormapCSV(const Colormap &map, const std::filesystem::path &path);
+} // namespace uc
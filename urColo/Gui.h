@@ -29,6 +29,9 @@ struct GuiManager {
     const Swatch *swatchForIndex(int idx) const;
 
     std::vector<uc::Palette> _palettes;
+    // Palettes the model learned from the Good checkbox since the window
+    // manager last collected them.
+    std::vector<uc::Palette> _learned;
     std::unique_ptr<pfd::open_file> _imageDialog;
 
   private:
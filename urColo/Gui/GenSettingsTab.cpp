@@ -3,13 +3,58 @@
 #include "Contrast.h"
 #include "Logger.h"
 #include "PaletteGenerator.h"
+#include "ThreadPool.h"
 #include "imgui.h"
 #include "imgui/misc/cpp/imgui_stdlib.h"
 
 #include "../Gui.h"
 
 #include <GL/gl.h>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
 #include <format>
+#include <utility>
+
+namespace {
+using namespace uc;
+
+// Height of the image preview as drawn next to the k-means settings.
+constexpr float PREVIEW_HEIGHT = kSwatchHeightPx * 1.5f;
+
+// Resolution of the preview texture relative to its drawn size, so it
+// stays sharp on high-DPI displays.
+constexpr float PREVIEW_OVERSAMPLE = 2.0f;
+
+// Widest preview texture relative to its height. Wider images are drawn
+// stretched from a texture of this shape rather than uploaded in full.
+constexpr int PREVIEW_MAX_ASPECT = 4;
+
+// File patterns offered when opening an image: the formats stb_image reads,
+// including those it decodes at 16 bits (PNG, PSD, PNM) or as HDR.
+constexpr const char *IMAGE_PATTERNS =
+    "*.png *.jpg *.jpeg *.bmp *.tga *.psd *.hdr *.pnm *.ppm *.pgm";
+
+// Small box-filtered copy of an image, sized for the preview texture.
+ImageData previewOf(const ImageData &img) {
+    const int h = static_cast<int>(PREVIEW_HEIGHT * PREVIEW_OVERSAMPLE);
+    return makeThumbnail(img, h * PREVIEW_MAX_ASPECT, h);
+}
+
+// Noise standing in for a random image of the given size. It is generated
+// at the size previewOf() would reduce the image to, so the full image is
+// never made; k-means synthesises its own samples from the same seed.
+ImageData randomPreview(int width, int height, std::uint64_t seed) {
+    const int h = static_cast<int>(PREVIEW_HEIGHT * PREVIEW_OVERSAMPLE);
+    const double scale = std::min(
+        {1.0, static_cast<double>(h * PREVIEW_MAX_ASPECT) / width,
+         static_cast<double>(h) / height});
+    auto fit = [scale](int len) {
+        return std::max(1, static_cast<int>(std::lround(len * scale)));
+    };
+    return generateRandomImage(fit(width), fit(height), seed);
+}
+} // namespace
 
 namespace uc {
 // Tab containing algorithm and generation settings.
@@ -24,6 +69,8 @@ GenSettingsTab::GenSettingsTab(GuiManager *manager, PaletteGenerator *generator)
 void GenSettingsTab::drawContent() {
     loadRandomImage();
     loadImage();
+    loadBoardImages();
+    updateRecolour();
     ImGui::TextUnformatted("Gen settings tab not implemented yet.");
 
     ImGui::SetNextItemWidth(ImGui::CalcTextSize("Random Offset").x + _margin +
@@ -33,12 +80,17 @@ void GenSettingsTab::drawContent() {
 
     if (_algo == PaletteGenerator::Algorithm::KMeans) {
         drawKMeansSelectors();
+    } else if (_algo == PaletteGenerator::Algorithm::Distinct) {
+        drawDistinctSelectors();
+    } else if (_algo == PaletteGenerator::Algorithm::Learned) {
+        drawLearnedSelectors();
     }
 
     drawGenModeSelector();
 }
 
-// Helper to upload an ImageData object as an OpenGL texture.
+// Helper to upload an ImageData object as an OpenGL texture. Only called
+// with preview thumbnails, never full-resolution images.
 unsigned int GenSettingsTab::createTexture(const ImageData &img) {
     if (img.rgba.empty())
         return 0;
@@ -61,27 +113,50 @@ void GenSettingsTab::loadImage() {
         _imageDialog.reset();
         if (!paths.empty()) {
             auto path = paths[0];
-            _imageThread = std::jthread([this, path]() {
-                auto img = loadImageData(path);
-                _loadedImage = std::move(img);
-                _imageReady = true;
-            });
+            _loadProgress.reset();
+            if (_imageSource == ImageSource::Frames) {
+                _imageThread = std::jthread([this, path]() {
+                    auto frames = loadImageFrames(path, &_loadProgress);
+                    if (!frames.empty()) {
+                        _loadedImage = frames.frames.front();
+                        _loadedPreview = previewOf(*_loadedImage);
+                        _loadedFrameColours = pooledColours(frames.frames);
+                    }
+                    _loadedFrames = std::move(frames.frames);
+                    _imageReady = true;
+                });
+            } else {
+                _imageThread = std::jthread([this, path]() {
+                    _loadedImage = loadSharedImage(path, &_loadProgress);
+                    if (_loadedImage)
+                        _loadedPreview = previewOf(*_loadedImage);
+                    _imageReady = true;
+                });
+            }
             _loadingImage = true;
         }
     }
 }
 
-// Transfer the loaded/random image data into a texture when ready.
+// Take over the loaded/random image and upload its thumbnail, made on the
+// loader thread, as the preview texture when ready.
 void GenSettingsTab::loadRandomImage() {
     if (_imageReady) {
         _imageData = std::move(_loadedImage);
-        _loadedImage = {};
+        _loadedImage.reset();
+        _imageFrames = std::move(_loadedFrames);
+        _loadedFrames.clear();
+        _frameColours = std::move(_loadedFrameColours);
+        _loadedFrameColours.reset();
         if (_imageTexture) {
             glDeleteTextures(1, &_imageTexture);
             _imageTexture = 0;
         }
 
-        _imageTexture = createTexture(_imageData);
+        _preview = std::move(_loadedPreview);
+        _loadedPreview = {};
+        if (!_preview.empty())
+            _imageTexture = createTexture(_preview);
         _loadingImage = false;
         _imageReady = false;
         if (_imageThread.joinable())
@@ -135,8 +210,21 @@ void GenSettingsTab::drawKMeansSelectors() {
     if (ImGui::DragInt("Iterations", &iters, 1.0f, 1, 200))
         _generator->setKMeansIterations(iters);
 
+    int budget = static_cast<int>(_generator->kMeansPixelBudget() / 1024);
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("4096").x * 5.0f);
+    if (ImGui::DragInt("Pixel Budget (K)", &budget, 4.0f, 16, 4096))
+        _generator->setKMeansPixelBudget(static_cast<std::size_t>(budget) *
+                                         1024);
+
+    int regions = static_cast<int>(_generator->kMeansSuperpixels());
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("8192").x * 5.0f);
+    if (ImGui::DragInt("Superpixels", &regions, 16.0f, 0, 8192,
+                       regions == 0 ? "Off" : "%d"))
+        _generator->setKMeansSuperpixels(static_cast<std::size_t>(regions));
+
     int src = static_cast<int>(_imageSource);
-    ImGui::SetNextItemWidth(ImGui::CalcTextSize("Random").x + _margin + _arrow);
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("GIF Frames").x + _margin +
+                            _arrow);
 
     if (ImGui::BeginCombo("KMeans Source",
                           _kmeansSrc[std::size_t(src)].c_str())) {
@@ -154,18 +242,73 @@ void GenSettingsTab::drawKMeansSelectors() {
     drawKMeansImageSelectors();
 }
 
+// Widgets for the distinctness optimiser's time budget and chain count.
+void GenSettingsTab::drawDistinctSelectors() {
+    DistinctSettings ds = _generator->distinctSettings();
+    bool changed = false;
+
+    int budget = static_cast<int>(ds.budget.count());
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("2000").x * 5.0f);
+    if (ImGui::DragInt("Time Budget (ms)", &budget, 5.0f, 10, 2000)) {
+        ds.budget = std::chrono::milliseconds(budget);
+        changed = true;
+    }
+
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("16").x * 5.0f);
+    if (ImGui::DragInt("Chains", &ds.replicas, 0.1f, 1, 16))
+        changed = true;
+
+    float weight = static_cast<float>(ds.anchorWeight);
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("10.00").x * 5.0f);
+    if (ImGui::DragFloat("Locked Pull", &weight, 0.01f, 0.0f, 10.0f, "%.2f")) {
+        ds.anchorWeight = weight;
+        changed = true;
+    }
+
+    if (changed)
+        _generator->setDistinctSettings(ds);
+}
+
+// Learned model options: mixture components fitted when next trained,
+// following palette order and saving the training palettes.
+void GenSettingsTab::drawLearnedSelectors() {
+    // Read through the const model so a copy held by a running job is not
+    // duplicated just to draw the current settings.
+    const Model &model = std::as_const(*_generator).model();
+    int comps = model.components();
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("16").x * 5.0f);
+    if (ImGui::DragInt("Mixture Components", &comps, 0.1f, 1, 16))
+        _generator->model().setComponents(comps);
+    bool ordered = model.ordered();
+    if (ImGui::Checkbox("Follow Palette Order", &ordered))
+        _generator->model().setOrdered(ordered);
+    bool keep = model.savePalettes();
+    if (ImGui::Checkbox("Save Training Palettes", &keep))
+        _generator->model().setSavePalettes(keep);
+}
+
 // Show image preview and options for supplying k-means input.
 void GenSettingsTab::drawKMeansImageSelectors() {
     // img src is not none and there is an image ready
-    if (_imageSource != ImageSource::None && _imageTexture) {
+    const bool board = _imageSource == ImageSource::Board;
+    if (_imageSource != ImageSource::None && !board && _imageTexture) {
         // draw image
         ImGui::SameLine();
-        float h = kSwatchHeightPx * 1.5f;
-        float aspect = static_cast<float>(_imageData.width) /
-                       static_cast<float>(_imageData.height);
+        // Random images exist only as their preview.
+        const ImageData &shown = _imageData ? *_imageData : _preview;
+        float h = PREVIEW_HEIGHT;
+        float aspect = static_cast<float>(shown.width) /
+                       static_cast<float>(shown.height);
         ImGui::Image(static_cast<ImTextureID>(_imageTexture),
                      ImVec2(h * aspect, h));
+        if (_showRecolour && _recolourTexture) {
+            ImGui::SameLine();
+            ImGui::Image(static_cast<ImTextureID>(_recolourTexture),
+                         ImVec2(h * aspect, h));
+        }
     }
+    if (_imageSource != ImageSource::None && !board)
+        drawRecolourSelectors();
 
     if (_imageSource == ImageSource::Random) {
         const float field = ImGui::CalcTextSize("512").x * 5.0f;
@@ -174,34 +317,220 @@ void GenSettingsTab::drawKMeansImageSelectors() {
         ImGui::SetNextItemWidth(field);
         ImGui::DragInt("Height", &_randHeight, 1.0f, 1, 512);
         if (ImGui::Button("Generate Image")) {
-            _imageThread = std::jthread([this]() {
-                auto img = generateRandomImage(_randWidth, _randHeight);
-                _loadedImage = std::move(img);
-                _imageReady = true;
-            });
+            _loadProgress.reset();
+            _randSeed = std::random_device{}();
+            _imageThread = std::jthread(
+                [this, w = _randWidth, h = _randHeight, seed = _randSeed]() {
+                    _loadedImage.reset();
+                    _loadedPreview = randomPreview(w, h, seed);
+                    _imageReady = true;
+                });
             _loadingImage = true;
         }
 
         if (_loadingImage) {
-            drawProgressBar();
+            drawProgressBar(_loadProgress);
         }
     } else if (_imageSource == ImageSource::Loaded) {
         // open file, load img
         if (ImGui::Button("Load Image")) {
             _imageDialog = std::make_unique<pfd::open_file>(
                 "Open Image", ".",
-                std::vector<std::string>{"Image Files", "*.png *.jpg"});
+                std::vector<std::string>{"Image Files", IMAGE_PATTERNS});
         }
 
         if (_loadingImage) {
-            drawProgressBar();
+            drawProgressBar(_loadProgress);
         }
+    } else if (_imageSource == ImageSource::Frames) {
+        if (ImGui::Button("Load GIF")) {
+            _imageDialog = std::make_unique<pfd::open_file>(
+                "Open Animated GIF", ".",
+                std::vector<std::string>{"GIF Files", "*.gif"});
+        }
+
+        if (_loadingImage) {
+            drawProgressBar(_loadProgress);
+        } else if (!_imageFrames.empty()) {
+            ImGui::SameLine();
+            ImGui::Text("%zu frames", _imageFrames.size());
+        }
+        ImGui::Checkbox("Palette Per Frame", &_palettePerFrame);
+    } else if (board) {
+        drawMoodBoardSelectors();
     }
 }
-// Small animated progress bar used while images load in a thread.
-void GenSettingsTab::drawProgressBar() {
+
+// Buttons for adding and clearing mood board images, then a weight and a
+// remove button per image.
+void GenSettingsTab::drawMoodBoardSelectors() {
+    if (ImGui::Button("Add Images")) {
+        _boardDialog = std::make_unique<pfd::open_file>(
+            "Add Mood Board Images", ".",
+            std::vector<std::string>{
+                "Image Files", std::string(IMAGE_PATTERNS) + " *.gif"},
+            pfd::opt::multiselect);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Clear Board")) {
+        _moodBoard.clear();
+        _boardImages.clear();
+    }
+    if (_loadingBoard)
+        drawProgressBar(_boardProgress);
+
+    for (std::size_t i = 0; i < _boardImages.size();) {
+        auto &img = _boardImages[i];
+        ImGui::PushID(static_cast<int>(i));
+        ImGui::SetNextItemWidth(ImGui::CalcTextSize("10.00").x * 5.0f);
+        if (ImGui::DragFloat("##weight", &img.weight, 0.01f, 0.01f, 10.0f,
+                             "%.2f"))
+            _moodBoard.setWeight(img.fingerprint, img.weight);
+        ImGui::SameLine();
+        bool removed = ImGui::SmallButton("Remove");
+        ImGui::SameLine();
+        ImGui::TextUnformatted(img.name.c_str());
+        ImGui::PopID();
+        if (removed) {
+            _moodBoard.remove(img.fingerprint);
+            _boardImages.erase(_boardImages.begin() +
+                               static_cast<std::ptrdiff_t>(i));
+        } else {
+            ++i;
+        }
+    }
+}
+
+// Poll the mood board dialog and bin the chosen files on a background
+// thread, then merge their histograms into the board once ready. Only the
+// new images are read; the rest of the board is left as it is.
+void GenSettingsTab::loadBoardImages() {
+    if (_boardDialog && _boardDialog->ready() && !_loadingBoard) {
+        auto paths = _boardDialog->result();
+        _boardDialog.reset();
+        if (!paths.empty()) {
+            const std::size_t budget = _generator->kMeansPixelBudget();
+            _boardProgress.reset();
+            _boardProgress.total = paths.size();
+            _boardThread = std::jthread([this, paths, budget]() {
+                std::vector<std::pair<std::string, ColourHistogram>> loaded(
+                    paths.size());
+                ThreadPool::shared().parallelFor(
+                    paths.size(), [&](std::size_t i) {
+                        loaded[i] = {
+                            std::filesystem::path(paths[i])
+                                .filename()
+                                .string(),
+                            histogramOf(loadSharedImage(paths[i]), budget)};
+                        ++_boardProgress.done;
+                    });
+                _loadedHistograms = std::move(loaded);
+                _boardReady = true;
+            });
+            _loadingBoard = true;
+        }
+    }
+
+    if (_boardReady) {
+        if (_boardThread.joinable())
+            _boardThread.join();
+        for (auto &[name, hist] : _loadedHistograms) {
+            const std::uint64_t fingerprint = hist.fingerprint;
+            if (!_moodBoard.add(std::move(hist)))
+                continue;
+            std::erase_if(_boardImages, [fingerprint](const BoardImage &b) {
+                return b.fingerprint == fingerprint;
+            });
+            _boardImages.push_back({std::move(name), fingerprint, 1.0f});
+        }
+        _loadedHistograms.clear();
+        _boardReady = false;
+        _loadingBoard = false;
+    }
+}
+// Options for previewing the k-means image reduced to a palette.
+void GenSettingsTab::drawRecolourSelectors() {
+    ImGui::Checkbox("Recolour Preview", &_showRecolour);
+    if (!_showRecolour)
+        return;
+
+    const int palettes = static_cast<int>(_manager->_palettes.size());
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("100").x * 5.0f);
+    ImGui::DragInt("Preview Palette", &_recolourPalette, 0.1f, 0,
+                   std::max(palettes - 1, 0));
+
+    int dither = static_cast<int>(_dither);
+    ImGui::SetNextItemWidth(ImGui::CalcTextSize("Floyd-Steinberg").x +
+                            _margin + _arrow);
+    if (ImGui::BeginCombo("Dither",
+                          _ditherNames[std::size_t(dither)].c_str())) {
+        for (int i = 0; std::size_t(i) < _ditherNames.size(); ++i) {
+            bool sel = (i == dither);
+            if (ImGui::Selectable(_ditherNames[std::size_t(i)].c_str(), sel))
+                _dither = static_cast<Dither>(i);
+            if (sel)
+                ImGui::SetItemDefaultFocus();
+        }
+        ImGui::EndCombo();
+    }
+}
+
+// Upload a finished recolour preview and start a new one when the palette,
+// dithering or image no longer match the last. Only one recolour runs at a
+// time; edits made meanwhile are picked up once it finishes.
+void GenSettingsTab::updateRecolour() {
+    if (_recolourReady) {
+        if (_recolourThread.joinable())
+            _recolourThread.join();
+        if (_recolourTexture) {
+            glDeleteTextures(1, &_recolourTexture);
+            _recolourTexture = 0;
+        }
+        _recolourTexture = createTexture(_recoloured);
+        _recoloured = {};
+        _recolourReady = false;
+        _recolouring = false;
+    }
+    if (!_showRecolour || _recolouring || _preview.empty() ||
+        _recolourPalette < 0 ||
+        static_cast<std::size_t>(_recolourPalette) >=
+            _manager->_palettes.size())
+        return;
+
+    std::vector<LAB> palette;
+    std::vector<float> values;
+    for (const auto &sw :
+         _manager->_palettes[std::size_t(_recolourPalette)]._swatches) {
+        palette.push_back(Colour::fromImVec4(sw._colour).lab);
+        values.insert(values.end(), {sw._colour.x, sw._colour.y,
+                                     sw._colour.z});
+    }
+    std::uint64_t key = hashBytes(
+        {reinterpret_cast<const unsigned char *>(values.data()),
+         values.size() * sizeof(float)},
+        _preview.fingerprint ^ static_cast<std::uint64_t>(_dither));
+    if (key == _recolourKey)
+        return;
+    _recolourKey = key;
+    _recolouring = true;
+    _recolourThread = std::jthread(
+        [this, preview = _preview, palette = std::move(palette),
+         dither = _dither](std::stop_token stop) {
+            _recoloured = recolourImage(preview, palette, dither, stop);
+            _recolourReady = true;
+        });
+}
+
+// Progress bar used while images load in a thread. Shows the fraction of
+// `progress` finished once it is known and animates until then.
+void GenSettingsTab::drawProgressBar(const LoadProgress &progress) {
     // display progress
     ImGui::SameLine();
+    float done = progress.fraction();
+    if (done >= 0.0f) {
+        ImGui::ProgressBar(done, ImVec2(100, 0), "");
+        return;
+    }
     static float phase = 0.0f;
     phase += ImGui::GetIO().DeltaTime;
     if (phase < 1.0f) {
@@ -3,9 +3,12 @@
 
 #include "../Colour.h"
 #include "../ImageUtils.h"
+#include "../MoodBoard.h"
 #include "../PaletteGenerator.h"
+#include "../Recolour.h"
 #include "Tab.h"
 #include "imgui/imgui.h"
+#include <random>
 #include <thread>
 #include "../compiler_warnings.h"
 UC_SUPPRESS_WARNINGS_BEGIN
@@ -19,25 +22,69 @@ class GenSettingsTab : public Tab {
 
     int _randWidth{64};
     int _randHeight{64};
+    // Seed of the random k-means samples, redrawn by "Generate Image".
+    std::uint64_t _randSeed{std::random_device{}()};
     enum GenerationMode { PerPalette, AllPalettes };
     GenerationMode _genMode{GenerationMode::AllPalettes};
 
-    enum ImageSource { None, Loaded, Random };
+    enum ImageSource { None, Loaded, Random, Frames, Board };
     ImageSource _imageSource{ImageSource::None};
-    ImageData _imageData; //< Image used for k-means and preview
+    SharedImage _imageData; //< Image used for k-means and preview
+    // Frames of a loaded GIF, with _imageData holding the first. Each
+    // palette is generated from its own frame when _palettePerFrame is set
+    // and from the pooled colours of every frame otherwise.
+    std::vector<SharedImage> _imageFrames;
+    std::shared_ptr<const WeightedColours> _frameColours;
+    bool _palettePerFrame{false};
+    MoodBoard _moodBoard; //< Reference images merged for k-means
   private:
-    static inline const std::array<std::string, 4> _algNames = {
-        "Random Offset", "K-Means++", "Gradient", "Learned"};
-    static inline const std::array<std::string, 3> _kmeansSrc = {
-        "None", "Image", "Random"};
+    static inline const std::array<std::string, 5> _algNames = {
+        "Random Offset", "K-Means++", "Gradient", "Learned", "Distinct"};
+    static inline const std::array<std::string, 5> _kmeansSrc = {
+        "None", "Image", "Random", "GIF Frames", "Mood Board"};
     static inline const std::array<std::string, 2> _modeNames = {
         "Per Palette", "All Palettes"};
+    static inline const std::array<std::string, 3> _ditherNames = {
+        "None", "Floyd-Steinberg", "Blue Noise"};
 
     unsigned int _imageTexture{0};
     std::jthread _imageThread;
     std::atomic<bool> _loadingImage{false};
     std::atomic<bool> _imageReady{false};
-    ImageData _loadedImage; //< Temporary store from loader thread
+    SharedImage _loadedImage; //< Temporary store from loader thread
+    std::vector<SharedImage> _loadedFrames; //< GIF frames, likewise
+    std::shared_ptr<const WeightedColours> _loadedFrameColours;
+    ImageData _loadedPreview; //< Thumbnail of it made by the loader thread
+    LoadProgress _loadProgress; //< Pixels converted by the loader thread
+    ImageData _preview;       //< Thumbnail of _imageData shown in the tab
+
+    // Preview of the image reduced to one of the palettes, recoloured on a
+    // background thread whenever the palette, dithering or image changes.
+    bool _showRecolour{false};
+    int _recolourPalette{0};
+    Dither _dither{Dither::None};
+    unsigned int _recolourTexture{0};
+    std::atomic<bool> _recolourReady{false};
+    bool _recolouring{false};
+    ImageData _recoloured;         //< Result from the recolour thread
+    std::uint64_t _recolourKey{0}; //< Inputs of the current preview
+
+    // Mood board images as listed in the tab. Their histograms are built on
+    // a background thread and merged into _moodBoard once ready.
+    struct BoardImage {
+        std::string name;
+        std::uint64_t fingerprint;
+        float weight;
+    };
+    std::vector<BoardImage> _boardImages;
+    std::unique_ptr<pfd::open_file> _boardDialog;
+    std::atomic<bool> _boardReady{false};
+    bool _loadingBoard{false};
+    LoadProgress _boardProgress; //< Files binned by the board thread
+    std::vector<std::pair<std::string, ColourHistogram>> _loadedHistograms;
+    std::jthread _boardThread;
+
+    std::jthread _recolourThread;  //< Declared last, joined first
 
     PaletteGenerator *_generator;
     PaletteGenerator::Algorithm _algo;
@@ -47,10 +94,16 @@ class GenSettingsTab : public Tab {
     void drawGenModeSelector();
     void drawAlgorithmSelector();
     void drawKMeansSelectors();
+    void drawDistinctSelectors();
+    void drawLearnedSelectors();
     void drawKMeansImageSelectors();
-    void drawProgressBar();
+    void drawMoodBoardSelectors();
+    void drawProgressBar(const LoadProgress &progress);
+    void drawRecolourSelectors();
+    void updateRecolour();
     void loadImage();
     void loadRandomImage();
+    void loadBoardImages();
     static unsigned int createTexture(const ImageData &img);
     std::unique_ptr<pfd::open_file> _imageDialog;
 };
@@ -5,12 +5,14 @@
 #include "Gui/GenSettingsTab.h"
 #include "Logger.h"
 #include "PaletteGenerator.h"
+#include "Random.h"
 #include "imgui.h"
 #include "imgui/misc/cpp/imgui_stdlib.h"
 
 #include "../Gui.h"
 
 #include <GL/gl.h>
+#include <atomic>
 #include <format>
 
 namespace uc {
@@ -21,23 +23,25 @@ PaletteGenTab::PaletteGenTab(GuiManager *manager, PaletteGenerator *generator,
 
 // Draw palette controls and start/stop generation buttons.
 void PaletteGenTab::drawContent() {
-    if (_genReady) {
-        std::lock_guard<std::mutex> lock(_genMutex);
-        if (!_genResult.empty()) {
-            _manager->_palettes = std::move(_genResult);
-            _genResult.clear();
-        }
-        _genReady = false;
-    }
-    ImGui::BeginDisabled(_genRunning);
+    // Only swatches that still exist and are still unlocked take the new
+    // colours, so edits made while the job ran are kept.
+    std::vector<GeneratedColour> generated;
+    if (_pipeline.poll(generated))
+        applyGenerated(_manager->_palettes, generated);
+
+    // Starting again while a job runs supersedes it.
     if (ImGui::Button("Start Generation")) {
         generate();
     }
-    ImGui::EndDisabled();
 
-    if (_genRunning) {
+    if (_pipeline.busy()) {
         ImGui::SameLine();
-        ImGui::TextUnformatted("Generating...");
+        if (ImGui::Button("Cancel")) {
+            _pipeline.cancel();
+        }
+        ImGui::SameLine();
+        ImGui::ProgressBar(_pipeline.progress(), ImVec2(-FLT_MIN, 0),
+                           "Generating...");
     }
 
     drawPalettes();
@@ -95,6 +99,15 @@ void PaletteGenTab::drawPalettes() {
                     _pendingPaletteDeletes.push_back(idx);
                 }
             }
+            // Marking a palette as good teaches the model immediately.
+            // ingestNew() skips palettes it has learned before, so ticking
+            // the same palette again does not count it twice.
+            if (ImGui::Checkbox("Good", &p._good) && p._good) {
+                auto learned =
+                    _generator->model().ingestNew(std::span(&p, 1));
+                _manager->_learned.insert(_manager->_learned.end(),
+                                          learned.begin(), learned.end());
+            }
             drawPalette(p, idx);
             ImGui::PopID();
             ++idx;
@@ -301,39 +314,86 @@ void PaletteGenTab::drawSwatch(Swatch &sw, int pal_idx, int sw_idx) {
     ImGui::PopID();
 }
 
-// Perform palette generation either synchronously or in a background thread.
+// Queue palette generation on the background pipeline. The job works on a
+// copy of the generator reseeded from the UI's stream, so the UI-owned
+// generator is never touched from the worker thread. It reads a snapshot of
+// the palettes and returns only the colours of their unlocked swatches.
 void PaletteGenTab::generate() {
-
-    // startGeneration in Gui.cpp
-    if (_genRunning)
-        return;
-
-    _generator->clearKMeansImage();
-
-    auto generator = _generator; // copy for thread safety and RNG advance
-    auto palettes = _manager->_palettes;
+    // Index newly learned palettes once here rather than in every copy.
+    _generator->model().updateIndex();
+    PaletteGenerator generator = *_generator;
+    generator.reseed(_generator->drawSeed());
     auto mode = _settings->_genMode;
     auto imgSource = _settings->_imageSource;
-    auto imgData = _settings->_imageData;
+    auto imgData = _settings->_imageData; // shared handle, pixels not copied
+    auto frames = _settings->_imageFrames;
+    // Mood boards and whole GIFs are clustered from merged histograms.
+    std::shared_ptr<const WeightedColours> colours;
+    if (imgSource == GenSettingsTab::ImageSource::Board)
+        colours = _settings->_moodBoard.colours();
+    else if (imgSource == GenSettingsTab::ImageSource::Frames)
+        colours = _settings->_frameColours;
+    const bool byFrame =
+        generator.algorithm() == PaletteGenerator::Algorithm::KMeans &&
+        imgSource == GenSettingsTab::ImageSource::Frames &&
+        _settings->_palettePerFrame && !frames.empty();
+    // Each frame gets its own palette, so add palettes shaped like the last
+    // one until there is one per frame.
+    if (byFrame) {
+        auto &pals = _manager->_palettes;
+        Palette shape = pals.empty() ? Palette{} : pals.back();
+        shape._good = false;
+        for (auto &sw : shape._swatches)
+            sw._locked = false;
+        while (pals.size() < frames.size()) {
+            shape._name = std::format("frame {}", pals.size() + 1);
+            pals.push_back(shape);
+        }
+    }
+    auto palettes = _manager->_palettes;
     int rW = _settings->_randWidth;
     int rH = _settings->_randHeight;
-
-    auto work = [generator, palettes, mode, imgSource, imgData, rW,
-                 rH]() mutable {
-        if (generator->algorithm() == PaletteGenerator::Algorithm::KMeans) {
-            if ((imgSource == GenSettingsTab::ImageSource::Loaded ||
-                 imgSource == GenSettingsTab::ImageSource::Random) &&
-                !imgData.colours.empty()) {
-                generator->setKMeansImage(imgData.colours);
+    std::uint64_t rSeed = _settings->_randSeed;
+
+    auto work = [generator, palettes, mode, imgSource, imgData, frames,
+                 byFrame, colours, rW, rH,
+                 rSeed](std::stop_token stop, JobProgress &progress) mutable
+        -> std::vector<GeneratedColour> {
+        std::vector<GeneratedColour> result;
+        if (generator.algorithm() == PaletteGenerator::Algorithm::KMeans &&
+            !byFrame) {
+            if (colours) {
+                generator.setKMeansColours(colours);
             } else if (imgSource == GenSettingsTab::ImageSource::Random) {
-                generator->setKMeansRandomImage(rW, rH);
+                generator.setKMeansRandomImage(rW, rH, rSeed);
+            } else if (imgSource != GenSettingsTab::ImageSource::None &&
+                       imgData && !imgData->empty()) {
+                generator.setKMeansImage(imgData);
             } else {
-                generator->clearKMeansImage();
+                generator.clearKMeansImage();
             }
         }
 
-        if (mode == GenSettingsTab::GenerationMode::PerPalette) {
-            for (auto &p : palettes) {
+        if (mode == GenSettingsTab::GenerationMode::PerPalette || byFrame) {
+            // Palettes are independent, so each is generated on the shared
+            // pool by its own copy of the generator; the copies share one
+            // learned model rather than duplicating it. Seeding every copy
+            // from the master seed and the palette index, and giving each
+            // its own k-means warm-start slot, keeps results reproducible
+            // regardless of which thread picks up which palette. With a
+            // palette per frame, palette i clusters frame i and palettes
+            // past the last frame are left alone.
+            const std::uint64_t master = generator.drawSeed();
+            const std::size_t count =
+                byFrame ? frames.size() : palettes.size();
+            std::atomic<std::size_t> done{0};
+            std::vector<std::vector<GeneratedColour>> perPalette(count);
+            auto &pool = ThreadPool::shared();
+            pool.parallelFor(count, [&](std::size_t pal_idx) {
+                if (stop.stop_requested())
+                    return;
+                const auto &p = palettes[pal_idx];
+
                 std::vector<Swatch> locked;
                 std::vector<std::size_t> unlocked_indices;
 
@@ -345,63 +405,60 @@ void PaletteGenTab::generate() {
                     }
                 }
 
-                if (unlocked_indices.empty()) {
-                    continue;
+                if (!unlocked_indices.empty()) {
+                    PaletteGenerator local = generator;
+                    local.reseed(deriveSeed(master, pal_idx));
+                    local.setKMeansSlot(pal_idx + 1);
+                    if (byFrame)
+                        local.setKMeansImage(frames[pal_idx]);
+                    auto generated =
+                        local.generate(locked, unlocked_indices.size(), stop);
+
+                    for (std::size_t i = 0;
+                         i < unlocked_indices.size() && i < generated.size();
+                         ++i)
+                        perPalette[pal_idx].push_back(
+                            {pal_idx, unlocked_indices[i],
+                             generated[i]._colour});
                 }
-                auto generated =
-                    generator->generate(locked, unlocked_indices.size());
-
-                for (std::size_t i = 0; i < unlocked_indices.size(); ++i) {
-                    auto idx = unlocked_indices[i];
-                    p._swatches[idx]._colour = generated[i]._colour;
-                    p._swatches[idx]._locked = false;
-                }
-            }
+                progress.set(static_cast<float>(++done) /
+                             static_cast<float>(count));
+            });
+            if (stop.stop_requested())
+                return {};
+            for (const auto &part : perPalette)
+                result.insert(result.end(), part.begin(), part.end());
         } else {
             std::vector<Swatch> locked;
-            std::vector<Swatch *> unlocked;
+            std::vector<GeneratedColour> unlocked;
 
-            for (auto &p : palettes) {
-                for (auto &sw : p._swatches) {
-                    if (sw._locked) {
-                        locked.push_back(sw);
+            for (std::size_t pi = 0; pi < palettes.size(); ++pi) {
+                const auto &swatches = palettes[pi]._swatches;
+                for (std::size_t si = 0; si < swatches.size(); ++si) {
+                    if (swatches[si]._locked) {
+                        locked.push_back(swatches[si]);
                     } else {
-                        unlocked.push_back(&sw);
+                        unlocked.push_back({pi, si, swatches[si]._colour});
                     }
                 }
             }
 
             if (!unlocked.empty()) {
-                auto generated = generator->generate(locked, unlocked.size());
-                for (std::size_t i = 0; i < unlocked.size(); ++i) {
-                    unlocked[i]->_colour = generated[i]._colour;
-                    unlocked[i]->_locked = false;
+                auto generated =
+                    generator.generate(locked, unlocked.size(), stop);
+                for (std::size_t i = 0;
+                     i < unlocked.size() && i < generated.size(); ++i) {
+                    unlocked[i].colour = generated[i]._colour;
+                    result.push_back(unlocked[i]);
                 }
             }
         }
 
-        return std::make_pair(palettes, generator);
+        progress.set(1.0f);
+        return result;
     };
 
-    bool slow = _generator->algorithm() == PaletteGenerator::Algorithm::KMeans;
-    if (slow) {
-        _genRunning = true;
-        _genReady = false;
-        _genThread = std::jthread([this, work]() mutable {
-            auto [result, gen] = work();
-            {
-                std::lock_guard<std::mutex> lock(_genMutex);
-                _genResult = std::move(result);
-            }
-            _generator = gen;
-            _genReady = true;
-            _genRunning = false;
-        });
-    } else {
-        auto [result, gen] = work();
-        _manager->_palettes = std::move(result);
-        _generator = gen;
-    }
+    _pipeline.submit(std::move(work));
 }
 
 } // namespace uc
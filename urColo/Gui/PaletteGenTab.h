@@ -2,12 +2,13 @@
 #pragma once
 
 #include "../Colour.h"
+#include "../GenerationPipeline.h"
 #include "../ImageUtils.h"
 #include "../PaletteGenerator.h"
+#include "../ThreadPool.h"
 #include "Gui/GenSettingsTab.h"
 #include "Tab.h"
 #include "imgui/imgui.h"
-#include <thread>
 #include "../compiler_warnings.h"
 UC_SUPPRESS_WARNINGS_BEGIN
 #include <portable-file-dialogs.h>
@@ -22,12 +23,7 @@ class PaletteGenTab : public Tab {
   private:
     PaletteGenerator *_generator;
     GenSettingsTab *_settings;
-    // Background generation state
-    std::jthread _genThread;
-    std::atomic<bool> _genRunning{false};
-    std::atomic<bool> _genReady{false};
-    std::mutex _genMutex;
-    std::vector<uc::Palette> _genResult;
+    GenerationPipeline _pipeline; //< Runs every generation off the UI thread
 
     struct DragPayload {
         int pal_idx;
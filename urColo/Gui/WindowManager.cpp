@@ -1,6 +1,9 @@
 // urColo - platform window integration
 #include "WindowManager.h"
+#include "../Gradient.h"
 #include "../Gui.h"
+#include "../ImageCache.h"
+#include "../Logger.h"
 #include "../Model.h"
 #include "../PaletteGenerator.h"
 #include <imgui.h>
@@ -24,6 +27,7 @@
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <print>
+#include <stdexcept>
 
 namespace {
 // Common ImGui state initialisation shared by all platforms.
@@ -114,6 +118,9 @@ void WindowManager::init(GuiManager *gui,
     init_imgui_glfw(wind, glsl_version);
 #endif
     applyStyle();
+    // Decoded reference images are cached in the working directory, next
+    // to palettes.json, so they reopen without decoding or converting.
+    setImageCache(std::make_shared<ImageCache>("image_cache"));
 
     if (_gui)
         _gui->init();
@@ -175,6 +182,15 @@ void WindowManager::render() {
             loadModel(paths[0]);
         }
     }
+    if (_corpusDialog && _corpusDialog->ready()) {
+        auto paths = _corpusDialog->result();
+        _corpusDialog.reset();
+        if (!paths.empty()) {
+            trainModel(paths[0]);
+        }
+    }
+    keepLearnedPalettes();
+    collectTrainedModel();
     if (_paletteSaveDialog && _paletteSaveDialog->ready()) {
         auto path = _paletteSaveDialog->result();
         _paletteSaveDialog.reset();
@@ -198,6 +214,17 @@ void WindowManager::render() {
             _savePopup = true;
         }
     }
+    if (_colormapSaveDialog && _colormapSaveDialog->ready()) {
+        auto path = _colormapSaveDialog->result();
+        _colormapSaveDialog.reset();
+        if (!path.empty()) {
+            auto map = Gradient(_colormapAnchors).colormap(_colormapSize);
+            if (saveColormapCSV(map, path)) {
+                _lastSavePath = path;
+                _savePopup = true;
+            }
+        }
+    }
     if (ImGui::BeginMainMenuBar()) {
         if (ImGui::BeginMenu("File")) {
             if (ImGui::MenuItem("Save to JSON")) {
@@ -220,6 +247,14 @@ void WindowManager::render() {
                     "Open Model", ".",
                     std::vector<std::string>{"JSON Files", "*.json"});
             }
+            if (ImGui::MenuItem("Train Model from File", nullptr, false,
+                                !_training)) {
+                _corpusDialog = std::make_unique<pfd::open_file>(
+                    "Open Palette Corpus", ".",
+                    std::vector<std::string>{"Palette Files",
+                                             "*.json *.jsonl"});
+            }
+            drawColormapMenu();
             if (ImGui::MenuItem("Quit")) {
 #ifdef _WIN32
                 // Windows message loop quit request.
@@ -350,22 +385,62 @@ void WindowManager::GLFWErrorCallback(int error, const char *desc) {
 }
 #endif
 
-// Train the model on palettes marked as good and write to disk.
+// Collect the palettes the live model learned this frame. While a corpus
+// is being trained on they are kept, to be replayed onto the trained model
+// before it replaces this one.
+void WindowManager::keepLearnedPalettes() {
+    if (!_gui)
+        return;
+    if (_training || _trainReady)
+        _learnedWhileTraining.insert(_learnedWhileTraining.end(),
+                                     _gui->_learned.begin(),
+                                     _gui->_learned.end());
+    _gui->_learned.clear();
+}
+
+// Write the model to disk. Palettes marked as good were ingested when they
+// were marked.
 void WindowManager::saveModel(const std::filesystem::path &path) {
     if (!_gui)
         return;
-    std::vector<Palette> good;
-    for (const auto &p : _gui->_palettes) {
-        if (p._good)
-            good.push_back(p);
-    }
-    _gui->_generator->model().train(good);
     nlohmann::json j = _gui->_generator->model();
     std::ofstream out{path};
     if (out.is_open())
         out << j.dump(4);
 }
 
+// List palettes and table sizes for colormap export. Each palette's swatches
+// become the gradient anchors in the order they are shown.
+void WindowManager::drawColormapMenu() {
+    if (!_gui || _gui->_palettes.empty())
+        return;
+    if (!ImGui::BeginMenu("Export Colormap"))
+        return;
+    for (std::size_t i = 0; i < _gui->_palettes.size(); ++i) {
+        const auto &pal = _gui->_palettes[i];
+        ImGui::PushID(static_cast<int>(i));
+        if (ImGui::BeginMenu(pal._name.c_str(), pal._swatches.size() >= 2)) {
+            for (std::size_t size = Gradient::kMinColormapSize;
+                 size <= Gradient::kMaxColormapSize; size *= 4) {
+                auto label = std::format("{} entries", size);
+                if (ImGui::MenuItem(label.c_str())) {
+                    _colormapAnchors.clear();
+                    for (const auto &sw : pal._swatches)
+                        _colormapAnchors.push_back(
+                            Colour::fromImVec4(sw._colour).lab);
+                    _colormapSize = size;
+                    _colormapSaveDialog = std::make_unique<pfd::save_file>(
+                        "Export Colormap", pal._name + ".csv",
+                        std::vector<std::string>{"CSV Files", "*.csv"});
+                }
+            }
+            ImGui::EndMenu();
+        }
+        ImGui::PopID();
+    }
+    ImGui::EndMenu();
+}
+
 // Load a previously saved model from disk.
 void WindowManager::loadModel(const std::filesystem::path &path) {
     if (!_gui)
@@ -378,4 +453,45 @@ void WindowManager::loadModel(const std::filesystem::path &path) {
     Model m = j.get<Model>();
     _gui->_generator->model() = std::move(m);
 }
+
+// Ingest a JSON or JSON Lines palette corpus into a copy of the model on a
+// background thread.
+void WindowManager::trainModel(const std::filesystem::path &path) {
+    if (!_gui || _training)
+        return;
+    if (_trainThread.joinable())
+        _trainThread.join();
+    _trainedModel = _gui->_generator->model();
+    _learnedWhileTraining.clear();
+    _training = true;
+    _trainThread = std::jthread([this, path]() {
+        std::ifstream in{path};
+        try {
+            if (!in.is_open())
+                throw std::runtime_error("cannot open file");
+            auto count = _trainedModel.ingestStream(in);
+            Logger::log(Logger::Level::Ok, "Trained model on {} palettes",
+                        count);
+            _trainReady = true;
+        } catch (const std::exception &e) {
+            Logger::log(Logger::Level::Error,
+                        "Training from {} failed: {}", path.string(),
+                        e.what());
+        }
+        _training = false;
+    });
+}
+
+// Swap in the model trained on a corpus once the thread has finished,
+// after replaying the good palettes the live model learned meanwhile.
+void WindowManager::collectTrainedModel() {
+    if (!_trainReady)
+        return;
+    if (_trainThread.joinable())
+        _trainThread.join();
+    _trainedModel.ingestNew(_learnedWhileTraining);
+    _learnedWhileTraining.clear();
+    _trainReady = false;
+    _gui->_generator->model() = std::move(_trainedModel);
+}
 } // namespace uc
@@ -7,9 +7,14 @@
 // Other platforms use GLFW for window and input management.
 #include <GLFW/glfw3.h>
 #endif
+#include <atomic>
 #include <filesystem>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+#include "../Colour.h"
+#include "../Model.h"
 #include "../compiler_warnings.h"
 UC_SUPPRESS_WARNINGS_BEGIN
 #include <portable-file-dialogs.h> // third-party header
@@ -54,10 +59,28 @@ class WindowManager {
     std::unique_ptr<pfd::save_file> _paletteSaveDialog;
     std::unique_ptr<pfd::save_file> _modelSaveDialog;
     std::unique_ptr<pfd::open_file> _modelLoadDialog;
+    std::unique_ptr<pfd::open_file> _corpusDialog;
+    std::unique_ptr<pfd::save_file> _colormapSaveDialog;
+    // Anchors and size captured when a colormap export was requested, so
+    // edits made while the dialog is open do not change the result.
+    std::vector<LAB> _colormapAnchors;
+    std::size_t _colormapSize{256};
+    // Training on a palette corpus runs on a copy of the model so the UI
+    // keeps using the old one until the new one is ready.
+    std::jthread _trainThread;
+    std::atomic<bool> _training{false};
+    std::atomic<bool> _trainReady{false};
+    Model _trainedModel; //< Result from the training thread
+    // Good palettes learned while the thread ran, replayed onto its result.
+    std::vector<Palette> _learnedWhileTraining;
 
     void applyStyle();
+    void keepLearnedPalettes();
     void saveModel(const std::filesystem::path &path);
     void loadModel(const std::filesystem::path &path);
+    void trainModel(const std::filesystem::path &path);
+    void collectTrainedModel();
+    void drawColormapMenu();
 #ifndef _WIN32
     // GLFW reports errors through a callback when not using Win32.
     static void GLFWErrorCallback(int error, const char *desc);
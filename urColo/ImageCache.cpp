@@ -0,0 +1,188 @@
+// urColo - persistent cache of decoded images
+#include "ImageCache.h"
+#include "Logger.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+using namespace uc;
+
+// Tag and layout version at the start of every entry. Bump the version
+// whenever the layout changes so old entries are discarded, not misread.
+constexpr std::array<char, 4> MAGIC{'U', 'R', 'C', 'I'};
+constexpr std::uint32_t VERSION = 2;
+
+// Extension of entry files. Other files in the directory are left alone.
+constexpr const char *ENTRY_EXTENSION = ".urci";
+
+// Start of an entry. The RGBA bytes follow, then the L, a and b planes.
+struct Header {
+    std::array<char, 4> magic;
+    std::uint32_t version;
+    std::int32_t width;
+    std::int32_t height;
+    std::int32_t bitDepth; //< Bits per channel of the source image
+};
+
+// Size of the entry for an image of `pixels` pixels.
+std::uintmax_t entrySize(std::size_t pixels) {
+    return sizeof(Header) + pixels * (4 + 3 * sizeof(float));
+}
+
+// An entry file found in the cache directory.
+struct Entry {
+    fs::path path;
+    std::uintmax_t size;
+    fs::file_time_type used; //< Last write time, refreshed on every hit
+};
+
+std::vector<Entry> listEntries(const fs::path &dir) {
+    std::vector<Entry> entries;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end;
+         it.increment(ec)) {
+        if (it->path().extension() != ENTRY_EXTENSION)
+            continue;
+        std::error_code fe;
+        auto size = it->file_size(fe);
+        auto used = fe ? fs::file_time_type{} : it->last_write_time(fe);
+        if (!fe)
+            entries.push_back({it->path(), size, used});
+    }
+    return entries;
+}
+
+std::mutex currentMutex;
+std::shared_ptr<ImageCache> current; //< Cache used by loadSharedImage
+} // namespace
+
+namespace uc {
+
+ImageCache::ImageCache(fs::path dir, std::uintmax_t maxBytes)
+    : _dir(std::move(dir)), _maxBytes(maxBytes) {}
+
+fs::path ImageCache::entryPath(std::uint64_t key) const {
+    return _dir / std::format("{:016x}{}", key, ENTRY_EXTENSION);
+}
+
+SharedImage ImageCache::load(std::uint64_t key) const {
+    const fs::path path = entryPath(key);
+    std::lock_guard lock(_mutex);
+    MappedFile file(path.string());
+    if (!file)
+        return nullptr;
+
+    Header h{};
+    bool valid = file.size() >= sizeof(Header);
+    if (valid) {
+        std::memcpy(&h, file.data(), sizeof(h));
+        valid = h.magic == MAGIC && h.version == VERSION && h.width > 0 &&
+                h.height > 0 &&
+                file.size() == entrySize(static_cast<std::size_t>(h.width) *
+                                         static_cast<std::size_t>(h.height));
+    }
+    std::error_code ec;
+    if (!valid) {
+        file = MappedFile{}; // Windows cannot delete a mapped file
+        fs::remove(path, ec);
+        return nullptr;
+    }
+
+    const std::size_t n = static_cast<std::size_t>(h.width) *
+                          static_cast<std::size_t>(h.height);
+    const unsigned char *p = file.data() + sizeof(Header);
+    std::vector<unsigned char> rgba(p, p + n * 4);
+    p += n * 4;
+    LabPlanes planes;
+    for (auto *plane : {&planes.L, &planes.a, &planes.b}) {
+        plane->resize(n);
+        std::memcpy(plane->data(), p, n * sizeof(float));
+        p += n * sizeof(float);
+    }
+    file = MappedFile{};
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return std::make_shared<const ImageData>(ImageData::fromPlanes(
+        h.width, h.height, std::move(rgba), std::move(planes), h.bitDepth));
+}
+
+// Entries are written to a temporary file and renamed into place, so a
+// reader never sees a partly written entry.
+void ImageCache::store(std::uint64_t key, const ImageData &img) {
+    const std::size_t n = img.pixelCount();
+    if (n == 0 || entrySize(n) > _maxBytes)
+        return;
+    auto planes = img.lab();
+    const Header h{MAGIC, VERSION, img.width, img.height, img.bitDepth};
+    const fs::path path = entryPath(key);
+    fs::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::lock_guard lock(_mutex);
+        std::error_code ec;
+        fs::create_directories(_dir, ec);
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        auto write = [&out](const void *data, std::size_t bytes) {
+            out.write(static_cast<const char *>(data),
+                      static_cast<std::streamsize>(bytes));
+        };
+        write(&h, sizeof(h));
+        write(img.rgba.data(), img.rgba.size());
+        for (const auto *plane : {&planes->L, &planes->a, &planes->b})
+            write(plane->data(), n * sizeof(float));
+        out.close();
+        if (out)
+            fs::rename(tmp, path, ec);
+        if (!out || ec) {
+            Logger::log(Logger::Level::Warn,
+                        "Could not write image cache entry {}",
+                        path.string());
+            fs::remove(tmp, ec);
+            return;
+        }
+    }
+    evict();
+}
+
+void ImageCache::evict() {
+    std::lock_guard lock(_mutex);
+    auto entries = listEntries(_dir);
+    std::uintmax_t total = 0;
+    for (const auto &e : entries)
+        total += e.size;
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) { return a.used < b.used; });
+    for (const auto &e : entries) {
+        if (total <= _maxBytes)
+            break;
+        std::error_code ec;
+        if (fs::remove(e.path, ec))
+            total -= e.size;
+    }
+}
+
+std::uintmax_t ImageCache::sizeOnDisk() const {
+    std::lock_guard lock(_mutex);
+    std::uintmax_t total = 0;
+    for (const auto &e : listEntries(_dir))
+        total += e.size;
+    return total;
+}
+
+void setImageCache(std::shared_ptr<ImageCache> cache) {
+    std::lock_guard lock(currentMutex);
+    current = std::move(cache);
+}
+
+std::shared_ptr<ImageCache> imageCache() {
+    std::lock_guard lock(currentMutex);
+    return current;
+}
+
+} // namespace uc
@@ -0,0 +1,65 @@
+// urColo - persistent cache of decoded images
+#pragma once
+#include "ImageUtils.h"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+namespace uc {
+// A directory of decoded images keyed by a hash of the source file bytes.
+// Each entry holds the RGBA pixels and OKLab planes of one image in a
+// compact binary file, so reopening an image skips both decoding and
+// conversion. Entries are stamped on every hit and the least recently used
+// are removed once the directory grows past its size limit.
+//
+// Entries use the machine's byte order and are only meant to be read back
+// on the machine that wrote them.
+class ImageCache {
+  public:
+    // Default limit on the total size of the cache directory.
+    static constexpr std::uintmax_t kDefaultMaxBytes = std::uintmax_t{1}
+                                                       << 30;
+
+    // Use `dir`, created on first store, holding at most `maxBytes`.
+    explicit ImageCache(std::filesystem::path dir,
+                        std::uintmax_t maxBytes = kDefaultMaxBytes);
+
+    [[nodiscard]] const std::filesystem::path &directory() const {
+        return _dir;
+    }
+    [[nodiscard]] std::uintmax_t maxBytes() const { return _maxBytes; }
+
+    // Read the entry stored under `key`.
+    //
+    // \return The image, or null when there is no valid entry. Entries that
+    //         fail validation are removed.
+    [[nodiscard]] SharedImage load(std::uint64_t key) const;
+
+    // Write `img` under `key`, replacing any older entry, then evict.
+    // Images too large to ever fit are skipped. Write failures are logged
+    // and otherwise ignored, since the cache is only an optimisation.
+    void store(std::uint64_t key, const ImageData &img);
+
+    // Remove least recently used entries until the directory fits within
+    // maxBytes().
+    void evict();
+
+    // Combined size of all entries in bytes.
+    [[nodiscard]] std::uintmax_t sizeOnDisk() const;
+
+  private:
+    [[nodiscard]] std::filesystem::path entryPath(std::uint64_t key) const;
+
+    std::filesystem::path _dir;
+    std::uintmax_t _maxBytes;
+    mutable std::mutex _mutex; //< Serialises directory changes
+};
+
+// Set the cache loadSharedImage consults before decoding a file. Null, the
+// default, disables it.
+void setImageCache(std::shared_ptr<ImageCache> cache);
+
+// Cache currently used by loadSharedImage, if any.
+std::shared_ptr<ImageCache> imageCache();
+} // namespace uc
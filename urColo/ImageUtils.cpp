@@ -1,255 +1,760 @@
 // urColo - image loading helpers
 #include "ImageUtils.h"
+#include "ImageCache.h"
+#include "MappedFile.h"
+#include "Superpixels.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 #include <random>
+#include <unordered_map>
 #include <stb_image.h>
 
-namespace uc {
+namespace {
+using namespace uc;
 
-// Load an image file and convert it to ImageData.
-ImageData loadImageData(const std::string &path) {
-    ImageData img;
-    int comp = 0;
-    unsigned char *data =
-        stbi_load(path.c_str(), &img.width, &img.height, &comp, 4);
-    if (!data)
-        return img;
+// Default limit on cached OKLab planes. At 12 bytes per pixel this keeps a
+// few 4K images converted while an 8K image is converted per use instead of
+// pinning most of a gigabyte.
+constexpr std::size_t DEFAULT_LAB_BUDGET = std::size_t{512} << 20;
 
-    std::size_t pixels = static_cast<std::size_t>(img.width) * img.height;
-    img.rgba.assign(data, data + pixels * 4);
-    img.colours.reserve(pixels);
-    for (std::size_t i = 0; i < pixels; ++i) {
-        unsigned char *p = data + i * 4;
-        img.colours.push_back(Colour::fromSRGB(
-            p[0], p[1], p[2], static_cast<double>(p[3]) / 255.0));
-    }
-    stbi_image_free(data);
-    return img;
+std::atomic<std::size_t> labBudget{DEFAULT_LAB_BUDGET};
+std::atomic<std::size_t> labCached{0};
+
+// Claim `bytes` of the cache budget, failing when it would be exceeded.
+bool reserveLabBytes(std::size_t bytes) {
+    std::size_t used = labCached.load();
+    do {
+        if (used + bytes > labBudget.load())
+            return false;
+    } while (!labCached.compare_exchange_weak(used, used + bytes));
+    return true;
 }
 
-// Create a width x height image filled with random colours.
-ImageData generateRandomImage(int width, int height) {
-    ImageData img;
-    if (width <= 0 || height <= 0)
-        return img;
+// A decoded image file that may still be in use. Only a weak reference is
+// kept, so the cache never holds pixels nobody else needs; size and
+// modification time detect files changed since they were decoded.
+struct DecodedFile {
+    std::uintmax_t size{0};
+    std::filesystem::file_time_type modified{};
+    std::weak_ptr<const ImageData> image;
+};
 
-    img.width = width;
-    img.height = height;
-    std::size_t pixels = static_cast<std::size_t>(width) * height;
-    img.rgba.resize(pixels * 4);
-    img.colours.reserve(pixels);
-    std::mt19937_64 rng{std::random_device{}()};
-    std::uniform_int_distribution<int> dist(0, 255);
-    for (std::size_t i = 0; i < pixels; ++i) {
-        unsigned char r = static_cast<unsigned char>(dist(rng));
-        unsigned char g = static_cast<unsigned char>(dist(rng));
-        unsigned char b = static_cast<unsigned char>(dist(rng));
-        img.rgba[i * 4 + 0] = r;
-        img.rgba[i * 4 + 1] = g;
-        img.rgba[i * 4 + 2] = b;
-        img.rgba[i * 4 + 3] = 255;
-        img.colours.push_back(Colour::fromSRGB(r, g, b));
+std::mutex decodedMutex;
+std::unordered_map<std::string, DecodedFile> decoded; //< By canonical path
+
+// Pixels per task when copying and converting images. Large enough to
+// amortise scheduling, small enough that a tile's bytes are still in cache
+// when they are converted and that progress advances smoothly.
+constexpr std::size_t TILE_PIXELS = std::size_t{1} << 16;
+
+// Signature at the start of every GIF file, either version.
+constexpr std::array<unsigned char, 4> GIF_MAGIC{'G', 'I', 'F', '8'};
+
+// Frees planes and returns their bytes to the cache budget. The charge is
+// released when the planes are freed, not when the image is, since callers
+// may still be reading them.
+struct ReleaseLabBytes {
+    std::size_t bytes;
+    void operator()(const LabPlanes *p) const {
+        labCached -= bytes;
+        delete p;
     }
-    return img;
+};
+
+// Allocate planes for `n` pixels charged to the cache budget, or return
+// null when they would not fit.
+std::shared_ptr<LabPlanes> budgetedPlanes(std::size_t n) {
+    const std::size_t bytes = n * 3 * sizeof(float);
+    if (!reserveLabBytes(bytes))
+        return nullptr;
+    std::shared_ptr<LabPlanes> planes(new LabPlanes, ReleaseLabBytes{bytes});
+    planes->L.resize(n);
+    planes->a.resize(n);
+    planes->b.resize(n);
+    return planes;
 }
 
-// Run a small k-means clustering on the image pixels to pick representative
-// colours.
-std::vector<Colour> loadImageColours(const std::string &path) {
-    int w = 0, h = 0, comp = 0;
-    unsigned char *data = stbi_load(path.c_str(), &w, &h, &comp, 3);
-    if (!data)
-        return {};
+// Take over converted planes charged to the cache budget, or return null
+// when they would not fit.
+std::shared_ptr<LabPlanes> chargePlanes(LabPlanes &&planes) {
+    const std::size_t bytes = planes.size() * 3 * sizeof(float);
+    if (!reserveLabBytes(bytes))
+        return nullptr;
+    return {new LabPlanes(std::move(planes)), ReleaseLabBytes{bytes}};
+}
 
-    std::vector<LAB> points;
-    points.reserve(static_cast<std::size_t>(w) * h);
-    for (int y = 0; y < h; ++y) {
-        for (int x = 0; x < w; ++x) {
-            unsigned char *p = data + (y * w + x) * 3;
-            Colour c = Colour::fromSRGB(p[0], p[1], p[2], 1.0);
-            points.push_back(c.lab);
+// Convert `n` RGBA pixels from `src` into `planes` in tiles spread over the
+// shared pool. When `copy` is given each tile is first copied there and
+// converted from the copy. Either stage may be skipped by passing null.
+void convertTiles(const unsigned char *src, unsigned char *copy,
+                  LabPlanes *planes, std::size_t n, LoadProgress *progress) {
+    const std::size_t tiles = (n + TILE_PIXELS - 1) / TILE_PIXELS;
+    ThreadPool::shared().parallelFor(tiles, [&](std::size_t t) {
+        const std::size_t first = t * TILE_PIXELS;
+        const std::size_t count = std::min(TILE_PIXELS, n - first);
+        const unsigned char *from = src + first * 4;
+        if (copy) {
+            std::memcpy(copy + first * 4, from, count * 4);
+            from = copy + first * 4;
         }
-    }
-    stbi_image_free(data);
+        if (planes)
+            srgb8ToLab({from, count * 4},
+                       std::span(planes->L).subspan(first, count),
+                       std::span(planes->a).subspan(first, count),
+                       std::span(planes->b).subspan(first, count));
+        if (progress)
+            progress->done += count;
+    });
+}
 
-    const std::size_t k = 5;
-    if (points.empty())
+// Convert `n` RGBA pixels wider than a byte per channel in tiles over the
+// shared pool. `toLab` fills the planes straight from the source, when
+// given, and `toBytes` reduces each pixel to the bytes kept in `rgba`.
+template <class T, class ToLab, class ToBytes>
+void convertWideTiles(const T *src, unsigned char *rgba, LabPlanes *planes,
+                      std::size_t n, LoadProgress *progress, ToLab toLab,
+                      ToBytes toBytes) {
+    const std::size_t tiles = (n + TILE_PIXELS - 1) / TILE_PIXELS;
+    ThreadPool::shared().parallelFor(tiles, [&](std::size_t t) {
+        const std::size_t first = t * TILE_PIXELS;
+        const std::size_t count = std::min(TILE_PIXELS, n - first);
+        const T *from = src + first * 4;
+        for (std::size_t i = 0; i < count; ++i)
+            toBytes(from + i * 4, rgba + (first + i) * 4);
+        if (planes)
+            toLab(std::span(from, count * 4),
+                  std::span(planes->L).subspan(first, count),
+                  std::span(planes->a).subspan(first, count),
+                  std::span(planes->b).subspan(first, count));
+        if (progress)
+            progress->done += count;
+    });
+}
+
+// Decode a mapped image file into an ImageData. HDR and 16-bit files are
+// decoded at their own precision; everything else as 8-bit RGBA.
+ImageData decodeFile(const MappedFile &file, LoadProgress *progress) {
+    if (!file || file.size() == 0 ||
+        file.size() > static_cast<std::size_t>(INT_MAX))
         return {};
 
-    std::mt19937_64 rng{std::random_device{}()};
+    const auto len = static_cast<int>(file.size());
+    int width = 0, height = 0, comp = 0;
+    ImageData img;
+    if (stbi_is_hdr_from_memory(file.data(), len)) {
+        float *data = stbi_loadf_from_memory(file.data(), len, &width,
+                                             &height, &comp, 4);
+        if (!data)
+            return {};
+        toneMapHDR({data, static_cast<std::size_t>(width) * height * 4});
+        img = ImageData::fromLinear(width, height, data, progress);
+        stbi_image_free(data);
+    } else if (stbi_is_16_bit_from_memory(file.data(), len)) {
+        stbi_us *data = stbi_load_16_from_memory(file.data(), len, &width,
+                                                 &height, &comp, 4);
+        if (!data)
+            return {};
+        img = ImageData::fromRGBA16(width, height, data, progress);
+        stbi_image_free(data);
+    } else {
+        unsigned char *data = stbi_load_from_memory(file.data(), len, &width,
+                                                    &height, &comp, 4);
+        if (!data)
+            return {};
+        img = ImageData::fromRGBA(width, height, data, progress);
+        stbi_image_free(data);
+    }
+    return img;
+}
 
-    auto dist2 = [](const LAB &a, const LAB &b) {
-        double dl = a.L - b.L;
-        double da = a.a - b.a;
-        double db = a.b - b.b;
-        return dl * dl + da * da + db * db;
-    };
+// Report a load that needed no work as complete.
+void finishProgress(LoadProgress *progress, std::size_t pixels) {
+    if (progress) {
+        progress->total = pixels;
+        progress->done = pixels;
+    }
+}
 
-    std::vector<LAB> centres;
-    centres.reserve(k);
-    std::uniform_int_distribution<std::size_t> pick(0, points.size() - 1);
-    centres.push_back(points[pick(rng)]);
-    while (centres.size() < k) {
-        std::vector<double> dist(points.size());
-        double sumDist = 0.0;
-        for (std::size_t i = 0; i < points.size(); ++i) {
-            double best = dist2(points[i], centres[0]);
-            for (std::size_t c = 1; c < centres.size(); ++c) {
-                double d = dist2(points[i], centres[c]);
-                if (d < best)
-                    best = d;
+// Shrink an image to `ow` by `oh` pixels. Each output pixel is the mean of
+// the block of source pixels it covers, averaged in linear light; rows are
+// filtered in parallel.
+std::vector<unsigned char> boxFilter(const ImageData &img, std::size_t ow,
+                                     std::size_t oh) {
+    const std::size_t w = static_cast<std::size_t>(img.width);
+    const std::size_t h = static_cast<std::size_t>(img.height);
+    const auto &linear = srgb8LinearTable();
+    std::vector<unsigned char> out(ow * oh * 4);
+    ThreadPool::shared().parallelFor(oh, [&](std::size_t y) {
+        const std::size_t y0 = y * h / oh;
+        const std::size_t y1 = (y + 1) * h / oh;
+        for (std::size_t x = 0; x < ow; ++x) {
+            const std::size_t x0 = x * w / ow;
+            const std::size_t x1 = (x + 1) * w / ow;
+            double r = 0.0, g = 0.0, b = 0.0, a = 0.0;
+            for (std::size_t sy = y0; sy < y1; ++sy) {
+                const unsigned char *p = img.rgba.data() + (sy * w + x0) * 4;
+                for (std::size_t sx = x0; sx < x1; ++sx, p += 4) {
+                    r += linear[p[0]];
+                    g += linear[p[1]];
+                    b += linear[p[2]];
+                    a += p[3];
+                }
             }
-            dist[i] = best;
-            sumDist += best;
-        }
-        std::uniform_real_distribution<double> pickDist(0.0, sumDist);
-        double target = pickDist(rng);
-        double accum = 0.0;
-        std::size_t idx = 0;
-        for (; idx < points.size(); ++idx) {
-            accum += dist[idx];
-            if (accum >= target)
-                break;
+            const double n = static_cast<double>((y1 - y0) * (x1 - x0));
+            unsigned char *o = out.data() + (y * ow + x) * 4;
+            o[0] = linearToSRGB8(r / n);
+            o[1] = linearToSRGB8(g / n);
+            o[2] = linearToSRGB8(b / n);
+            o[3] = static_cast<unsigned char>(std::lround(a / n));
         }
-        if (idx >= points.size())
-            idx = points.size() - 1;
-        centres.push_back(points[idx]);
-    }
+    });
+    return out;
+}
 
-    // A small fixed iteration count is sufficient for picking representative
-    // colours from the image while keeping the computation inexpensive.
-    // Reuse the same low iteration count when clustering random pixels.
-    int iterations = 5;
-    for (int iter = 0; iter < iterations; ++iter) {
-        std::vector<LAB> sum(k);
-        std::vector<int> count(k, 0);
-        for (const auto &p : points) {
-            std::size_t best = 0;
-            double bestd = dist2(p, centres[0]);
-            for (std::size_t c = 1; c < centres.size(); ++c) {
-                double d = dist2(p, centres[c]);
-                if (d < bestd) {
-                    bestd = d;
-                    best = c;
+// As boxFilter, but reading linear light back from the OKLab planes rather
+// than the bytes, so no precision is lost. Returns the output bytes and
+// planes converted from the block means.
+std::pair<std::vector<unsigned char>, LabPlanes>
+boxFilterPlanes(const ImageData &img, const LabPlanes &planes,
+                std::size_t ow, std::size_t oh) {
+    const std::size_t w = static_cast<std::size_t>(img.width);
+    const std::size_t h = static_cast<std::size_t>(img.height);
+    std::vector<unsigned char> out(ow * oh * 4);
+    std::vector<float> means(ow * oh * 4);
+    ThreadPool::shared().parallelFor(oh, [&](std::size_t y) {
+        const std::size_t y0 = y * h / oh;
+        const std::size_t y1 = (y + 1) * h / oh;
+        std::vector<float> r(w), g(w), b(w);
+        std::vector<double> sums(ow * 4);
+        for (std::size_t sy = y0; sy < y1; ++sy) {
+            const std::size_t row = sy * w;
+            labToLinear(std::span(planes.L).subspan(row, w),
+                        std::span(planes.a).subspan(row, w),
+                        std::span(planes.b).subspan(row, w), r, g, b);
+            for (std::size_t x = 0; x < ow; ++x) {
+                double *acc = sums.data() + x * 4;
+                for (std::size_t sx = x * w / ow; sx < (x + 1) * w / ow;
+                     ++sx) {
+                    acc[0] += r[sx];
+                    acc[1] += g[sx];
+                    acc[2] += b[sx];
+                    acc[3] += img.rgba[(row + sx) * 4 + 3];
                 }
             }
-            sum[best].L += p.L;
-            sum[best].a += p.a;
-            sum[best].b += p.b;
-            ++count[best];
         }
-        for (std::size_t c = 0; c < centres.size(); ++c) {
-            if (count[c] > 0) {
-                centres[c].L = sum[c].L / count[c];
-                centres[c].a = sum[c].a / count[c];
-                centres[c].b = sum[c].b / count[c];
+        for (std::size_t x = 0; x < ow; ++x) {
+            const std::size_t x0 = x * w / ow;
+            const std::size_t x1 = (x + 1) * w / ow;
+            const double n = static_cast<double>((y1 - y0) * (x1 - x0));
+            const double *acc = sums.data() + x * 4;
+            float *m = means.data() + (y * ow + x) * 4;
+            unsigned char *o = out.data() + (y * ow + x) * 4;
+            for (int c = 0; c < 3; ++c) {
+                m[c] = static_cast<float>(acc[c] / n);
+                o[c] = linearToSRGB8(acc[c] / n);
             }
+            o[3] = static_cast<unsigned char>(std::lround(acc[3] / n));
         }
+    });
+    LabPlanes lab;
+    lab.L.resize(ow * oh);
+    lab.a.resize(ow * oh);
+    lab.b.resize(ow * oh);
+    linearToLab(means, lab.L, lab.a, lab.b);
+    return {std::move(out), std::move(lab)};
+}
+
+// Cluster OKLab points and return the centres as opaque colours with
+// their share and spread, most common first. Points standing for several
+// pixels, such as superpixels, pass their pixel counts as `weights` and
+// the spread of their own pixels as `spread`, which is added to that of
+// the points about each centre.
+template <class Points, class Weights = UnitWeights>
+std::vector<DominantColour>
+clusterColours(const Points &points, ClusterSettings settings,
+               std::uint64_t seed, Weights weights = {},
+               std::span<const double> spread = {}) {
+    if (points.size() == 0 || settings.k == 0)
+        return {};
+    // Shares come from refine(), so at least one pass must run.
+    settings.maxIterations = std::max(settings.maxIterations, 1);
+    std::mt19937_64 rng{seed};
+    auto cl = ClusterEngine<EuclideanMetric, Weights>({}, weights)
+                  .run(points, {}, settings, rng);
+    if (!spread.empty()) {
+        std::vector<double> within(cl.centres.size());
+        for (std::size_t i = 0; i < points.size(); ++i)
+            within[cl.assignment[i]] += weights[i] * spread[i];
+        for (std::size_t c = 0; c < cl.centres.size(); ++c)
+            if (cl.weight[c] > 0.0)
+                cl.variance[c] += within[c] / cl.weight[c];
     }
 
-    std::vector<Colour> out;
-    out.reserve(k);
-    for (const auto &lab : centres) {
-        Colour col;
-        col.lab = lab;
-        col.alpha = 1.0;
-        out.push_back(col);
+    double total = 0.0;
+    for (double w : cl.weight)
+        total += w;
+    std::vector<DominantColour> out;
+    out.reserve(cl.centres.size());
+    for (std::size_t c = 0; c < cl.centres.size(); ++c) {
+        DominantColour d;
+        d.colour.lab = cl.centres[c];
+        d.colour.alpha = 1.0;
+        d.share = total > 0.0 ? cl.weight[c] / total : 0.0;
+        d.variance = cl.variance[c];
+        out.push_back(d);
     }
+    std::stable_sort(out.begin(), out.end(),
+                     [](const DominantColour &x, const DominantColour &y) {
+                         return x.share > y.share;
+                     });
     return out;
 }
 
-// Generate a random image and cluster the pixels to obtain a palette.
-std::vector<Colour> generateRandomImageColours(int width, int height) {
-    if (width <= 0 || height <= 0)
-        return {};
+std::vector<Colour> coloursOf(const std::vector<DominantColour> &dominant) {
+    std::vector<Colour> out;
+    out.reserve(dominant.size());
+    for (const auto &d : dominant)
+        out.push_back(d.colour);
+    return out;
+}
+} // namespace
 
-    std::vector<LAB> points;
-    points.reserve(static_cast<std::size_t>(width) * height);
-    std::mt19937_64 rng{std::random_device{}()};
-    std::uniform_real_distribution<double> Ld(0.0, 1.0);
-    std::uniform_real_distribution<double> ab(-0.5, 0.5);
-    for (int i = 0; i < width * height; ++i) {
-        points.push_back({Ld(rng), ab(rng), ab(rng)});
+namespace uc {
+
+ImageData::PlaneCache &
+ImageData::PlaneCache::operator=(const PlaneCache &) {
+    std::lock_guard lock(mutex);
+    planes.reset();
+    return *this;
+}
+
+ImageData::PlaneCache &
+ImageData::PlaneCache::operator=(PlaneCache &&other) noexcept {
+    std::lock_guard lock(mutex);
+    planes = std::move(other.planes);
+    return *this;
+}
+
+ImageData ImageData::fromRGBA(int width, int height,
+                              const unsigned char *pixels,
+                              LoadProgress *progress) {
+    ImageData img;
+    if (!pixels || width <= 0 || height <= 0)
+        return img;
+
+    img.width = width;
+    img.height = height;
+    const std::size_t n = static_cast<std::size_t>(width) * height;
+    img.rgba.resize(n * 4);
+    if (progress)
+        progress->total = n;
+    auto planes = budgetedPlanes(n);
+    convertTiles(pixels, img.rgba.data(), planes.get(), n, progress);
+    img._labCache.planes = std::move(planes);
+    img.fingerprint = fingerprintImage(img);
+    return img;
+}
+
+ImageData ImageData::fromRGBA16(int width, int height,
+                                const std::uint16_t *pixels,
+                                LoadProgress *progress) {
+    ImageData img;
+    if (!pixels || width <= 0 || height <= 0)
+        return img;
+
+    img.width = width;
+    img.height = height;
+    img.bitDepth = 16;
+    const std::size_t n = static_cast<std::size_t>(width) * height;
+    img.rgba.resize(n * 4);
+    if (progress)
+        progress->total = n;
+    auto planes = budgetedPlanes(n);
+    convertWideTiles(pixels, img.rgba.data(), planes.get(), n, progress,
+                     srgb16ToLab,
+                     [](const std::uint16_t *px, unsigned char *out) {
+                         for (int c = 0; c < 4; ++c)
+                             out[c] = static_cast<unsigned char>(
+                                 (px[c] * 255u + 32767u) / 65535u);
+                     });
+    img._labCache.planes = std::move(planes);
+    img.fingerprint = fingerprintImage(img);
+    return img;
+}
+
+ImageData ImageData::fromLinear(int width, int height, const float *pixels,
+                                LoadProgress *progress) {
+    ImageData img;
+    if (!pixels || width <= 0 || height <= 0)
+        return img;
+
+    img.width = width;
+    img.height = height;
+    img.bitDepth = 32;
+    const std::size_t n = static_cast<std::size_t>(width) * height;
+    img.rgba.resize(n * 4);
+    if (progress)
+        progress->total = n;
+    auto planes = budgetedPlanes(n);
+    convertWideTiles(pixels, img.rgba.data(), planes.get(), n, progress,
+                     linearToLab, [](const float *px, unsigned char *out) {
+                         for (int c = 0; c < 3; ++c)
+                             out[c] = linearToSRGB8(px[c]);
+                         out[3] = static_cast<unsigned char>(std::lround(
+                             std::clamp(px[3], 0.0f, 1.0f) * 255.0f));
+                     });
+    img._labCache.planes = std::move(planes);
+    img.fingerprint = fingerprintImage(img);
+    return img;
+}
+
+ImageData ImageData::fromPlanes(int width, int height,
+                                std::vector<unsigned char> pixels,
+                                LabPlanes planes, int bitDepth) {
+    ImageData img;
+    const std::size_t n = static_cast<std::size_t>(std::max(width, 0)) *
+                          static_cast<std::size_t>(std::max(height, 0));
+    if (n == 0 || pixels.size() != n * 4)
+        return img;
+    img.width = width;
+    img.height = height;
+    img.rgba = std::move(pixels);
+    img.bitDepth = bitDepth;
+    if (planes.size() == n && planes.a.size() == n && planes.b.size() == n)
+        img._labCache.planes = chargePlanes(std::move(planes));
+    img.fingerprint = fingerprintImage(img);
+    return img;
+}
+
+std::shared_ptr<const LabPlanes> ImageData::lab() const {
+    std::lock_guard lock(_labCache.mutex);
+    if (_labCache.planes)
+        return _labCache.planes;
+
+    const std::size_t n = pixelCount();
+    auto planes = budgetedPlanes(n);
+    const bool keep = planes != nullptr;
+    if (!keep) {
+        planes = std::make_shared<LabPlanes>();
+        planes->L.resize(n);
+        planes->a.resize(n);
+        planes->b.resize(n);
     }
+    convertTiles(rgba.data(), nullptr, planes.get(), n, nullptr);
+    if (keep)
+        _labCache.planes = planes;
+    return planes;
+}
 
-    const std::size_t k = 5;
-    if (points.empty())
-        return {};
+void setLabPlaneBudget(std::size_t bytes) { labBudget = bytes; }
 
-    auto dist2 = [](const LAB &a, const LAB &b) {
-        double dl = a.L - b.L;
-        double da = a.a - b.a;
-        double db = a.b - b.b;
-        return dl * dl + da * da + db * db;
-    };
+std::size_t labPlaneBudget() { return labBudget; }
 
-    std::vector<LAB> centres;
-    centres.reserve(k);
-    std::uniform_int_distribution<std::size_t> pick(0, points.size() - 1);
-    centres.push_back(points[pick(rng)]);
-    while (centres.size() < k) {
-        std::vector<double> dist(points.size());
-        double sumDist = 0.0;
-        for (std::size_t i = 0; i < points.size(); ++i) {
-            double best = dist2(points[i], centres[0]);
-            for (std::size_t c = 1; c < centres.size(); ++c) {
-                double d = dist2(points[i], centres[c]);
-                if (d < best)
-                    best = d;
-            }
-            dist[i] = best;
-            sumDist += best;
-        }
-        std::uniform_real_distribution<double> pickDist(0.0, sumDist);
-        double target = pickDist(rng);
-        double accum = 0.0;
-        std::size_t idx = 0;
-        for (; idx < points.size(); ++idx) {
-            accum += dist[idx];
-            if (accum >= target)
-                break;
+std::size_t labPlaneBytesCached() { return labCached; }
+
+// Every output pixel averages a block of whole source pixels; block edges
+// are spread evenly so sizes differ by at most one pixel.
+SharedImage downsampleImage(SharedImage img, std::size_t maxPixels) {
+    if (!img || maxPixels == 0 || img->pixelCount() <= maxPixels)
+        return img;
+
+    const std::size_t w = static_cast<std::size_t>(img->width);
+    const std::size_t h = static_cast<std::size_t>(img->height);
+    const double scale = std::sqrt(static_cast<double>(maxPixels) /
+                                   static_cast<double>(w * h));
+    const std::size_t ow = std::max<std::size_t>(
+        1, static_cast<std::size_t>(static_cast<double>(w) * scale));
+    const std::size_t oh = std::max<std::size_t>(
+        1, static_cast<std::size_t>(static_cast<double>(h) * scale));
+    if (img->bitDepth > 8) {
+        auto planes = img->lab();
+        auto [out, lab] = boxFilterPlanes(*img, *planes, ow, oh);
+        return std::make_shared<const ImageData>(ImageData::fromPlanes(
+            static_cast<int>(ow), static_cast<int>(oh), std::move(out),
+            std::move(lab), img->bitDepth));
+    }
+    auto out = boxFilter(*img, ow, oh);
+    return std::make_shared<const ImageData>(ImageData::fromRGBA(
+        static_cast<int>(ow), static_cast<int>(oh), out.data()));
+}
+
+// Find the brightest luminance, then scale every pixel by the extended
+// Reinhard curve L (1 + L / white^2) / (1 + L) over its luminance L.
+void toneMapHDR(std::span<float> rgba) {
+    const std::size_t n = rgba.size() / 4;
+    const std::size_t tiles = (n + TILE_PIXELS - 1) / TILE_PIXELS;
+    auto luminance = [&rgba](std::size_t i) {
+        return 0.2126f * rgba[i * 4] + 0.7152f * rgba[i * 4 + 1] +
+               0.0722f * rgba[i * 4 + 2];
+    };
+    std::vector<float> brightest(tiles, 0.0f);
+    auto &pool = ThreadPool::shared();
+    pool.parallelFor(tiles, [&](std::size_t t) {
+        const std::size_t last = std::min((t + 1) * TILE_PIXELS, n);
+        for (std::size_t i = t * TILE_PIXELS; i < last; ++i)
+            brightest[t] = std::max(brightest[t], luminance(i));
+    });
+    const float white = *std::max_element(brightest.begin(), brightest.end());
+    if (white <= 1.0f)
+        return;
+    const float white2 = white * white;
+    pool.parallelFor(tiles, [&](std::size_t t) {
+        const std::size_t last = std::min((t + 1) * TILE_PIXELS, n);
+        for (std::size_t i = t * TILE_PIXELS; i < last; ++i) {
+            const float l = luminance(i);
+            if (l <= 0.0f)
+                continue;
+            const float scale = (1.0f + l / white2) / (1.0f + l);
+            rgba[i * 4] *= scale;
+            rgba[i * 4 + 1] *= scale;
+            rgba[i * 4 + 2] *= scale;
         }
-        if (idx >= points.size())
-            idx = points.size() - 1;
-        centres.push_back(points[idx]);
+    });
+}
+
+ImageData makeThumbnail(const ImageData &img, int maxWidth, int maxHeight) {
+    ImageData thumb;
+    if (img.empty() || maxWidth <= 0 || maxHeight <= 0)
+        return thumb;
+    const double scale =
+        std::min({1.0, static_cast<double>(maxWidth) / img.width,
+                  static_cast<double>(maxHeight) / img.height});
+    auto fit = [scale](int len) {
+        return std::max<std::size_t>(
+            1, static_cast<std::size_t>(std::lround(len * scale)));
+    };
+    const std::size_t ow = fit(img.width);
+    const std::size_t oh = fit(img.height);
+    thumb.width = static_cast<int>(ow);
+    thumb.height = static_cast<int>(oh);
+    if (scale >= 1.0)
+        thumb.rgba = img.rgba;
+    else
+        thumb.rgba = boxFilter(img, ow, oh);
+    thumb.fingerprint = fingerprintImage(thumb);
+    return thumb;
+}
+
+// Mix the bytes eight at a time with a multiply/xor-shift step.
+std::uint64_t hashBytes(std::span<const unsigned char> bytes,
+                        std::uint64_t seed) {
+    std::uint64_t h = 0x9E3779B97F4A7C15ull ^ seed;
+    auto mix = [&h](std::uint64_t v) {
+        h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+    };
+
+    const unsigned char *p = bytes.data();
+    std::size_t n = bytes.size();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        std::uint64_t v;
+        std::memcpy(&v, p + i, sizeof(v));
+        mix(v);
     }
+    std::uint64_t tail = 0;
+    if (n > i)
+        std::memcpy(&tail, p + i, n - i);
+    mix(tail ^ n);
+    return h == 0 ? 1 : h;
+}
 
-    int iterations = 5;
-    for (int iter = 0; iter < iterations; ++iter) {
-        std::vector<LAB> sum(k);
-        std::vector<int> count(k, 0);
-        for (const auto &p : points) {
-            std::size_t best = 0;
-            double bestd = dist2(p, centres[0]);
-            for (std::size_t c = 1; c < centres.size(); ++c) {
-                double d = dist2(p, centres[c]);
-                if (d < bestd) {
-                    bestd = d;
-                    best = c;
-                }
+// Hash the RGBA bytes, seeded with the dimensions.
+std::uint64_t fingerprintImage(const ImageData &img) {
+    if (img.rgba.empty())
+        return 0;
+    return hashBytes(img.rgba,
+                     (static_cast<std::uint64_t>(img.width) << 32) ^
+                         static_cast<std::uint64_t>(img.height));
+}
+
+// Decode an image file through a read-only mapping.
+ImageData loadImageData(const std::string &path, LoadProgress *progress) {
+    return decodeFile(MappedFile(path), progress);
+}
+
+// Load an image and freeze it in a shared buffer, reusing a live decode of
+// the same unchanged file, then an entry of the on-disk cache.
+SharedImage loadSharedImage(const std::string &path, LoadProgress *progress) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    const auto modified = ec ? fs::file_time_type{}
+                             : fs::last_write_time(path, ec);
+    if (ec)
+        return std::make_shared<const ImageData>(
+            loadImageData(path, progress));
+    std::string key = fs::weakly_canonical(path, ec).string();
+    if (ec)
+        key = path;
+
+    {
+        std::lock_guard lock(decodedMutex);
+        auto it = decoded.find(key);
+        if (it != decoded.end() && it->second.size == size &&
+            it->second.modified == modified) {
+            if (auto img = it->second.image.lock()) {
+                finishProgress(progress, img->pixelCount());
+                return img;
             }
-            sum[best].L += p.L;
-            sum[best].a += p.a;
-            sum[best].b += p.b;
-            ++count[best];
         }
-        for (std::size_t c = 0; c < centres.size(); ++c) {
-            if (count[c] > 0) {
-                centres[c].L = sum[c].L / count[c];
-                centres[c].a = sum[c].a / count[c];
-                centres[c].b = sum[c].b / count[c];
+    }
+
+    SharedImage img;
+    MappedFile file(path);
+    auto cache = imageCache();
+    const std::uint64_t content =
+        cache ? hashBytes({file.data(), file.size()}) : 0;
+    if (cache)
+        img = cache->load(content);
+    if (img) {
+        finishProgress(progress, img->pixelCount());
+    } else {
+        img = std::make_shared<const ImageData>(decodeFile(file, progress));
+        if (cache && !img->empty())
+            cache->store(content, *img);
+    }
+
+    if (!img->empty()) {
+        std::lock_guard lock(decodedMutex);
+        std::erase_if(decoded, [](const auto &entry) {
+            return entry.second.image.expired();
+        });
+        decoded[key] = {size, modified, img};
+    }
+    return img;
+}
+
+// Decode all frames of a GIF into one buffer, then convert each frame from
+// its slice of it.
+ImageFrames loadImageFrames(const std::string &path, LoadProgress *progress) {
+    ImageFrames out;
+    bool gif = false;
+    {
+        MappedFile file(path);
+        gif = file && file.size() >= GIF_MAGIC.size() &&
+              file.size() <= static_cast<std::size_t>(INT_MAX) &&
+              std::equal(GIF_MAGIC.begin(), GIF_MAGIC.end(), file.data());
+        if (gif) {
+            int width = 0, height = 0, count = 0, comp = 0;
+            int *delays = nullptr;
+            unsigned char *data = stbi_load_gif_from_memory(
+                file.data(), static_cast<int>(file.size()), &delays, &width,
+                &height, &count, &comp, 4);
+            stbi_image_free(delays);
+            const std::size_t n = data && width > 0 && height > 0
+                                      ? static_cast<std::size_t>(width) *
+                                            static_cast<std::size_t>(height)
+                                      : 0;
+            const auto frames = static_cast<std::size_t>(std::max(count, 0));
+            if (n == 0 || frames == 0 ||
+                n > static_cast<std::size_t>(INT_MAX) / frames) {
+                stbi_image_free(data);
+                return out;
             }
+            if (progress)
+                progress->total = n * frames;
+            out.frames.resize(frames);
+            ThreadPool::shared().parallelFor(frames, [&](std::size_t f) {
+                out.frames[f] = std::make_shared<const ImageData>(
+                    ImageData::fromRGBA(width, height, data + f * n * 4));
+                if (progress)
+                    progress->done += n;
+            });
+            stbi_image_free(data);
         }
     }
-
-    std::vector<Colour> out;
-    out.reserve(k);
-    for (const auto &lab : centres) {
-        Colour col;
-        col.lab = lab;
-        col.alpha = 1.0;
-        out.push_back(col);
+    if (!gif) {
+        auto img = loadSharedImage(path, progress);
+        if (img && !img->empty())
+            out.frames.push_back(std::move(img));
     }
     return out;
 }
 
+// Create a width x height image filled with random colours.
+ImageData generateRandomImage(int width, int height, std::uint64_t seed) {
+    ImageData img;
+    if (width <= 0 || height <= 0)
+        return img;
+
+    img.width = width;
+    img.height = height;
+    const std::size_t pixels = static_cast<std::size_t>(width) * height;
+    img.rgba.resize(pixels * 4);
+    const std::uint64_t key = splitmix64(seed);
+    const std::size_t tiles = (pixels + TILE_PIXELS - 1) / TILE_PIXELS;
+    ThreadPool::shared().parallelFor(tiles, [&](std::size_t t) {
+        const std::size_t first = t * TILE_PIXELS;
+        const std::size_t last = std::min(first + TILE_PIXELS, pixels);
+        unsigned char *p = img.rgba.data() + first * 4;
+        // One hash supplies the three channels of a pixel.
+        for (std::size_t i = first; i < last; ++i, p += 4) {
+            const std::uint64_t bits = randomBits(key, i);
+            p[0] = static_cast<unsigned char>(bits);
+            p[1] = static_cast<unsigned char>(bits >> 8);
+            p[2] = static_cast<unsigned char>(bits >> 16);
+            p[3] = 255;
+        }
+    });
+    img.fingerprint = fingerprintImage(img);
+    return img;
+}
+
+ImageData generateRandomImage(int width, int height) {
+    return generateRandomImage(width, height, std::random_device{}());
+}
+
+// Cluster the image pixels to pick representative colours.
+std::vector<DominantColour>
+extractDominantColours(const ImageData &img, const ClusterSettings &settings,
+                       std::uint64_t seed, std::size_t superpixels) {
+    if (img.empty())
+        return {};
+    if (superpixels == 0 || superpixels >= img.pixelCount())
+        return clusterColours(*img.lab(), settings, seed);
+    SuperpixelSettings sp;
+    sp.count = superpixels;
+    auto regions = segmentSuperpixels(img, sp);
+    return clusterColours(regions, settings, seed,
+                          std::span<const double>(regions.weights),
+                          regions.variance);
+}
+
+std::vector<DominantColour>
+extractDominantColours(const std::string &path,
+                       const ClusterSettings &settings, std::uint64_t seed,
+                       std::size_t pixelBudget, std::size_t superpixels) {
+    auto img = downsampleImage(loadSharedImage(path), pixelBudget);
+    return extractDominantColours(*img, settings, seed, superpixels);
+}
+
+std::vector<Colour> loadImageColours(const std::string &path,
+                                     const ClusterSettings &settings,
+                                     std::size_t pixelBudget) {
+    return coloursOf(extractDominantColours(path, settings,
+                                            std::random_device{}(),
+                                            pixelBudget));
+}
+
+// Cluster random OKLab samples, synthesised as they are read, to obtain a
+// palette.
+std::vector<Colour>
+generateRandomImageColours(int width, int height,
+                           const ClusterSettings &settings) {
+    if (width <= 0 || height <= 0)
+        return {};
+
+    std::mt19937_64 rng{std::random_device{}()};
+    RandomLabSource points{rng(), static_cast<std::size_t>(width) * height};
+    return coloursOf(clusterColours(points, settings, rng()));
+}
+
 } // namespace uc
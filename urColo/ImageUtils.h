@@ -1,29 +1,282 @@
 // urColo - image utility structures
 #pragma once
+#include "Clustering.h"
 #include "Colour.h"
+#include "Random.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
 #include <vector>
 
 namespace uc {
 
-// Raw image pixels in RGBA format along with colour conversions for
-// algorithms.
+// OKLab values of an image in structure-of-arrays form: one float plane per
+// channel, in pixel order. Can be passed directly to ClusterEngine.
+//
+// Member variables:
+// - `L`, `a`, `b` Channel planes of equal length.
+struct LabPlanes {
+    std::vector<float> L, a, b;
+
+    [[nodiscard]] std::size_t size() const { return L.size(); }
+    [[nodiscard]] LAB operator[](std::size_t i) const {
+        return {L[i], a[i], b[i]};
+    }
+};
+
+// Uniformly random OKLab samples synthesised on demand. Sample `i` is a
+// pure function of the seed and `i`, so k-means can read any number of
+// them without storing a buffer. L covers [0, 1) and a and b [-0.5, 0.5).
+//
+// Member variables:
+// - `seed`  Stream the samples are drawn from.
+// - `count` Number of samples.
+struct RandomLabSource {
+    std::uint64_t seed{0};
+    std::size_t count{0};
+
+    [[nodiscard]] std::size_t size() const { return count; }
+    [[nodiscard]] LAB operator[](std::size_t i) const {
+        // Three 21-bit fields of one hash.
+        constexpr double unit = 1.0 / (1 << 21);
+        std::uint64_t bits = randomBits(seed, i);
+        return {static_cast<double>(bits & 0x1FFFFF) * unit,
+                static_cast<double>((bits >> 21) & 0x1FFFFF) * unit - 0.5,
+                static_cast<double>((bits >> 42) & 0x1FFFFF) * unit - 0.5};
+    }
+};
+
+// Progress of an image load, updated from worker threads as tiles finish.
+//
+// Member variables:
+// - `done`  Pixels copied and converted so far.
+// - `total` Pixels in the image, 0 until decoding has finished.
+struct LoadProgress {
+    std::atomic<std::size_t> done{0};
+    std::atomic<std::size_t> total{0};
+
+    // Clear the counters before a new load.
+    void reset() {
+        done = 0;
+        total = 0;
+    }
+    // Fraction of pixels finished, or a negative value while decoding.
+    [[nodiscard]] float fraction() const {
+        std::size_t t = total;
+        return t == 0 ? -1.0f
+                      : static_cast<float>(done) / static_cast<float>(t);
+    }
+};
+
+// Raw image pixels in RGBA format. Only the decoded bytes are stored; the
+// OKLab values algorithms need are derived on demand by lab(). Once loaded
+// an image is treated as immutable and passed around as `SharedImage` so
+// preview, generation jobs and the generator can all read the same buffers
+// without copying them.
 struct ImageData {
     int width{0};
     int height{0};
     std::vector<unsigned char> rgba; //< 4 * width * height bytes
-    std::vector<Colour> colours;     //< Colour representation of each pixel
+    std::uint64_t fingerprint{0};    //< Content hash, 0 when empty
+    int bitDepth{8}; //< Bits per channel the planes were converted from
+
+    // Build an image from `width * height` decoded RGBA pixels. The bytes
+    // are copied tile by tile across the shared thread pool and each tile
+    // is converted to OKLab while it is still in cache, so the planes come
+    // for free when the budget allows keeping them.
+    static ImageData fromRGBA(int width, int height,
+                              const unsigned char *pixels,
+                              LoadProgress *progress = nullptr);
+
+    // Build an image from 16-bit sRGB RGBA pixels, such as a 16-bit PNG.
+    // Tiles are converted to OKLab straight from the 16-bit values and
+    // reduced to bytes for `rgba` in the same pass, so the planes keep the
+    // full precision. Should the planes not fit the budget, lab() later
+    // converts from the bytes instead.
+    static ImageData fromRGBA16(int width, int height,
+                                const std::uint16_t *pixels,
+                                LoadProgress *progress = nullptr);
+
+    // Build an image from linear-light float RGBA pixels, such as an HDR
+    // image after toneMapHDR(). Converted like fromRGBA16().
+    static ImageData fromLinear(int width, int height, const float *pixels,
+                                LoadProgress *progress = nullptr);
+
+    // Build an image from RGBA bytes and OKLab planes converted earlier,
+    // such as an entry read back from an ImageCache. The planes are kept
+    // when the budget allows and must have one value per pixel; otherwise
+    // they are dropped and lab() converts again on demand. `bitDepth` is
+    // that of the source the planes were converted from.
+    static ImageData fromPlanes(int width, int height,
+                                std::vector<unsigned char> pixels,
+                                LabPlanes planes, int bitDepth = 8);
+
+    [[nodiscard]] std::size_t pixelCount() const { return rgba.size() / 4; }
+    [[nodiscard]] bool empty() const { return rgba.empty(); }
+
+    // OKLab planes of the pixels, converted on first use in parallel
+    // tiles. They stay cached
+    // in the image while the planes of all images fit in labPlaneBudget();
+    // beyond that every call converts afresh and the returned handle is the
+    // only owner, so the memory goes once the caller is done.
+    [[nodiscard]] std::shared_ptr<const LabPlanes> lab() const;
+
+  private:
+    // Lazily filled planes. Copies start empty, so editing the pixels of a
+    // copied image never leaves it with stale planes; moves carry the
+    // planes along with the pixels.
+    struct PlaneCache {
+        PlaneCache() = default;
+        PlaneCache(const PlaneCache &) {}
+        PlaneCache(PlaneCache &&other) noexcept
+            : planes(std::move(other.planes)) {}
+        PlaneCache &operator=(const PlaneCache &);
+        PlaneCache &operator=(PlaneCache &&other) noexcept;
+
+        std::mutex mutex;
+        std::shared_ptr<const LabPlanes> planes;
+    };
+    mutable PlaneCache _labCache;
+};
+
+// Set the most bytes of OKLab planes kept cached across all images. Planes
+// already cached are unaffected; the limit applies to later conversions.
+void setLabPlaneBudget(std::size_t bytes);
+
+// Current limit on cached OKLab plane memory in bytes.
+std::size_t labPlaneBudget();
+
+// Bytes of OKLab planes currently held in image caches.
+std::size_t labPlaneBytesCached();
+
+// Reference-counted handle to an immutable image.
+using SharedImage = std::shared_ptr<const ImageData>;
+
+// Pixels k-means samples from an image by default. Palette quality stops
+// improving well before this, while clustering cost keeps growing.
+inline constexpr std::size_t kDefaultPixelBudget = std::size_t{256} * 1024;
+
+// Shrink an image to at most `maxPixels` pixels, keeping its aspect ratio.
+// Each output pixel is the mean of the block of source pixels it covers,
+// averaged in linear light so edges between colours do not darken. Images
+// deeper than 8 bits are averaged from their OKLab planes, so the result
+// keeps their precision.
+//
+// \return `img` itself when it already fits or `maxPixels` is 0.
+SharedImage downsampleImage(SharedImage img, std::size_t maxPixels);
+
+// Box-filtered preview of an image that fits within `maxWidth` by
+// `maxHeight`, keeping its aspect ratio and averaging in linear light like
+// downsampleImage(). Images that already fit are copied unchanged. Meant
+// for display: the OKLab planes are only converted if lab() is called.
+ImageData makeThumbnail(const ImageData &img, int maxWidth, int maxHeight);
+
+// Fast non-cryptographic hash of a byte buffer.
+//
+// \return A non-zero hash.
+std::uint64_t hashBytes(std::span<const unsigned char> bytes,
+                        std::uint64_t seed = 0);
+
+// Hash the pixel contents of an image so identical images can be recognised.
+//
+// \return A non-zero hash, or 0 for an image without pixels.
+std::uint64_t fingerprintImage(const ImageData &img);
+
+// Compress the range of linear HDR pixels into [0, 1] in place with the
+// extended Reinhard operator on luminance, using the brightest pixel as
+// white so nothing clips. Scaling all three channels alike keeps hues.
+// Images no brighter than 1 are left unchanged. Alpha is not touched.
+void toneMapHDR(std::span<float> rgba);
+
+// Load an image file and return its pixel data. The file is memory-mapped
+// and decoded in place. 16-bit PNGs and Radiance HDR files keep their
+// precision in the OKLab planes; HDR files are tone mapped first.
+// `progress`, when given, is updated as the decoded pixels are copied and
+// converted.
+ImageData loadImageData(const std::string &path,
+                        LoadProgress *progress = nullptr);
+
+// Load an image file into an immutable shared buffer. While an earlier
+// load of the same unchanged file is still referenced, that image is
+// returned instead of decoding again, so preview and colour extraction of
+// one file share a single decode.
+SharedImage loadSharedImage(const std::string &path,
+                            LoadProgress *progress = nullptr);
+
+// Frames of an animated image. pooledColours() merges them for clustering
+// all frames together.
+//
+// Member variables:
+// - `frames` Each frame as its own image, in display order.
+struct ImageFrames {
+    std::vector<SharedImage> frames;
+
+    [[nodiscard]] std::size_t size() const { return frames.size(); }
+    [[nodiscard]] bool empty() const { return frames.empty(); }
 };
 
-// Load an image file and return its pixel data and colour values.
-ImageData loadImageData(const std::string &path);
+// Load every frame of an animated GIF, as composited for display. Frames
+// are converted to OKLab straight from the decoded buffer, one frame per
+// task, and the buffer is freed once they are done. GIFs whose frames hold
+// more than INT_MAX pixels in total are rejected. Other files load as a
+// single frame through loadSharedImage(). `progress` counts the pixels of
+// finished frames.
+ImageFrames loadImageFrames(const std::string &path,
+                            LoadProgress *progress = nullptr);
 
 // Generate a random image of the given dimensions and return the pixels.
+// Each pixel is hashed from `seed` and its index, so tiles are filled in
+// parallel and the same seed always gives the same image.
+ImageData generateRandomImage(int width, int height, std::uint64_t seed);
+// As above with a freshly drawn seed.
 ImageData generateRandomImage(int width, int height);
 
-// Load an image and extract dominant colours using a simple k-means.
-std::vector<Colour> loadImageColours(const std::string &path);
+// A dominant colour of an image together with how much of it it covers.
+//
+// Member variables:
+// - `colour`   Cluster centre, fully opaque.
+// - `share`    Fraction of the clustered pixels assigned to it.
+// - `variance` Mean squared OKLab distance of those pixels from the centre.
+struct DominantColour {
+    Colour colour;
+    double share{0.0};
+    double variance{0.0};
+};
+
+// Extract the dominant colours of an image with k-means, most common
+// first. `settings` gives the number of colours and the iteration limit and
+// `seed` the random stream, so the same arguments always give the same
+// result. Shares and variances are gathered in the final assignment pass.
+// A non-zero `superpixels` first segments the image into about that many
+// SLIC regions and clusters their mean colours weighted by area, which
+// ignores isolated noisy pixels and is much faster on large images.
+std::vector<DominantColour>
+extractDominantColours(const ImageData &img,
+                       const ClusterSettings &settings = {},
+                       std::uint64_t seed = 0, std::size_t superpixels = 0);
+
+// Load an image and extract its dominant colours as above. Images larger
+// than `pixelBudget` are downsampled first.
+std::vector<DominantColour>
+extractDominantColours(const std::string &path,
+                       const ClusterSettings &settings = {},
+                       std::uint64_t seed = 0,
+                       std::size_t pixelBudget = kDefaultPixelBudget,
+                       std::size_t superpixels = 0);
+
+// Load an image and extract dominant colours with k-means, most common
+// first. `settings` gives the number of colours and the iteration limit;
+// images larger than `pixelBudget` are downsampled first.
+std::vector<Colour>
+loadImageColours(const std::string &path, const ClusterSettings &settings = {},
+                 std::size_t pixelBudget = kDefaultPixelBudget);
 
 // Generate a random image and return representative colours.
-std::vector<Colour> generateRandomImageColours(int width, int height);
+std::vector<Colour>
+generateRandomImageColours(int width, int height,
+                           const ClusterSettings &settings = {});
 } // namespace uc
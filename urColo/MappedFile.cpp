@@ -0,0 +1,112 @@
+// urColo - read-only memory-mapped file
+#include "MappedFile.h"
+
+#include <utility>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace uc {
+
+#ifdef _WIN32
+// The file handle is only needed to create the mapping; the view keeps the
+// file open until it is unmapped.
+MappedFile::MappedFile(const std::string &path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER size{};
+    if (GetFileSizeEx(file, &size)) {
+        _open = true;
+        _size = static_cast<std::size_t>(size.QuadPart);
+        if (_size > 0) {
+            _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+                                          nullptr);
+            if (_mapping)
+                _data = static_cast<const unsigned char *>(
+                    MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (!_data)
+                close();
+        }
+    }
+    CloseHandle(file);
+}
+
+void MappedFile::close() {
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mapping)
+        CloseHandle(_mapping);
+    _data = nullptr;
+    _mapping = nullptr;
+    _size = 0;
+    _open = false;
+}
+#else
+// The descriptor can be closed straight away; the mapping holds its own
+// reference to the file.
+MappedFile::MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        _open = true;
+        _size = static_cast<std::size_t>(st.st_size);
+        if (_size > 0) {
+            void *p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close();
+            } else {
+                _data = static_cast<const unsigned char *>(p);
+                // Decoders read front to back.
+                ::madvise(p, _size, MADV_SEQUENTIAL);
+            }
+        }
+    }
+    ::close(fd);
+}
+
+void MappedFile::close() {
+    if (_data)
+        ::munmap(const_cast<unsigned char *>(_data), _size);
+    _data = nullptr;
+    _size = 0;
+    _open = false;
+}
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : _data(std::exchange(other._data, nullptr)),
+      _size(std::exchange(other._size, 0)),
+      _open(std::exchange(other._open, false))
+#ifdef _WIN32
+      ,
+      _mapping(std::exchange(other._mapping, nullptr))
+#endif
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+        _open = std::exchange(other._open, false);
+#ifdef _WIN32
+        _mapping = std::exchange(other._mapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+} // namespace uc
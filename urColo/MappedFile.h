@@ -0,0 +1,38 @@
+// urColo - read-only memory-mapped file interface
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace uc {
+// A whole file mapped read-only into memory. The operating system pages
+// the contents in on first access, so decoders can read straight from the
+// mapping without a stdio buffer or a copy in between.
+//
+// A failed open leaves the object empty; check it with operator bool.
+class MappedFile {
+  public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    // True when the file was opened and mapped. An empty file maps to an
+    // empty span and still counts as open.
+    explicit operator bool() const { return _open; }
+    [[nodiscard]] const unsigned char *data() const { return _data; }
+    [[nodiscard]] std::size_t size() const { return _size; }
+
+  private:
+    void close();
+
+    const unsigned char *_data{nullptr};
+    std::size_t _size{0};
+    bool _open{false};
+#ifdef _WIN32
+    void *_mapping{nullptr}; //< File mapping handle
+#endif
+};
+} // namespace uc
@@ -1,76 +1,787 @@
 // urColo - learning model implementation
 #include "Model.h"
+#include "Random.h"
+#include "ThreadPool.h"
 #include <algorithm>
+#include <bit>
 #include <cmath>
+#include <limits>
 #include <nlohmann/json.hpp>
+#include <string>
 
 using json = nlohmann::json;
 
+namespace {
+using namespace uc;
+
+// Upper bound on EM rounds. The log-likelihood normally stops improving
+// after a few dozen.
+constexpr int EM_MAX_ITERS = 100;
+
+// Average per-colour log-likelihood gain below which EM has converged.
+constexpr double EM_TOLERANCE = 1e-6;
+
+// Added to every covariance diagonal so a component that collapses onto a
+// handful of identical colours stays invertible. Corresponds to a spread of
+// 0.01 in OKLab, well below a visible difference.
+constexpr double COV_FLOOR = 1e-4;
+
+// Colours per E-step task. Large enough to amortise scheduling and small
+// enough that a task's responsibility buffer stays in cache.
+constexpr std::size_t CHUNK = 1024;
+
+// Spread used when no training data constrains a channel. Also the initial
+// spread of a component started by ingest().
+constexpr double DEFAULT_STDEV = 0.05;
+
+// While the mixture is still growing, an ingested colour further than this
+// from every component mean starts a new component. Roughly the OKLab
+// distance between colours most people would name differently.
+constexpr double SEED_SPACING = 0.1;
+
+// Palettes per shard in a parallel ingest. A shard's accumulator is merged
+// once, so shards should be large compared with the merge cost.
+constexpr std::size_t SHARD_PALETTES = 256;
+
+// Palettes parsed from a stream before they are ingested as one batch.
+// Bounds memory use while leaving enough work to spread across shards.
+constexpr std::size_t STREAM_BATCH = 4096;
+
+// Training palettes consulted for a locked-colour suggestion.
+constexpr std::size_t NEIGHBOURS = 8;
+
+// Offset added to a neighbour's match score before it is inverted into a
+// sampling weight, so an exact match does not take every draw.
+constexpr double SCORE_EPS = 0.02;
+
+// Spread of the noise added to colours taken from neighbour palettes, so
+// repeated suggestions vary slightly instead of copying them exactly.
+constexpr double NEIGHBOUR_JITTER = 0.01;
+
+constexpr double LOG_2PI = 1.8378770664093453;
+
+// Identify a palette by its swatch colours, in order.
+std::uint64_t paletteKey(const Palette &palette) {
+    std::uint64_t key = splitmix64(palette._swatches.size());
+    for (const auto &sw : palette._swatches) {
+        for (float v : {sw._colour.x, sw._colour.y, sw._colour.z,
+                        sw._colour.w})
+            key = splitmix64(key ^ std::bit_cast<std::uint32_t>(v));
+    }
+    return key;
+}
+
+// Training colours stored one array per channel so the E-step loops run
+// over contiguous doubles.
+struct Samples {
+    std::vector<double> L, a, b;
+    std::size_t size() const { return L.size(); }
+};
+
+// Component parameters rearranged for evaluating log densities: the mean,
+// the six distinct entries of the inverse covariance and the log of the
+// weight times the normalising constant.
+struct Precision {
+    double mL, ma, mb;
+    double i00, i01, i02, i11, i12, i22;
+    double logNorm;
+};
+
+// Responsibility-weighted sums gathered by one E-step task: count, first
+// moments and the six distinct second moments, per component.
+using Moments = std::array<double, 10>;
+struct ChunkStats {
+    std::vector<Moments> comp;
+    double logLik{0.0};
+};
+
+// Cholesky factorisation of a symmetric 3x3 matrix.
+//
+// Returns false if the matrix is not positive definite.
+bool cholesky(const std::array<double, 9> &m, std::array<double, 9> &l) {
+    l.fill(0.0);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j <= i; ++j) {
+            double sum = m[static_cast<std::size_t>(i * 3 + j)];
+            for (int k = 0; k < j; ++k)
+                sum -= l[static_cast<std::size_t>(i * 3 + k)] *
+                       l[static_cast<std::size_t>(j * 3 + k)];
+            if (i == j) {
+                if (sum <= 0.0)
+                    return false;
+                l[static_cast<std::size_t>(i * 3 + i)] = std::sqrt(sum);
+            } else {
+                l[static_cast<std::size_t>(i * 3 + j)] =
+                    sum / l[static_cast<std::size_t>(j * 3 + j)];
+            }
+        }
+    }
+    return true;
+}
+
+// Fill in the Cholesky factor, widening the covariance until it factors.
+void factor(MixtureComponent &c) {
+    while (!cholesky(c.cov, c.chol)) {
+        c.cov[0] += COV_FLOOR;
+        c.cov[4] += COV_FLOOR;
+        c.cov[8] += COV_FLOOR;
+    }
+}
+
+Precision precision(const MixtureComponent &c) {
+    const auto &m = c.cov;
+    double c00 = m[4] * m[8] - m[5] * m[7];
+    double c01 = m[2] * m[7] - m[1] * m[8];
+    double c02 = m[1] * m[5] - m[2] * m[4];
+    double c11 = m[0] * m[8] - m[2] * m[6];
+    double c12 = m[2] * m[3] - m[0] * m[5];
+    double c22 = m[0] * m[4] - m[1] * m[3];
+    double det = m[0] * c00 + m[1] * (m[5] * m[6] - m[3] * m[8]) +
+                 m[2] * (m[3] * m[7] - m[4] * m[6]);
+    det = std::max(det, std::numeric_limits<double>::min());
+    return {c.mean.L,
+            c.mean.a,
+            c.mean.b,
+            c00 / det,
+            c01 / det,
+            c02 / det,
+            c11 / det,
+            c12 / det,
+            c22 / det,
+            std::log(std::max(c.weight, std::numeric_limits<double>::min())) -
+                0.5 * (3.0 * LOG_2PI + std::log(det))};
+}
+
+// Log density of `x` under each component, including its mixing weight.
+void logDensities(const LAB &x, std::span<const Precision> prec,
+                  std::span<double> out) {
+    for (std::size_t c = 0; c < prec.size(); ++c) {
+        const Precision &p = prec[c];
+        double dL = x.L - p.mL;
+        double da = x.a - p.ma;
+        double db = x.b - p.mb;
+        double q = p.i00 * dL * dL + p.i11 * da * da + p.i22 * db * db +
+                   2.0 * (p.i01 * dL * da + p.i02 * dL * db + p.i12 * da * db);
+        out[c] = p.logNorm - 0.5 * q;
+    }
+}
+
+// Statistics equivalent to the moment sums gathered by the E-step.
+ColourStats statsFromMoments(const Moments &s) {
+    ColourStats st;
+    if (s[0] <= 0.0)
+        return st;
+    st.weight = s[0];
+    st.mean = {s[1] / s[0], s[2] / s[0], s[3] / s[0]};
+    const LAB &mu = st.mean;
+    st.m2 = {s[4] - s[0] * mu.L * mu.L, s[5] - s[0] * mu.L * mu.a,
+             s[6] - s[0] * mu.L * mu.b, s[7] - s[0] * mu.a * mu.a,
+             s[8] - s[0] * mu.a * mu.b, s[9] - s[0] * mu.b * mu.b};
+    return st;
+}
+
+// Covariance from statistics, floored so it stays invertible.
+std::array<double, 9> flooredCovariance(const ColourStats &st) {
+    auto cov = st.covariance();
+    cov[0] += COV_FLOOR;
+    cov[4] += COV_FLOOR;
+    cov[8] += COV_FLOOR;
+    return cov;
+}
+
+// E-step over samples [begin, end): compute every component's log density
+// for the whole chunk, turn them into responsibilities, then accumulate the
+// weighted moments the M-step needs.
+void expectation(const Samples &pts, std::span<const Precision> prec,
+                 std::size_t begin, std::size_t end, ChunkStats &out) {
+    const std::size_t k = prec.size();
+    const std::size_t len = end - begin;
+    const double *L = pts.L.data() + begin;
+    const double *A = pts.a.data() + begin;
+    const double *B = pts.b.data() + begin;
+    std::vector<double> resp(k * len);
+
+    for (std::size_t c = 0; c < k; ++c) {
+        const Precision &p = prec[c];
+        double *row = resp.data() + c * len;
+        for (std::size_t i = 0; i < len; ++i) {
+            double dL = L[i] - p.mL;
+            double da = A[i] - p.ma;
+            double db = B[i] - p.mb;
+            double q = p.i00 * dL * dL + p.i11 * da * da + p.i22 * db * db +
+                       2.0 * (p.i01 * dL * da + p.i02 * dL * db +
+                              p.i12 * da * db);
+            row[i] = p.logNorm - 0.5 * q;
+        }
+    }
+
+    std::vector<double> peak(len, -std::numeric_limits<double>::infinity());
+    std::vector<double> total(len, 0.0);
+    for (std::size_t c = 0; c < k; ++c)
+        for (std::size_t i = 0; i < len; ++i)
+            peak[i] = std::max(peak[i], resp[c * len + i]);
+    for (std::size_t c = 0; c < k; ++c) {
+        for (std::size_t i = 0; i < len; ++i) {
+            double e = std::exp(resp[c * len + i] - peak[i]);
+            resp[c * len + i] = e;
+            total[i] += e;
+        }
+    }
+    for (std::size_t i = 0; i < len; ++i)
+        out.logLik += peak[i] + std::log(total[i]);
+
+    out.comp.assign(k, Moments{});
+    for (std::size_t c = 0; c < k; ++c) {
+        Moments &s = out.comp[c];
+        const double *row = resp.data() + c * len;
+        for (std::size_t i = 0; i < len; ++i) {
+            double r = row[i] / total[i];
+            s[0] += r;
+            s[1] += r * L[i];
+            s[2] += r * A[i];
+            s[3] += r * B[i];
+            s[4] += r * L[i] * L[i];
+            s[5] += r * L[i] * A[i];
+            s[6] += r * L[i] * B[i];
+            s[7] += r * A[i] * A[i];
+            s[8] += r * A[i] * B[i];
+            s[9] += r * B[i] * B[i];
+        }
+    }
+}
+
+// Pick starting means with k-means++ so components begin on separate
+// clusters. Returns fewer than `k` when there are fewer distinct colours.
+std::vector<LAB> seedMeans(const Samples &pts, std::size_t k,
+                           std::mt19937_64 &rng) {
+    std::vector<LAB> means;
+    std::uniform_int_distribution<std::size_t> pick(0, pts.size() - 1);
+    std::size_t first = pick(rng);
+    means.push_back({pts.L[first], pts.a[first], pts.b[first]});
+
+    std::vector<double> d2(pts.size());
+    while (means.size() < k) {
+        double sum = 0.0;
+        for (std::size_t i = 0; i < pts.size(); ++i) {
+            double best = std::numeric_limits<double>::infinity();
+            for (const auto &m : means) {
+                double dL = pts.L[i] - m.L;
+                double da = pts.a[i] - m.a;
+                double db = pts.b[i] - m.b;
+                best = std::min(best, dL * dL + da * da + db * db);
+            }
+            d2[i] = best;
+            sum += best;
+        }
+        if (sum <= 0.0)
+            break;
+        std::uniform_real_distribution<double> target(0.0, sum);
+        double t = target(rng);
+        std::size_t idx = 0;
+        for (double acc = 0.0; idx + 1 < pts.size(); ++idx) {
+            acc += d2[idx];
+            if (acc >= t)
+                break;
+        }
+        means.push_back({pts.L[idx], pts.a[idx], pts.b[idx]});
+    }
+    return means;
+}
+} // namespace
+
 namespace uc {
+
+void ColourStats::add(const LAB &x, double w) {
+    if (w <= 0.0)
+        return;
+    weight += w;
+    double f = w / weight;
+    LAB d{x.L - mean.L, x.a - mean.a, x.b - mean.b};
+    mean.L += d.L * f;
+    mean.a += d.a * f;
+    mean.b += d.b * f;
+    LAB e{x.L - mean.L, x.a - mean.a, x.b - mean.b};
+    m2[0] += w * d.L * e.L;
+    m2[1] += w * d.L * e.a;
+    m2[2] += w * d.L * e.b;
+    m2[3] += w * d.a * e.a;
+    m2[4] += w * d.a * e.b;
+    m2[5] += w * d.b * e.b;
+}
+
+// Chan et al.'s pairwise update: the combined co-moments are the two sums
+// plus a correction for the distance between the two means.
+void ColourStats::merge(const ColourStats &other) {
+    if (other.weight <= 0.0)
+        return;
+    if (weight <= 0.0) {
+        *this = other;
+        return;
+    }
+    double total = weight + other.weight;
+    double f = weight * other.weight / total;
+    LAB d{other.mean.L - mean.L, other.mean.a - mean.a,
+          other.mean.b - mean.b};
+    m2[0] += other.m2[0] + d.L * d.L * f;
+    m2[1] += other.m2[1] + d.L * d.a * f;
+    m2[2] += other.m2[2] + d.L * d.b * f;
+    m2[3] += other.m2[3] + d.a * d.a * f;
+    m2[4] += other.m2[4] + d.a * d.b * f;
+    m2[5] += other.m2[5] + d.b * d.b * f;
+    double g = other.weight / total;
+    mean.L += d.L * g;
+    mean.a += d.a * g;
+    mean.b += d.b * g;
+    weight = total;
+}
+
+std::array<double, 9> ColourStats::covariance() const {
+    if (weight <= 0.0)
+        return {};
+    auto v = [this](std::size_t i) { return m2[i] / weight; };
+    return {v(0), v(1), v(2), v(1), v(3), v(4), v(2), v(4), v(5)};
+}
+
+LAB ColourStats::stdev() const {
+    auto cov = covariance();
+    return {std::sqrt(std::max(cov[0], 0.0)), std::sqrt(std::max(cov[4], 0.0)),
+            std::sqrt(std::max(cov[8], 0.0))};
+}
+
+void Model::Accumulator::merge(const Accumulator &other) {
+    overall.merge(other.overall);
+    if (components.size() < other.components.size())
+        components.resize(other.components.size());
+    for (std::size_t c = 0; c < other.components.size(); ++c)
+        components[c].merge(other.components[c]);
+}
+
 // Simple statistical model capturing average colour properties.
 Model::Model(std::uint64_t seed)
     : _rng(seed == 0 ? std::random_device{}() : seed) {}
 
-// Calculate mean and standard deviation of colours in the given palettes.
+// Fit the overall statistics and the Gaussian mixture to the colours of the
+// given palettes, discarding anything learned before.
 void Model::train(const std::vector<Palette> &goodPalettes) {
-    std::size_t count = 0;
-    LAB mean{};
-    LAB m2{}; // sum of squared differences for variance
-
+    Samples pts;
+    _overall = {};
     for (const auto &pal : goodPalettes) {
         for (const auto &sw : pal._swatches) {
             Colour c = Colour::fromImVec4(sw._colour);
-            ++count;
-            // Welford's method
-            double deltaL = c.lab.L - mean.L;
-            double deltaA = c.lab.a - mean.a;
-            double deltaB = c.lab.b - mean.b;
-            mean.L += deltaL / static_cast<double>(count);
-            mean.a += deltaA / static_cast<double>(count);
-            mean.b += deltaB / static_cast<double>(count);
-            m2.L += deltaL * (c.lab.L - mean.L);
-            m2.a += deltaA * (c.lab.a - mean.a);
-            m2.b += deltaB * (c.lab.b - mean.b);
+            pts.L.push_back(c.lab.L);
+            pts.a.push_back(c.lab.a);
+            pts.b.push_back(c.lab.b);
+            _overall.add(c.lab);
         }
     }
 
-    if (count == 0) {
+    remember(goodPalettes, true);
+    _learned.clear();
+    for (const auto &pal : goodPalettes)
+        _learned.insert(paletteKey(pal));
+    if (pts.size() == 0) {
         _trained = false;
+        _mixture.clear();
         return;
     }
-
-    _mean = mean;
-    _stdev.L = std::sqrt(m2.L / static_cast<double>(count));
-    _stdev.a = std::sqrt(m2.a / static_cast<double>(count));
-    _stdev.b = std::sqrt(m2.b / static_cast<double>(count));
     _trained = true;
+    const LAB sd = _overall.stdev();
+
+    // Every component starts with the overall spread, centred on a
+    // k-means++ pick.
+    auto means =
+        seedMeans(pts, static_cast<std::size_t>(_components), _rng);
+    const std::size_t k = means.size();
+    std::vector<MixtureComponent> mix(k);
+    for (std::size_t c = 0; c < k; ++c) {
+        mix[c].weight = 1.0 / static_cast<double>(k);
+        mix[c].mean = means[c];
+        mix[c].cov = {sd.L * sd.L + COV_FLOOR, 0.0, 0.0,
+                      0.0, sd.a * sd.a + COV_FLOOR, 0.0,
+                      0.0, 0.0, sd.b * sd.b + COV_FLOOR};
+    }
+
+    const std::size_t n = pts.size();
+    const std::size_t chunks = (n + CHUNK - 1) / CHUNK;
+    std::vector<ChunkStats> stats(chunks);
+    std::vector<Precision> prec(k);
+    std::vector<Moments> sum(k);
+    double prevLogLik = -std::numeric_limits<double>::infinity();
+    auto &pool = ThreadPool::shared();
+
+    for (int iter = 0; iter < EM_MAX_ITERS; ++iter) {
+        for (std::size_t c = 0; c < k; ++c)
+            prec[c] = precision(mix[c]);
+
+        pool.parallelFor(chunks, [&](std::size_t ch) {
+            stats[ch].logLik = 0.0;
+            expectation(pts, prec, ch * CHUNK, std::min(n, (ch + 1) * CHUNK),
+                        stats[ch]);
+        });
+
+        // M-step: reduce the chunk sums and re-estimate each component.
+        double logLik = 0.0;
+        std::fill(sum.begin(), sum.end(), Moments{});
+        for (const auto &st : stats) {
+            logLik += st.logLik;
+            for (std::size_t c = 0; c < k; ++c)
+                for (std::size_t m = 0; m < sum[c].size(); ++m)
+                    sum[c][m] += st.comp[c][m];
+        }
+        for (std::size_t c = 0; c < k; ++c) {
+            const Moments &s = sum[c];
+            if (s[0] <= std::numeric_limits<double>::epsilon())
+                continue; // no colours claimed; leave the component as is
+            auto &comp = mix[c];
+            comp.stats = statsFromMoments(s);
+            comp.weight = s[0] / static_cast<double>(n);
+            comp.mean = comp.stats.mean;
+            comp.cov = flooredCovariance(comp.stats);
+        }
+
+        if (logLik - prevLogLik < EM_TOLERANCE * static_cast<double>(n))
+            break;
+        prevLogLik = logLik;
+    }
+
+    for (auto &comp : mix)
+        factor(comp);
+    _mixture = std::move(mix);
+}
+
+// Start new components at colours far from every existing one while the
+// mixture has fewer than the requested number.
+void Model::seedComponents(const Palette &palette) {
+    for (const auto &sw : palette._swatches) {
+        if (_mixture.size() >= static_cast<std::size_t>(_components))
+            return;
+        LAB x = Colour::fromImVec4(sw._colour).lab;
+        bool near = false;
+        for (const auto &c : _mixture) {
+            double dL = x.L - c.mean.L;
+            double da = x.a - c.mean.a;
+            double db = x.b - c.mean.b;
+            near = near || dL * dL + da * da + db * db <
+                               SEED_SPACING * SEED_SPACING;
+        }
+        if (near)
+            continue;
+        MixtureComponent c;
+        c.weight = 0.0;
+        c.mean = x;
+        const double v = DEFAULT_STDEV * DEFAULT_STDEV;
+        c.cov = {v, 0.0, 0.0, 0.0, v, 0.0, 0.0, 0.0, v};
+        factor(c);
+        _mixture.push_back(c);
+    }
+}
+
+Model::Accumulator Model::accumulate(std::span<const Palette> palettes) const {
+    Accumulator acc;
+    const std::size_t k = _mixture.size();
+    acc.components.resize(k);
+    std::vector<Precision> prec(k);
+    for (std::size_t c = 0; c < k; ++c) {
+        // Newly seeded components have no weight yet; give them an equal
+        // share so they can claim the colours nearest to them.
+        MixtureComponent comp = _mixture[c];
+        if (comp.weight <= 0.0)
+            comp.weight = 1.0 / static_cast<double>(k);
+        prec[c] = precision(comp);
+    }
+
+    std::vector<double> logp(k);
+    for (const auto &pal : palettes) {
+        for (const auto &sw : pal._swatches) {
+            LAB x = Colour::fromImVec4(sw._colour).lab;
+            acc.overall.add(x);
+            if (k == 0)
+                continue;
+            logDensities(x, prec, logp);
+            double peak = *std::max_element(logp.begin(), logp.end());
+            double total = 0.0;
+            for (auto &v : logp) {
+                v = std::exp(v - peak);
+                total += v;
+            }
+            for (std::size_t c = 0; c < k; ++c)
+                acc.components[c].add(x, logp[c] / total);
+        }
+    }
+    return acc;
+}
+
+void Model::absorb(const Accumulator &acc) {
+    _overall.merge(acc.overall);
+    for (std::size_t c = 0; c < acc.components.size() && c < _mixture.size();
+         ++c)
+        _mixture[c].stats.merge(acc.components[c]);
+    refresh();
+}
+
+// Recompute every component's parameters from its statistics.
+void Model::refresh() {
+    double total = 0.0;
+    for (const auto &c : _mixture)
+        total += c.stats.weight;
+    for (auto &c : _mixture) {
+        if (c.stats.weight <= 0.0)
+            continue;
+        c.weight = c.stats.weight / total;
+        c.mean = c.stats.mean;
+        c.cov = flooredCovariance(c.stats);
+        factor(c);
+    }
+    _trained = _overall.weight > 0.0;
+}
+
+// Queue palettes for the neighbour index and transition counts. Nothing is
+// rebuilt here, so ingesting one palette at a time stays cheap.
+void Model::remember(std::span<const Palette> palettes, bool replace) {
+    if (replace) {
+        _index.reset();
+        _transitions.reset();
+        _pending.clear();
+        _pendingStart.assign(1, 0);
+    }
+    for (const auto &pal : palettes) {
+        for (const auto &sw : pal._swatches)
+            _pending.push_back(Colour::fromImVec4(sw._colour).lab);
+        _pendingStart.push_back(static_cast<std::uint32_t>(_pending.size()));
+    }
+}
+
+// Append the pending palettes and rebuild once. The index and transitions
+// are updated in place unless another copy of the model still shares them.
+void Model::updateIndex() {
+    if (_pendingStart.size() == 1)
+        return;
+    if (!_index)
+        _index = std::make_shared<PaletteIndex>();
+    else if (_index.use_count() > 1)
+        _index = std::make_shared<PaletteIndex>(*_index);
+    if (!_transitions)
+        _transitions = std::make_shared<TransitionModel>();
+    else if (_transitions.use_count() > 1)
+        _transitions = std::make_shared<TransitionModel>(*_transitions);
+
+    const std::span<const LAB> all(_pending);
+    for (std::size_t p = 0; p + 1 < _pendingStart.size(); ++p) {
+        auto cols = all.subspan(_pendingStart[p],
+                                _pendingStart[p + 1] - _pendingStart[p]);
+        _index->add(cols);
+        _transitions->add(cols);
+    }
+    _index->build();
+    _transitions->build();
+    _pending.clear();
+    _pendingStart.assign(1, 0);
+}
+
+void Model::ingest(const Palette &palette) {
+    ingest(std::span<const Palette>(&palette, 1));
+}
+
+void Model::ingest(std::span<const Palette> palettes) {
+    if (palettes.empty())
+        return;
+    remember(palettes, false);
+
+    // Grow the mixture one palette at a time; once it is complete the
+    // remaining palettes are independent and can be split into shards.
+    std::size_t first = 0;
+    while (first < palettes.size() &&
+           _mixture.size() < static_cast<std::size_t>(_components)) {
+        const Palette &p = palettes[first++];
+        seedComponents(p);
+        absorb(accumulate({&p, 1}));
+    }
+    auto rest = palettes.subspan(first);
+    if (rest.empty())
+        return;
+
+    const std::size_t shards = (rest.size() + SHARD_PALETTES - 1) /
+                               SHARD_PALETTES;
+    std::vector<Accumulator> parts(shards);
+    ThreadPool::shared().parallelFor(shards, [&](std::size_t i) {
+        std::size_t begin = i * SHARD_PALETTES;
+        std::size_t len = std::min(SHARD_PALETTES, rest.size() - begin);
+        parts[i] = accumulate(rest.subspan(begin, len));
+    });
+    Accumulator acc;
+    for (const auto &p : parts)
+        acc.merge(p);
+    absorb(acc);
+}
+
+std::vector<Palette> Model::ingestNew(std::span<const Palette> palettes) {
+    std::vector<Palette> fresh;
+    for (const auto &pal : palettes)
+        if (_learned.insert(paletteKey(pal)).second)
+            fresh.push_back(pal);
+    ingest(std::span<const Palette>(fresh));
+    return fresh;
+}
+
+std::size_t Model::ingestStream(std::istream &in) {
+    std::size_t count = 0;
+    std::vector<Palette> batch;
+    batch.reserve(STREAM_BATCH);
+    auto flush = [&] {
+        ingest(std::span<const Palette>(batch));
+        count += batch.size();
+        batch.clear();
+    };
+
+    in >> std::ws;
+    if (in.peek() == '[') {
+        // Convert each element of the top-level array as soon as it has
+        // been parsed and tell the parser to discard it.
+        json::parser_callback_t cb = [&](int depth, json::parse_event_t ev,
+                                         json &parsed) {
+            if (depth == 1 && ev == json::parse_event_t::object_end) {
+                batch.push_back(parsed.get<Palette>());
+                if (batch.size() >= STREAM_BATCH)
+                    flush();
+                return false;
+            }
+            return true;
+        };
+        // Every element was discarded, leaving only an empty array.
+        [[maybe_unused]] json rest = json::parse(in, cb);
+    } else {
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            batch.push_back(json::parse(line).get<Palette>());
+            if (batch.size() >= STREAM_BATCH)
+                flush();
+        }
+    }
+    flush();
+    updateIndex();
+    return count;
 }
 
-// Sample new colours from the learned distribution.
-std::vector<Swatch> Model::suggest(std::size_t count) {
+// Draw from the swatches of the training palettes closest to the locked
+// colours. In each neighbour the swatch nearest to every locked colour is
+// the match itself and is skipped; the rest are weighted by how well the
+// palette matched.
+std::vector<Swatch> Model::suggestNear(std::size_t count,
+                                       std::span<const LAB> locked,
+                                       std::mt19937_64 &rng) const {
     std::vector<Swatch> result;
+    std::vector<LAB> pool;
+    std::vector<double> weights;
+    for (const auto &m : _index->nearest(locked, NEIGHBOURS)) {
+        auto cols = _index->palette(m.palette);
+        std::vector<bool> matched(cols.size(), false);
+        for (const auto &q : locked) {
+            std::size_t best = cols.size();
+            double bestD = std::numeric_limits<double>::infinity();
+            for (std::size_t i = 0; i < cols.size(); ++i) {
+                double dL = q.L - cols[i].L;
+                double da = q.a - cols[i].a;
+                double db = q.b - cols[i].b;
+                double d = dL * dL + da * da + db * db;
+                if (!matched[i] && d < bestD) {
+                    bestD = d;
+                    best = i;
+                }
+            }
+            if (best < cols.size())
+                matched[best] = true;
+        }
+        for (std::size_t i = 0; i < cols.size(); ++i) {
+            if (matched[i])
+                continue;
+            pool.push_back(cols[i]);
+            weights.push_back(1.0 / (m.score + SCORE_EPS));
+        }
+    }
+    if (pool.empty())
+        return result;
+
+    std::discrete_distribution<std::size_t> pick(weights.begin(),
+                                                 weights.end());
+    std::normal_distribution<double> jitter(0.0, NEIGHBOUR_JITTER);
     result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const LAB &src = pool[pick(rng)];
+        Colour c;
+        c.lab = {std::clamp(src.L + jitter(rng), 0.0, 1.0),
+                 std::clamp(src.a + jitter(rng), -1.0, 1.0),
+                 std::clamp(src.b + jitter(rng), -1.0, 1.0)};
+        c.alpha = 1.0;
+        Swatch sw;
+        sw._colour = c.toImVec4();
+        sw._locked = false;
+        result.push_back(sw);
+    }
+    return result;
+}
 
-    std::normal_distribution<double> nL(_mean.L,
-                                        _stdev.L > 0 ? _stdev.L : 0.05);
-    std::normal_distribution<double> nA(_mean.a,
-                                        _stdev.a > 0 ? _stdev.a : 0.05);
-    std::normal_distribution<double> nB(_mean.b,
-                                        _stdev.b > 0 ? _stdev.b : 0.05);
+// Sample new colours near the locked ones if possible, otherwise from the
+// learned mixture.
+std::vector<Swatch> Model::suggest(std::size_t count,
+                                   std::span<const LAB> locked) {
+    updateIndex();
+    return suggest(count, locked, _rng);
+}
+
+std::vector<Swatch> Model::suggest(std::size_t count,
+                                   std::span<const LAB> locked,
+                                   std::mt19937_64 &rng) const {
+    if (_ordered && _transitions && !_transitions->empty()) {
+        std::vector<Swatch> result;
+        for (const auto &lab : _transitions->walk(count, locked, rng)) {
+            Colour c;
+            c.lab = lab;
+            c.alpha = 1.0;
+            Swatch sw;
+            sw._colour = c.toImVec4();
+            sw._locked = false;
+            result.push_back(sw);
+        }
+        return result;
+    }
+    if (!locked.empty() && _index && _index->size() > 0) {
+        auto near = suggestNear(count, locked, rng);
+        if (!near.empty())
+            return near;
+    }
+
+    std::vector<Swatch> result;
+    result.reserve(count);
+
+    std::vector<double> weights;
+    weights.reserve(_mixture.size());
+    for (const auto &c : _mixture)
+        weights.push_back(c.weight);
+    std::discrete_distribution<std::size_t> pick(weights.begin(),
+                                                 weights.end());
+    std::normal_distribution<double> unit(0.0, 1.0);
 
     std::uniform_real_distribution<double> unifL(0.0, 1.0);
     std::uniform_real_distribution<double> unifA(-0.5, 0.5);
 
     for (std::size_t i = 0; i < count; ++i) {
         double L, a, b;
-        if (_trained) {
-            L = std::clamp(nL(_rng), 0.0, 1.0);
-            a = std::clamp(nA(_rng), -1.0, 1.0);
-            b = std::clamp(nB(_rng), -1.0, 1.0);
+        if (_trained && !_mixture.empty()) {
+            const auto &c = _mixture[pick(rng)];
+            const auto &l = c.chol;
+            double z0 = unit(rng);
+            double z1 = unit(rng);
+            double z2 = unit(rng);
+            L = std::clamp(c.mean.L + l[0] * z0, 0.0, 1.0);
+            a = std::clamp(c.mean.a + l[3] * z0 + l[4] * z1, -1.0, 1.0);
+            b = std::clamp(c.mean.b + l[6] * z0 + l[7] * z1 + l[8] * z2, -1.0,
+                           1.0);
         } else {
-            L = unifL(_rng);
-            a = unifA(_rng);
-            b = unifA(_rng);
+            L = unifL(rng);
+            a = unifA(rng);
+            b = unifA(rng);
         }
         Colour c;
         c.lab = {L, a, b};
@@ -85,18 +796,113 @@ std::vector<Swatch> Model::suggest(std::size_t count) {
 
 // Serialise the model to JSON for saving to disk.
 void to_json(json &j, const Model &m) {
-    j = json{{"mean", {m._mean.L, m._mean.a, m._mean.b}},
-             {"stdev", {m._stdev.L, m._stdev.a, m._stdev.b}},
-             {"trained", m._trained}};
+    json comps = json::array();
+    for (const auto &c : m._mixture) {
+        comps.push_back({{"weight", c.weight},
+                         {"mean", {c.mean.L, c.mean.a, c.mean.b}},
+                         {"cov", c.cov},
+                         {"count", c.stats.weight}});
+    }
+    const LAB sd = m._overall.stdev();
+    j = json{{"mean", {m._overall.mean.L, m._overall.mean.a,
+                       m._overall.mean.b}},
+             {"stdev", {sd.L, sd.a, sd.b}},
+             {"trained", m._trained},
+             {"count", m._overall.weight},
+             {"componentCount", m._components},
+             {"components", comps},
+             {"ordered", m._ordered}};
+    // Learned keys only make sense next to the palettes they stand for.
+    if (m._savePalettes && !m._learned.empty())
+        j["learned"] = m._learned;
+    if (m._pendingStart.size() == 1) {
+        if (m._transitions)
+            j["transitions"] = *m._transitions;
+        if (m._savePalettes && m._index)
+            j["palettes"] = *m._index;
+        return;
+    }
+
+    // Palettes still pending are written as if they had been indexed.
+    Model settled = m;
+    settled.updateIndex();
+    j["transitions"] = *settled._transitions;
+    if (m._savePalettes)
+        j["palettes"] = *settled._index;
 }
 
-// Restore model state from JSON.
+// Restore model state from JSON. Files written before the mixture was
+// added become a single diagonal component built from the mean and stdev.
+// Statistics are rebuilt from the stored moments so later ingest() calls
+// continue from where the saved model left off.
 void from_json(const json &j, Model &m) {
     auto mean = j.at("mean");
-    m._mean = {mean.at(0), mean.at(1), mean.at(2)};
     auto sd = j.at("stdev");
-    m._stdev = {sd.at(0), sd.at(1), sd.at(2)};
+    LAB mu{mean.at(0), mean.at(1), mean.at(2)};
+    LAB dev{sd.at(0), sd.at(1), sd.at(2)};
     j.at("trained").get_to(m._trained);
+    if (j.contains("componentCount"))
+        m.setComponents(j.at("componentCount").get<int>());
+
+    double count = j.value("count", m._trained ? 1.0 : 0.0);
+    m._overall = {};
+    m._overall.weight = count;
+    m._overall.mean = mu;
+    m._overall.m2 = {dev.L * dev.L * count, 0.0, 0.0,
+                     dev.a * dev.a * count, 0.0, dev.b * dev.b * count};
+
+    auto restore = [](MixtureComponent &c, double weight) {
+        c.stats.weight = weight;
+        c.stats.mean = c.mean;
+        const auto &v = c.cov;
+        c.stats.m2 = {(v[0] - COV_FLOOR) * weight, v[1] * weight,
+                      v[2] * weight,        (v[4] - COV_FLOOR) * weight,
+                      v[5] * weight,        (v[8] - COV_FLOOR) * weight};
+    };
+
+    m._mixture.clear();
+    if (j.contains("components")) {
+        for (const auto &jc : j.at("components")) {
+            MixtureComponent c;
+            jc.at("weight").get_to(c.weight);
+            auto cm = jc.at("mean");
+            c.mean = {cm.at(0), cm.at(1), cm.at(2)};
+            jc.at("cov").get_to(c.cov);
+            restore(c, jc.value("count", c.weight * count));
+            m._mixture.push_back(c);
+        }
+    } else if (m._trained) {
+        auto var = [](double s) {
+            double v = s > 0.0 ? s : DEFAULT_STDEV;
+            return v * v + COV_FLOOR;
+        };
+        MixtureComponent c;
+        c.mean = mu;
+        c.cov = {var(dev.L), 0.0, 0.0, 0.0, var(dev.a), 0.0,
+                 0.0, 0.0, var(dev.b)};
+        restore(c, count);
+        m._mixture.push_back(c);
+    }
+    for (auto &c : m._mixture)
+        factor(c);
+
+    m._ordered = j.value("ordered", false);
+    m._learned.clear();
+    if (j.contains("learned") && j.contains("palettes"))
+        j.at("learned").get_to(m._learned);
+    m._pending.clear();
+    m._pendingStart.assign(1, 0);
+    m._transitions.reset();
+    if (j.contains("transitions"))
+        m._transitions = std::make_shared<TransitionModel>(
+            j.at("transitions").get<TransitionModel>());
+
+    // A model saved without its palettes keeps leaving them out.
+    m._savePalettes = j.contains("palettes");
+    m._index.reset();
+    if (m._savePalettes)
+        m._index = std::make_shared<PaletteIndex>(
+            j.at("palettes").get<PaletteIndex>());
 }
 
 } // namespace uc
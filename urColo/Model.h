@@ -1,20 +1,166 @@
 // urColo - colour learning model
 #pragma once
 #include "Colour.h"
+#include "PaletteIndex.h"
+#include "TransitionModel.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <memory>
 #include <random>
+#include <span>
+#include <unordered_set>
 #include <vector>
 
 namespace uc {
-// Simple model storing colour statistics learned from palettes.
+// Weighted running mean and co-moments of OKLab colours (Welford's method).
+// Two accumulators built from separate data can be merged exactly, so work
+// can be split into shards and combined afterwards.
+//
+// Member variables:
+// - `weight` Total weight of the colours added.
+// - `mean`   Weighted mean.
+// - `m2`     Sums of weighted products of deviations, ordered LL, La, Lb,
+//            aa, ab, bb.
+struct ColourStats {
+    double weight{0.0};
+    LAB mean{};
+    std::array<double, 6> m2{};
+
+    // Add one colour with the given weight.
+    void add(const LAB &x, double w = 1.0);
+    // Combine with statistics gathered from other colours.
+    void merge(const ColourStats &other);
+    // Row-major 3x3 covariance; zero when nothing has been added.
+    [[nodiscard]] std::array<double, 9> covariance() const;
+    // Standard deviation of each channel.
+    [[nodiscard]] LAB stdev() const;
+};
+
+// One full-covariance Gaussian of the learned mixture, in OKLab.
+//
+// Member variables:
+// - `weight` Mixing proportion; the weights of a mixture sum to one.
+// - `mean`   Centre of the component.
+// - `cov`    Row-major 3x3 covariance matrix over (L, a, b).
+// - `chol`   Lower-triangular Cholesky factor of `cov`, used for sampling.
+// - `stats`  Responsibility-weighted statistics the parameters come from.
+struct MixtureComponent {
+    double weight{1.0};
+    LAB mean{};
+    std::array<double, 9> cov{};
+    std::array<double, 9> chol{};
+    ColourStats stats;
+};
+
+// Model of colour preferences learned from palettes marked as good.
+//
+// Swatch colours are fitted with a Gaussian mixture in OKLab, so distinct
+// palette styles end up in separate components rather than being averaged
+// together. train() fits from scratch by expectation-maximisation; ingest()
+// updates the fit incrementally from new palettes without revisiting old
+// ones. The overall mean and standard deviation are kept alongside.
+//
+// The training palettes themselves are kept in a nearest-neighbour index so
+// suggestions can follow the palettes that best match any locked colours.
+// Ingested palettes are appended to a pending buffer and folded into the
+// index, and into the optional transition model that learns palette order,
+// only when a suggestion next needs them. Both are shared between copies of
+// the model and copied only when a shared one has to be updated.
 class Model {
   public:
+    // Statistics gathered from a batch of palettes against a fixed mixture,
+    // ready to be folded into the model.
+    struct Accumulator {
+        ColourStats overall;
+        std::vector<ColourStats> components;
+        // Combine with an accumulator built against the same mixture.
+        void merge(const Accumulator &other);
+    };
+
     explicit Model(std::uint64_t seed = 0);
 
-    // Update the model using a set of good palettes.
+    // Refit the model from scratch using a set of good palettes.
     void train(const std::vector<Palette> &goodPalettes);
 
-    // Suggest a number of colours sampled from the learned distribution.
-    std::vector<Swatch> suggest(std::size_t count);
+    // Update the model with one more good palette. Until the mixture has
+    // its full number of components, sufficiently new colours start
+    // components of their own.
+    void ingest(const Palette &palette);
+    // Update the model with a batch of palettes. The batch is split into
+    // shards that are accumulated in parallel and then merged.
+    void ingest(std::span<const Palette> palettes);
+    // Ingest the palettes not already given to this call or to train(),
+    // recognised by their swatch colours, so a palette can stay marked as
+    // good without being learned twice.
+    //
+    // \return The palettes that were ingested.
+    std::vector<Palette> ingestNew(std::span<const Palette> palettes);
+    // Ingest every palette read from `in`, either a JSON array of palettes
+    // or JSON Lines with one palette per line. Palettes are parsed and
+    // ingested in batches, so the whole corpus is never held in memory.
+    //
+    // \return Number of palettes ingested.
+    std::size_t ingestStream(std::istream &in);
+
+    // Gather statistics for `palettes` under the current mixture without
+    // changing the model. Safe to call from several threads at once.
+    [[nodiscard]] Accumulator accumulate(std::span<const Palette> palettes)
+        const;
+    // Fold accumulated statistics into the model and update its mixture.
+    void absorb(const Accumulator &acc);
+
+    // Suggest `count` new colours. In ordered mode they continue the
+    // palette from the last locked colour along learned transitions. With
+    // `locked` colours, they are otherwise drawn from the other swatches of
+    // the training palettes that best match the locked ones. When neither
+    // applies they are sampled from the mixture.
+    std::vector<Swatch> suggest(std::size_t count,
+                                std::span<const LAB> locked = {});
+    // As above, but drawing from `rng` and leaving the model untouched, so
+    // one model can serve several generators at once. Palettes ingested
+    // since the last updateIndex() are not consulted.
+    [[nodiscard]] std::vector<Swatch>
+    suggest(std::size_t count, std::span<const LAB> locked,
+            std::mt19937_64 &rng) const;
+
+    // Restart the sampling stream from `seed`.
+    void reseed(std::uint64_t seed) { _rng.seed(seed); }
+
+    // Set the number of mixture components used by train() and by ingest()
+    // while the mixture is still growing. Fewer are fitted when there are
+    // not enough distinct colours.
+    void setComponents(int count) { _components = std::max(1, count); }
+    // Number of components the model aims for.
+    [[nodiscard]] int components() const { return _components; }
+    // Components of the fitted mixture; empty until trained.
+    [[nodiscard]] const std::vector<MixtureComponent> &mixture() const {
+        return _mixture;
+    }
+    // Total weight of the colours the model has learned from.
+    [[nodiscard]] double colourCount() const { return _overall.weight; }
+    // Follow learned swatch-to-swatch transitions when suggesting.
+    void setOrdered(bool ordered) { _ordered = ordered; }
+    [[nodiscard]] bool ordered() const { return _ordered; }
+    // Number of training palettes kept for locked-colour suggestions.
+    [[nodiscard]] std::size_t paletteCount() const {
+        return (_index ? _index->size() : 0) + _pendingStart.size() - 1;
+    }
+    // Fold palettes ingested since the last call into the neighbour index
+    // and transition model. suggest() does this itself; call it before
+    // copying the model so the copies do not each build their own.
+    void updateIndex();
+    // Whether palettes are waiting to be folded in by updateIndex().
+    [[nodiscard]] bool indexPending() const {
+        return _pendingStart.size() > 1;
+    }
+    // Write the training palettes into saved models. They are saved by
+    // default so a reloaded model still follows locked swatches; a model
+    // saved without them suggests from the mixture alone and forgets which
+    // palettes ingestNew() has already learned.
+    void setSavePalettes(bool save) { _savePalettes = save; }
+    [[nodiscard]] bool savePalettes() const { return _savePalettes; }
 
     // Serialise model state to JSON.
     friend void to_json(nlohmann::json &j, const Model &m);
@@ -22,9 +168,24 @@ class Model {
     friend void from_json(const nlohmann::json &j, Model &m);
 
   private:
-    LAB _mean{};
-    LAB _stdev{};
+    void seedComponents(const Palette &palette);
+    void refresh();
+    void remember(std::span<const Palette> palettes, bool replace);
+    std::vector<Swatch> suggestNear(std::size_t count,
+                                    std::span<const LAB> locked,
+                                    std::mt19937_64 &rng) const;
+
+    ColourStats _overall;
     bool _trained{false};
+    int _components{4};
+    std::vector<MixtureComponent> _mixture;
+    std::shared_ptr<PaletteIndex> _index;
+    std::shared_ptr<TransitionModel> _transitions;
+    std::vector<LAB> _pending;                   //< Colours not yet indexed
+    std::vector<std::uint32_t> _pendingStart{0}; //< Offset of each palette
+    std::unordered_set<std::uint64_t> _learned; //< Keys from ingestNew()
+    bool _ordered{false};
+    bool _savePalettes{true};
     std::mt19937_64 _rng;
 };
 } // namespace uc
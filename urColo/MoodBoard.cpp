@@ -0,0 +1,211 @@
+// urColo - weighted multi-image k-means input
+#include "MoodBoard.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <bit>
+
+namespace {
+using namespace uc;
+
+// Range of a and b covered by the histogram grid. Nearly every sRGB colour
+// lies within it; the rest fall into the edge cells.
+constexpr double AB_RANGE = 0.4;
+
+// Total cells in the histogram grid.
+constexpr std::size_t GRID_CELLS =
+    std::size_t{ColourHistogram::kCells} * ColourHistogram::kCells *
+    ColourHistogram::kCells;
+
+// Weighted counts at or below this are treated as empty. Removing an image
+// subtracts what adding it added, which can leave rounding residue behind.
+constexpr double EMPTY_COUNT = 1e-12;
+
+std::uint32_t cellOf(double v, double lo, double hi) {
+    double t = (v - lo) / (hi - lo) * ColourHistogram::kCells;
+    return static_cast<std::uint32_t>(
+        std::clamp(static_cast<int>(t), 0, ColourHistogram::kCells - 1));
+}
+
+std::uint32_t gridIndex(float L, float a, float b) {
+    constexpr auto cells = static_cast<std::uint32_t>(ColourHistogram::kCells);
+    return (cellOf(L, 0.0, 1.0) * cells + cellOf(a, -AB_RANGE, AB_RANGE)) *
+               cells +
+           cellOf(b, -AB_RANGE, AB_RANGE);
+}
+} // namespace
+
+namespace uc {
+
+// The downsampled planes are binned in one pass; at the default budget
+// that takes well under the time spent converting them.
+ColourHistogram histogramOf(SharedImage img, std::size_t pixelBudget) {
+    ColourHistogram hist;
+    if (!img || img->empty())
+        return hist;
+    hist.fingerprint =
+        img->fingerprint != 0 ? img->fingerprint : fingerprintImage(*img);
+    img = downsampleImage(std::move(img), pixelBudget);
+    auto planes = img->lab();
+    const LabPlanes &p = *planes;
+    hist.pixels = p.size();
+
+    std::vector<LAB> sums(GRID_CELLS);
+    std::vector<double> counts(GRID_CELLS);
+    for (std::size_t i = 0; i < p.size(); ++i) {
+        const std::uint32_t c = gridIndex(p.L[i], p.a[i], p.b[i]);
+        sums[c].L += p.L[i];
+        sums[c].a += p.a[i];
+        sums[c].b += p.b[i];
+        counts[c] += 1.0;
+    }
+    for (std::size_t c = 0; c < GRID_CELLS; ++c) {
+        if (counts[c] == 0.0)
+            continue;
+        hist.cells.push_back(static_cast<std::uint32_t>(c));
+        hist.sums.push_back(sums[c]);
+        hist.counts.push_back(counts[c]);
+    }
+    return hist;
+}
+
+// Each histogram keeps its pixel counts, scaled back up by whatever its
+// image was downsampled by.
+std::shared_ptr<const WeightedColours>
+pooledColours(std::span<const SharedImage> images, std::size_t pixelBudget) {
+    std::vector<ColourHistogram> hists(images.size());
+    ThreadPool::shared().parallelFor(images.size(), [&](std::size_t i) {
+        hists[i] = histogramOf(images[i], pixelBudget);
+    });
+
+    std::vector<LAB> sums(GRID_CELLS);
+    std::vector<double> counts(GRID_CELLS);
+    std::uint64_t id = 0;
+    for (std::size_t i = 0; i < hists.size(); ++i) {
+        const ColourHistogram &h = hists[i];
+        if (h.pixels == 0)
+            continue;
+        const double scale = static_cast<double>(images[i]->pixelCount()) /
+                             static_cast<double>(h.pixels);
+        for (std::size_t j = 0; j < h.cells.size(); ++j) {
+            const std::uint32_t c = h.cells[j];
+            sums[c].L += h.sums[j].L * scale;
+            sums[c].a += h.sums[j].a * scale;
+            sums[c].b += h.sums[j].b * scale;
+            counts[c] += h.counts[j] * scale;
+        }
+        id = splitmix64(id ^ h.fingerprint);
+    }
+
+    auto out = std::make_shared<WeightedColours>();
+    for (std::size_t c = 0; c < GRID_CELLS; ++c) {
+        if (counts[c] == 0.0)
+            continue;
+        out->colours.push_back({sums[c].L / counts[c], sums[c].a / counts[c],
+                                sums[c].b / counts[c]});
+        out->weights.push_back(counts[c]);
+    }
+    // 0 is reserved for no input.
+    out->fingerprint =
+        out->colours.empty() ? 0 : std::max<std::uint64_t>(id, 1);
+    return out;
+}
+
+bool MoodBoard::add(ColourHistogram hist, double weight) {
+    if (hist.empty() || hist.pixels == 0 || !(weight > 0.0))
+        return false;
+    remove(hist.fingerprint);
+    if (_counts.empty()) {
+        _sums.assign(GRID_CELLS, LAB{});
+        _counts.assign(GRID_CELLS, 0.0);
+    }
+    _entries.push_back({std::move(hist), weight});
+    merge(_entries.back(), 1.0);
+    return true;
+}
+
+bool MoodBoard::remove(std::uint64_t fingerprint) {
+    auto it = std::find_if(_entries.begin(), _entries.end(),
+                           [fingerprint](const Entry &e) {
+                               return e.hist.fingerprint == fingerprint;
+                           });
+    if (it == _entries.end())
+        return false;
+    merge(*it, -1.0);
+    _entries.erase(it);
+    // Start again from exact zeros rather than accumulated residue.
+    if (_entries.empty())
+        clear();
+    return true;
+}
+
+bool MoodBoard::setWeight(std::uint64_t fingerprint, double weight) {
+    if (!(weight > 0.0))
+        return false;
+    for (auto &e : _entries) {
+        if (e.hist.fingerprint != fingerprint)
+            continue;
+        if (e.weight != weight) {
+            merge(e, -1.0);
+            e.weight = weight;
+            merge(e, 1.0);
+        }
+        return true;
+    }
+    return false;
+}
+
+double MoodBoard::weight(std::uint64_t fingerprint) const {
+    for (const auto &e : _entries)
+        if (e.hist.fingerprint == fingerprint)
+            return e.weight;
+    return 0.0;
+}
+
+void MoodBoard::clear() {
+    _entries.clear();
+    _sums.clear();
+    _counts.clear();
+    _colours.reset();
+}
+
+// Each pixel of an image counts weight / pixels, so every image adds its
+// weight in total whatever its size.
+void MoodBoard::merge(const Entry &entry, double sign) {
+    const ColourHistogram &h = entry.hist;
+    const double scale =
+        sign * entry.weight / static_cast<double>(h.pixels);
+    for (std::size_t i = 0; i < h.cells.size(); ++i) {
+        const std::uint32_t c = h.cells[i];
+        _sums[c].L += h.sums[i].L * scale;
+        _sums[c].a += h.sums[i].a * scale;
+        _sums[c].b += h.sums[i].b * scale;
+        _counts[c] += h.counts[i] * scale;
+    }
+    _colours.reset();
+}
+
+std::shared_ptr<const WeightedColours> MoodBoard::colours() const {
+    if (_colours)
+        return _colours;
+    auto out = std::make_shared<WeightedColours>();
+    for (std::size_t c = 0; c < _counts.size(); ++c) {
+        const double n = _counts[c];
+        if (n <= EMPTY_COUNT)
+            continue;
+        out->colours.push_back({_sums[c].L / n, _sums[c].a / n,
+                                _sums[c].b / n});
+        out->weights.push_back(n);
+    }
+    // The images and their weights identify the colours; 0 is reserved for
+    // no input.
+    std::uint64_t id = 0;
+    for (const auto &e : _entries)
+        id ^= splitmix64(e.hist.fingerprint ^
+                         splitmix64(std::bit_cast<std::uint64_t>(e.weight)));
+    out->fingerprint = _entries.empty() ? 0 : std::max<std::uint64_t>(id, 1);
+    _colours = std::move(out);
+    return _colours;
+}
+
+} // namespace uc
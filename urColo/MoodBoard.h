@@ -0,0 +1,116 @@
+// urColo - weighted multi-image k-means input
+#pragma once
+#include "Colour.h"
+#include "ImageUtils.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace uc {
+// OKLab histogram of one image: the occupied cells of a regular grid over
+// OKLab, each with the sum of the colours that fell into it, so the mean
+// colour of a cell is kept rather than snapped to its centre.
+//
+// Member variables:
+// - `fingerprint` Fingerprint of the image it was built from.
+// - `pixels`      Number of pixels binned.
+// - `cells`       Grid index of each occupied cell, ascending.
+// - `sums`        Sum of the OKLab colours in each cell.
+// - `counts`      Pixels in each cell.
+struct ColourHistogram {
+    // Cells along each axis of the grid.
+    static constexpr int kCells = 32;
+
+    std::uint64_t fingerprint{0};
+    std::size_t pixels{0};
+    std::vector<std::uint32_t> cells;
+    std::vector<LAB> sums;
+    std::vector<double> counts;
+
+    [[nodiscard]] bool empty() const { return cells.empty(); }
+};
+
+// Bin the pixels of an image into a ColourHistogram. Images over
+// `pixelBudget` are downsampled first, as they would be for k-means; 0
+// bins every pixel.
+[[nodiscard]] ColourHistogram
+histogramOf(SharedImage img, std::size_t pixelBudget = kDefaultPixelBudget);
+
+// Colours to cluster, each with a weight. Shaped like Superpixels, so the
+// colours and weights can be handed straight to a ClusterEngine.
+//
+// Member variables:
+// - `colours`     Mean OKLab colour of each occupied histogram cell.
+// - `weights`     Weight of each colour.
+// - `fingerprint` Identifies the images and weights the colours came from.
+struct WeightedColours {
+    std::vector<LAB> colours;
+    std::vector<double> weights;
+    std::uint64_t fingerprint{0};
+
+    [[nodiscard]] std::size_t size() const { return colours.size(); }
+    [[nodiscard]] LAB operator[](std::size_t i) const { return colours[i]; }
+};
+
+// Merge the histograms of `images` as if their pixels had been pooled into
+// one image, so larger images count for more. Used to cluster every frame
+// of an animation together without stacking the frames into one buffer.
+// The histograms are binned in parallel.
+[[nodiscard]] std::shared_ptr<const WeightedColours>
+pooledColours(std::span<const SharedImage> images,
+              std::size_t pixelBudget = kDefaultPixelBudget);
+
+// A set of reference images merged into one weighted histogram, so a
+// single palette can be built from a whole mood board without gathering
+// the pixels into one buffer. Each image contributes its weight spread
+// over its pixels, so large images do not drown out small ones.
+//
+// Histograms are added to running totals as images are added and
+// subtracted again when they are removed or reweighted, so changing one
+// image never revisits the others. The board is not thread-safe; hand
+// colours() to background work instead.
+class MoodBoard {
+  public:
+    // Add an image's histogram with `weight`, replacing any image with the
+    // same fingerprint.
+    //
+    // \return False, leaving the board unchanged, when `hist` is empty or
+    //         `weight` is not positive.
+    bool add(ColourHistogram hist, double weight = 1.0);
+    // Remove the image with `fingerprint`.
+    //
+    // \return False when no such image is on the board.
+    bool remove(std::uint64_t fingerprint);
+    // Change the weight of the image with `fingerprint`.
+    //
+    // \return False when no such image is on the board or `weight` is not
+    //         positive.
+    bool setWeight(std::uint64_t fingerprint, double weight);
+    // Weight of the image with `fingerprint`, or 0 when it is not present.
+    [[nodiscard]] double weight(std::uint64_t fingerprint) const;
+    // Remove every image.
+    void clear();
+
+    [[nodiscard]] std::size_t size() const { return _entries.size(); }
+    [[nodiscard]] bool empty() const { return _entries.empty(); }
+
+    // Merged colours of all images. Built from the running totals on the
+    // first call after a change and shared until the next one.
+    [[nodiscard]] std::shared_ptr<const WeightedColours> colours() const;
+
+  private:
+    struct Entry {
+        ColourHistogram hist;
+        double weight;
+    };
+    // Add `sign` times the weighted histogram of `entry` to the totals.
+    void merge(const Entry &entry, double sign);
+
+    std::vector<Entry> _entries; //< In the order they were added
+    std::vector<LAB> _sums;      //< Weighted colour sum per grid cell
+    std::vector<double> _counts; //< Weighted pixel count per grid cell
+    mutable std::shared_ptr<const WeightedColours> _colours;
+};
+} // namespace uc
@@ -1,12 +1,17 @@
 // urColo - palette generation algorithms
 #include "PaletteGenerator.h"
+#include "Gradient.h"
 #include "Profiling.h"
+#include "Random.h"
 
 #include <algorithm>
+#include <cmath>
 #include <numbers>
 #include <random>
 
 namespace {
+using namespace uc;
+
 // Weight factors used when generating and clustering colours. Lower weight for
 // luminance encourages more saturated results while keeping hue differences
 // significant.
@@ -35,29 +40,115 @@ constexpr double CHROMA_MAX = 0.6;
 // variety.
 constexpr double HUE_MIN = 0.0;
 constexpr double HUE_MAX = 2.0 * std::numbers::pi;
+
+// Standard deviation of the jitter applied to centres carried over from the
+// previous k-means run on the same image. Keeps consecutive generations from
+// repeating while staying close enough to converge in a few iterations.
+// Measured in clustering distance, so the L offset is divided by L_WEIGHT.
+constexpr double WARM_JITTER = 0.02;
+
+// Distance used for clustering: the luminance difference is scaled by
+// L_WEIGHT and the chroma/hue difference is the straight-line distance
+// between the two points in the a/b plane, matching the weighting used when
+// generating colours.
+constexpr WeightedMetric CLUSTER_METRIC{L_WEIGHT, CHROMA_WEIGHT};
+
 } // namespace
 
 namespace uc {
 
 PaletteGenerator::PaletteGenerator(std::uint64_t seed)
-    : _rng(seed == 0 ? std::random_device{}() : seed) {}
+    : _rng(seed == 0 ? std::random_device{}() : seed),
+      _modelRng(seed == 0 ? std::random_device{}() : deriveSeed(seed, 1)) {}
+
+void PaletteGenerator::reseed(std::uint64_t seed) {
+    _rng.seed(seed);
+    _modelRng.seed(deriveSeed(seed, 1));
+}
+
+// Every model is created non-const by make_shared, so once this copy is
+// its only owner it may be modified in place.
+Model &PaletteGenerator::model() {
+    if (_model.use_count() > 1)
+        _model = std::make_shared<Model>(*_model);
+    return const_cast<Model &>(*_model);
+}
+
+void PaletteGenerator::setKMeansImage(SharedImage img) {
+    if (!img || img->empty()) {
+        clearKMeansImage();
+        return;
+    }
+    if (_kMeansBudget != 0 && img->pixelCount() > _kMeansBudget) {
+        std::uint64_t source =
+            img->fingerprint != 0 ? img->fingerprint : fingerprintImage(*img);
+        std::lock_guard lock(_kMeansSample->mutex);
+        auto &cache = *_kMeansSample;
+        if (!cache.image || cache.source != source ||
+            cache.budget != _kMeansBudget) {
+            cache.image = downsampleImage(std::move(img), _kMeansBudget);
+            cache.source = source;
+            cache.budget = _kMeansBudget;
+        }
+        img = cache.image;
+    }
+    _kMeansFingerprint =
+        img->fingerprint != 0 ? img->fingerprint : fingerprintImage(*img);
+    _kMeansRegions.reset();
+    if (_kMeansSuperpixels != 0 && img->pixelCount() > _kMeansSuperpixels) {
+        std::lock_guard lock(_kMeansSample->mutex);
+        auto &cache = *_kMeansSample;
+        if (!cache.regions || cache.regionSource != _kMeansFingerprint ||
+            cache.regionCount != _kMeansSuperpixels) {
+            SuperpixelSettings sp;
+            sp.count = _kMeansSuperpixels;
+            cache.regions = std::make_shared<const Superpixels>(
+                segmentSuperpixels(*img, sp));
+            cache.regionSource = _kMeansFingerprint;
+            cache.regionCount = _kMeansSuperpixels;
+        }
+        _kMeansRegions = cache.regions;
+    }
+    _kMeansImage = std::move(img);
+    _kMeansRandom = {};
+    _kMeansColours.reset();
+}
 
 void PaletteGenerator::setKMeansImage(const std::vector<Colour> &img) {
-    _kMeansImage.clear();
-    _kMeansImage.reserve(img.size());
+    auto data = std::make_shared<ImageData>();
+    data->width = static_cast<int>(img.size());
+    data->height = img.empty() ? 0 : 1;
+    data->rgba.reserve(img.size() * 4);
     for (const auto &c : img) {
-        _kMeansImage.push_back(c.lab);
+        auto rgb = c.toSRGB8();
+        data->rgba.insert(data->rgba.end(), rgb.begin(), rgb.end());
+        data->rgba.push_back(static_cast<unsigned char>(
+            std::lround(std::clamp(c.alpha, 0.0, 1.0) * 255.0)));
     }
+    data->fingerprint = fingerprintImage(*data);
+    setKMeansImage(SharedImage(std::move(data)));
 }
 
-void PaletteGenerator::setKMeansRandomImage(int width, int height) {
-    _kMeansImage.clear();
-    _kMeansImage.reserve(static_cast<std::size_t>(width) * height);
-    std::uniform_real_distribution<double> Ld(LUMINANCE_MIN, LUMINANCE_MAX);
-    std::uniform_real_distribution<double> ab(-0.5, 0.5);
-    for (int i = 0; i < width * height; ++i) {
-        _kMeansImage.push_back({Ld(_rng), ab(_rng), ab(_rng)});
-    }
+void PaletteGenerator::setKMeansRandomImage(int width, int height,
+                                            std::uint64_t seed) {
+    _kMeansImage.reset();
+    _kMeansRegions.reset();
+    _kMeansColours.reset();
+    const auto w = static_cast<std::size_t>(std::max(width, 0));
+    const auto h = static_cast<std::size_t>(std::max(height, 0));
+    _kMeansRandom = {seed, w * h};
+    // The seed and size identify the samples; 0 is reserved for no image.
+    _kMeansFingerprint = std::max<std::uint64_t>(
+        splitmix64(_kMeansRandom.seed ^ _kMeansRandom.count), 1);
+}
+
+void PaletteGenerator::setKMeansColours(
+    std::shared_ptr<const WeightedColours> colours) {
+    clearKMeansImage();
+    if (!colours || colours->size() == 0)
+        return;
+    _kMeansFingerprint = colours->fingerprint;
+    _kMeansColours = std::move(colours);
 }
 
 std::vector<Swatch>
@@ -118,141 +209,128 @@ PaletteGenerator::generateRandomOffset(std::span<const Colour> lockedCols,
 
 std::vector<Swatch>
 PaletteGenerator::generateKMeans(std::span<const Colour> lockedCols,
-                                 std::size_t want) {
+                                 std::size_t want,
+                                 std::stop_token stop) {
     // Gather candidate colours that the clustering algorithm will operate on.
-    // If an image has been supplied via setKMeansImage we use every pixel
-    // converted to LCh as a sample. Otherwise we synthesise a small set of
-    // random LCh points. In both cases the caller's locked swatches are
-    // appended so they participate in centre selection and cannot be ignored.
-    // Number of random samples when no image data is provided. A modest amount
-    // keeps clustering fast while still giving reasonable variety.
-    const std::size_t randomPoints = RANDOM_POINTS;
-
-    std::vector<LCh> points;
-    if (_kMeansImage.empty()) {
-        points.reserve(randomPoints + lockedCols.size());
-        std::uniform_real_distribution<double> Ld(LUMINANCE_MIN, LUMINANCE_MAX);
-        std::uniform_real_distribution<double> Cdist(CHROMA_MIN, CHROMA_MAX);
-        std::uniform_real_distribution<double> hdist(HUE_MIN, HUE_MAX);
-        for (std::size_t i = 0; i < randomPoints; ++i) {
-            points.push_back({Ld(_rng), Cdist(_rng), hdist(_rng)});
-        }
-    } else {
-        points.reserve(_kMeansImage.size() + lockedCols.size());
-        for (const auto &p : _kMeansImage) {
-            points.push_back(toLCh(p));
-        }
+    // A shared image supplied via setKMeansImage is read through its OKLab
+    // planes, and random image samples are synthesised from their seed as
+    // they are read. Superpixels of the image, when enabled, are clustered in
+    // its place weighted by their area, and weighted colours such as those
+    // of a mood board are clustered by their weights. Otherwise we
+    // synthesise a small set of random LCh points. Locked colours are not
+    // added as samples: each sits exactly on its own fixed centre and so could
+    // never pull a movable centre towards it.
+    if (_kMeansColours)
+        return clusterPoints(*_kMeansColours, lockedCols, want, true, stop,
+                             std::span<const double>(_kMeansColours->weights));
+    if (_kMeansRegions)
+        return clusterPoints(*_kMeansRegions, lockedCols, want, true, stop,
+                             std::span<const double>(_kMeansRegions->weights));
+    if (_kMeansImage) {
+        auto planes = _kMeansImage->lab();
+        return clusterPoints(*planes, lockedCols, want, true, stop);
     }
-    for (const auto &c : lockedCols) {
-        points.push_back(c.toLCh());
+    if (_kMeansRandom.size() != 0)
+        return clusterPoints(_kMeansRandom, lockedCols, want, true, stop);
+
+    std::vector<LAB> randomPoints;
+    randomPoints.reserve(RANDOM_POINTS);
+    std::uniform_real_distribution<double> Ld(LUMINANCE_MIN, LUMINANCE_MAX);
+    std::uniform_real_distribution<double> Cdist(CHROMA_MIN, CHROMA_MAX);
+    std::uniform_real_distribution<double> hdist(HUE_MIN, HUE_MAX);
+    for (std::size_t i = 0; i < RANDOM_POINTS; ++i) {
+        LCh lch{Ld(_rng), Cdist(_rng), hdist(_rng)};
+        randomPoints.push_back(fromLCh(lch));
     }
+    return clusterPoints(std::span<const LAB>(randomPoints), lockedCols, want,
+                         false, stop);
+}
 
+template <class Points, class Weights>
+std::vector<Swatch>
+PaletteGenerator::clusterPoints(const Points &points,
+                                std::span<const Colour> lockedCols,
+                                std::size_t want, bool warmable,
+                                std::stop_token stop, Weights weights) {
     // Total number of cluster centres is locked colours plus the new colours
     // requested. Locked swatches act as fixed centres during iterations.
     const std::size_t k = lockedCols.size() + want;
-    if (k == 0)
+    if (k == 0 || points.size() == 0)
         return {};
 
-    std::vector<LCh> centres;
-    std::vector<bool> fixed;
-    centres.reserve(k);
-    fixed.reserve(k);
-    for (const auto &c : lockedCols) {
-        centres.push_back(c.toLCh());
-        fixed.push_back(true); // keep these centres fixed
+    std::vector<LAB> locked;
+    locked.reserve(lockedCols.size());
+    for (const auto &c : lockedCols)
+        locked.push_back(c.lab);
+    const ClusterEngine<WeightedMetric, Weights> engine(CLUSTER_METRIC,
+                                                        weights);
+
+    // Take the previous run's state out of the shared cache. Concurrent runs
+    // in the same slot on copies of this generator simply find it missing
+    // and start cold.
+    KMeansWarmState prev;
+    const std::pair key{_kMeansSlot, k};
+    if (warmable) {
+        std::lock_guard<std::mutex> lock(_kMeansWarm->mutex);
+        auto it = _kMeansWarm->bySlot.find(key);
+        if (it != _kMeansWarm->bySlot.end() &&
+            it->second.fingerprint == _kMeansFingerprint &&
+            it->second.clustering.assignment.size() == points.size()) {
+            prev = std::move(it->second);
+            _kMeansWarm->bySlot.erase(it);
+        }
     }
 
-    // Helper to compute the squared distance between two points in LCh space.
-    // k-means++ uses squared distances to weight the likelihood of picking
-    // a point as the next centre; this function applies the same weighting
-    // factors used elsewhere in the generator.
-    auto dist2 = [](const LCh &a, const LCh &b) {
-        double dL = (a.L - b.L) * L_WEIGHT;
-        double dh = std::remainder(a.h - b.h, HUE_MAX);
-        double term = a.C * a.C + b.C * b.C - 2.0 * a.C * b.C * std::cos(dh);
-        return dL * dL + CHROMA_WEIGHT * term;
-    };
-
-    // Choose remaining centres using k-means++: measure each point's distance
-    // to its nearest existing centre, accumulate those distances to form a
-    // probability distribution, then randomly pick a new centre proportional
-    // to that distance so far-away points are favoured.
-    std::uniform_int_distribution<std::size_t> pick(0, points.size() - 1);
-    if (centres.size() < k) {
-        centres.push_back(points[pick(_rng)]);
-        fixed.push_back(false);
-    }
-    while (centres.size() < k) {
-        std::vector<double> dist(points.size());
-        double sumDist = 0.0;
-        for (std::size_t i = 0; i < points.size(); ++i) {
-            double best = dist2(points[i], centres[0]);
-            for (std::size_t c = 1; c < centres.size(); ++c) {
-                double d = dist2(points[i], centres[c]);
-                if (d < best)
-                    best = d;
-            }
-            dist[i] = best;
-            sumDist += best;
+    Clustering cl;
+    if (!prev.clustering.centres.empty()) {
+        // Reuse the previous clustering of this image. Movable centres start
+        // from where the last run left them plus a little jitter, and the
+        // stored bounds are loosened by how far each centre moved so they
+        // remain valid without rescanning every pixel.
+        cl = std::move(prev.clustering);
+        std::normal_distribution<double> jitter(0.0, WARM_JITTER);
+        const double abScale = 1.0 / std::sqrt(CHROMA_WEIGHT);
+        std::vector<LAB> start = locked;
+        while (start.size() < k) {
+            const LAB &o = cl.centres[start.size()];
+            start.push_back({o.L + jitter(_rng) / L_WEIGHT,
+                             o.a + jitter(_rng) * abScale,
+                             o.b + jitter(_rng) * abScale});
         }
-        std::uniform_real_distribution<double> pickDist(0.0, sumDist);
-        double target = pickDist(_rng);
-        double accum = 0.0;
-        std::size_t idx = 0;
-        for (; idx < points.size(); ++idx) {
-            accum += dist[idx];
-            if (accum >= target)
-                break;
-        }
-        if (idx >= points.size())
-            idx = points.size() - 1;
-        centres.push_back(points[idx]);
-        fixed.push_back(false);
+        engine.move(cl, start);
+        cl.fixed.assign(k, false);
+        std::fill_n(cl.fixed.begin(), locked.size(), true);
+    } else {
+        // Locked colours become fixed centres; the rest are chosen with
+        // k-means++ so far-away points are favoured.
+        cl = engine.seed(points, locked, k, _rng);
     }
 
     // Run a limited number of Lloyd iterations. Each iteration assigns every
-    // point to its nearest centre, accumulates the sum of colour components for
-    // each cluster, then relocates only the movable centres to the mean of
-    // their assigned points. The count is bounded by _kMeansIterations to keep
-    // palette generation fast – full convergence is unnecessary – and centres
-    // marked as fixed are never adjusted so locked colours remain unchanged.
-    for (int iter = 0; iter < _kMeansIterations; ++iter) {
-        std::vector<LAB> sum(k);
-        std::vector<int> count(k, 0);
-        for (const auto &p : points) {
-            // Assign the sample to the closest current centre.
-            std::size_t best = 0;
-            double bestd = dist2(p, centres[0]);
-            for (std::size_t c = 1; c < centres.size(); ++c) {
-                double d = dist2(p, centres[c]);
-                if (d < bestd) {
-                    bestd = d;
-                    best = c;
-                }
-            }
-            // Accumulate sums for computing the mean of each cluster.
-            LAB plab = fromLCh(p);
-            sum[best].L += plab.L;
-            sum[best].a += plab.a;
-            sum[best].b += plab.b;
-            ++count[best];
-        }
-        // Move centres to the average of their assigned points, skipping those
-        // that are fixed or received no samples.
-        for (std::size_t c = 0; c < centres.size(); ++c) {
-            if (!fixed[c] && count[c] > 0) {
-                LAB mean{sum[c].L / count[c], sum[c].a / count[c],
-                         sum[c].b / count[c]};
-                centres[c] = toLCh(mean);
-            }
-        }
+    // point to its nearest centre then relocates only the movable centres to
+    // the mean of their assigned points. The count is bounded by
+    // _kMeansIterations to keep palette generation fast – full convergence is
+    // unnecessary – and centres marked as fixed are never adjusted so locked
+    // colours remain unchanged.
+    _kMeansLastIters = engine.refine(points, cl, _kMeansIterations, stop);
+    std::vector<LAB> centres = cl.centres;
+
+    if (warmable) {
+        std::lock_guard<std::mutex> lock(_kMeansWarm->mutex);
+        std::erase_if(_kMeansWarm->bySlot, [this](const auto &entry) {
+            return entry.second.fingerprint != _kMeansFingerprint;
+        });
+        auto &cached = _kMeansWarm->bySlot[key];
+        cached.fingerprint = _kMeansFingerprint;
+        cached.clustering = std::move(cl);
     }
 
     // Return only the centres corresponding to newly generated colours.
     std::vector<Swatch> out;
     out.reserve(want);
     for (std::size_t i = lockedCols.size(); i < centres.size(); ++i) {
-        Colour col = Colour::fromLCh(centres[i]);
+        Colour col;
+        col.lab = centres[i];
         col.alpha = 1.0;
         Swatch sw;
         PROFILE_TO_IMVEC4();
@@ -264,9 +342,15 @@ PaletteGenerator::generateKMeans(std::span<const Colour> lockedCols,
 }
 
 std::vector<Swatch>
-PaletteGenerator::generateLearned(std::span<const Colour> /*lockedCols*/,
+PaletteGenerator::generateLearned(std::span<const Colour> lockedCols,
                                   std::size_t want) {
-    return _model.suggest(want);
+    std::vector<LAB> locked;
+    locked.reserve(lockedCols.size());
+    for (const auto &c : lockedCols)
+        locked.push_back(c.lab);
+    if (_model->indexPending())
+        model().updateIndex();
+    return _model->suggest(want, locked, _modelRng);
 }
 
 std::vector<Swatch>
@@ -275,35 +359,47 @@ PaletteGenerator::generateGradient(std::span<const Colour> lockedCols,
     if (lockedCols.size() < 2)
         return generateRandomOffset(lockedCols, want);
 
-    std::vector<LCh> anchors;
+    // Anchors run from darkest to lightest; the new colours are spaced
+    // evenly by OKLab arc length along a spline through them.
+    std::vector<LAB> anchors;
     anchors.reserve(lockedCols.size());
     for (const auto &c : lockedCols) {
-        anchors.push_back(c.toLCh());
+        anchors.push_back(c.lab);
     }
     std::sort(anchors.begin(), anchors.end(),
-              [](const LCh &a, const LCh &b) { return a.L < b.L; });
+              [](const LAB &a, const LAB &b) { return a.L < b.L; });
 
     std::vector<Swatch> out;
     out.reserve(want);
+    for (const auto &lab : uc::Gradient(anchors).sample(want, false)) {
+        Colour c;
+        c.lab = lab;
+        c.alpha = 1.0;
+        Swatch sw;
+        PROFILE_TO_IMVEC4();
+        sw._colour = c.toImVec4();
+        sw._locked = false;
+        out.push_back(sw);
+    }
+    return out;
+}
+
+std::vector<Swatch>
+PaletteGenerator::generateDistinct(std::span<const Colour> lockedCols,
+                                   std::size_t want,
+                                   std::stop_token stop) {
+    std::vector<LAB> anchors;
+    anchors.reserve(lockedCols.size());
+    for (const auto &c : lockedCols)
+        anchors.push_back(c.lab);
+
+    auto found = optimiseDistinct(anchors, want, _distinct, _rng(), stop);
 
-    const std::size_t n = anchors.size();
-    if (want == 0)
-        return out;
-    const double step =
-        static_cast<double>(n - 1) / static_cast<double>(want + 1);
-    for (std::size_t i = 1; i <= want; ++i) {
-        double pos = step * static_cast<double>(i);
-        std::size_t idx = static_cast<std::size_t>(std::floor(pos));
-        if (idx >= n - 1)
-            idx = n - 2;
-        double t = pos - static_cast<double>(idx);
-        const LCh &a = anchors[idx];
-        const LCh &b = anchors[idx + 1];
-        double dh = std::remainder(b.h - a.h, HUE_MAX);
-        LCh lch{a.L + (b.L - a.L) * t, a.C + (b.C - a.C) * t, a.h + dh * t};
-        if (lch.h < HUE_MIN)
-            lch.h += HUE_MAX;
-        Colour c = Colour::fromLCh(lch);
+    std::vector<Swatch> out;
+    out.reserve(found.size());
+    for (const auto &lab : found) {
+        Colour c;
+        c.lab = lab;
         c.alpha = 1.0;
         Swatch sw;
         PROFILE_TO_IMVEC4();
@@ -315,7 +411,8 @@ PaletteGenerator::generateGradient(std::span<const Colour> lockedCols,
 }
 
 std::vector<Swatch> PaletteGenerator::generate(std::span<const Swatch> locked,
-                                               std::size_t want) {
+                                               std::size_t want,
+                                               std::stop_token stop) {
     std::vector<Colour> lockedCols;
     lockedCols.reserve(locked.size());
     for (const auto &sw : locked) {
@@ -325,11 +422,13 @@ std::vector<Swatch> PaletteGenerator::generate(std::span<const Swatch> locked,
 
     switch (_algorithm) {
     case Algorithm::KMeans:
-        return generateKMeans(lockedCols, want);
+        return generateKMeans(lockedCols, want, stop);
     case Algorithm::Gradient:
         return generateGradient(lockedCols, want);
     case Algorithm::Learned:
         return generateLearned(lockedCols, want);
+    case Algorithm::Distinct:
+        return generateDistinct(lockedCols, want, stop);
     case Algorithm::RandomOffset:
     default:
         return generateRandomOffset(lockedCols, want);
@@ -1,21 +1,39 @@
 // urColo - palette generator interface
 #pragma once
+#include "Clustering.h"
 #include "Colour.h"
+#include "DistinctOptimiser.h"
+#include "ImageUtils.h"
 #include "Model.h"
+#include "MoodBoard.h"
+#include "Superpixels.h"
+#include <map>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <span>
+#include <stop_token>
 #include <vector>
 
 namespace uc {
 struct PaletteGenerator {
     // Available palette generation algorithms.
-    enum Algorithm { RandomOffset, KMeans, Gradient, Learned };
+    enum Algorithm { RandomOffset, KMeans, Gradient, Learned, Distinct };
 
     explicit PaletteGenerator(std::uint64_t seed = 0);
 
     // Generate `want` colours using the currently selected algorithm.
+    // Iterative algorithms return their best result so far once `stop` is
+    // requested.
     std::vector<Swatch> generate(std::span<const Swatch> locked,
-                                 std::size_t want);
+                                 std::size_t want, std::stop_token stop = {});
+
+    // Restart the random streams of the generator and its model from `seed`.
+    // Copies handed to background jobs are reseeded so they do not replay
+    // the original's sequence.
+    void reseed(std::uint64_t seed);
+    // Draw a fresh seed from the generator's own stream.
+    std::uint64_t drawSeed() { return _rng(); }
 
     // Set the algorithm used when generating colours.
     void setAlgorithm(Algorithm alg) { _algorithm = alg; }
@@ -27,34 +45,168 @@ struct PaletteGenerator {
     // Get the currently configured number of k-means iterations.
     [[nodiscard]] int kMeansIterations() const { return _kMeansIterations; }
 
-    // Provide pixels for the k-means algorithm from an image.
+    // Set the search parameters used by the distinctness optimiser.
+    void setDistinctSettings(const DistinctSettings &s) { _distinct = s; }
+    // Get the current distinctness optimiser parameters.
+    [[nodiscard]] const DistinctSettings &distinctSettings() const {
+        return _distinct;
+    }
+
+    // Limit the pixels k-means clusters; larger images are downsampled when
+    // set. 0 removes the limit. Applies to images set afterwards.
+    void setKMeansPixelBudget(std::size_t pixels) { _kMeansBudget = pixels; }
+    // Get the current k-means pixel budget.
+    [[nodiscard]] std::size_t kMeansPixelBudget() const {
+        return _kMeansBudget;
+    }
+
+    // Cluster about `count` SLIC superpixels of k-means images, weighted
+    // by area, instead of their pixels. 0 clusters pixels directly. Applies
+    // to images set afterwards.
+    void setKMeansSuperpixels(std::size_t count) {
+        _kMeansSuperpixels = count;
+    }
+    // Get the current superpixel count, 0 when disabled.
+    [[nodiscard]] std::size_t kMeansSuperpixels() const {
+        return _kMeansSuperpixels;
+    }
+
+    // Provide an image for the k-means algorithm. The generator keeps a
+    // reference to the shared buffer and clusters its cached OKLab planes.
+    // Images over the pixel budget are replaced by a downsampled copy, made
+    // once and shared by generator copies that are given the same image.
+    // The same holds for its superpixels when they are enabled.
+    void setKMeansImage(SharedImage img);
+    // Provide loose pixels for the k-means algorithm. They are quantised
+    // once into a one-row 8-bit image; prefer the SharedImage overload when
+    // available.
     void setKMeansImage(const std::vector<Colour> &img);
-    // Generate a random image of the given dimensions for k-means.
-    void setKMeansRandomImage(int width, int height);
-    // Clear any previously set image data.
-    void clearKMeansImage() { _kMeansImage.clear(); }
+    // Use `width * height` random OKLab samples for k-means. Only the seed
+    // is stored; samples are synthesised as the clustering reads them, so
+    // the same seed gives the same samples.
+    void setKMeansRandomImage(int width, int height, std::uint64_t seed);
+    // As above with a seed drawn from the generator.
+    void setKMeansRandomImage(int width, int height) {
+        setKMeansRandomImage(width, height, _rng());
+    }
+    // Cluster weighted colours, such as those merged by a MoodBoard,
+    // instead of an image. The generator keeps a reference to the shared
+    // colours; an empty set clears the input.
+    void setKMeansColours(std::shared_ptr<const WeightedColours> colours);
+    // Clear any previously set image data. The warm-start state is kept so
+    // setting the same image again can still reuse it.
+    void clearKMeansImage() {
+        _kMeansImage.reset();
+        _kMeansRegions.reset();
+        _kMeansRandom = {};
+        _kMeansColours.reset();
+        _kMeansFingerprint = 0;
+    }
+    // Shared image currently used for k-means, if any. This is the
+    // downsampled copy when the image set exceeded the pixel budget.
+    [[nodiscard]] const SharedImage &kMeansImage() const {
+        return _kMeansImage;
+    }
+    // Fingerprint of the current k-means image, or 0 when none is set.
+    [[nodiscard]] std::uint64_t kMeansFingerprint() const {
+        return _kMeansFingerprint;
+    }
+    // Choose which warm-start entry k-means runs use. Copies generating
+    // different palettes side by side each take their own slot, so a
+    // palette only ever warm-starts from its own previous run, whichever
+    // thread finishes first.
+    void setKMeansSlot(std::size_t slot) { _kMeansSlot = slot; }
+    [[nodiscard]] std::size_t kMeansSlot() const { return _kMeansSlot; }
+    // Number of Lloyd iterations the most recent k-means run performed.
+    [[nodiscard]] int lastKMeansIterations() const { return _kMeansLastIters; }
 
-    // Access the underlying learned model.
-    [[nodiscard]] Model &model() { return _model; }
-    [[nodiscard]] const Model &model() const { return _model; }
+    // Access the underlying learned model. Copies of the generator share
+    // one model; mutable access first gives this copy a model of its own
+    // if it is still shared.
+    [[nodiscard]] Model &model();
+    [[nodiscard]] const Model &model() const { return *_model; }
 
   private:
     std::vector<Swatch> generateRandomOffset(std::span<const Colour> lockedCols,
                                              std::size_t want);
     // Generate colours using k-means++ seeded by any locked swatches.
     std::vector<Swatch> generateKMeans(std::span<const Colour> lockedCols,
-                                       std::size_t want);
+                                       std::size_t want,
+                                       std::stop_token stop);
+    // Cluster a set of OKLab samples with the shared clustering engine.
+    // `Points` provides size() and operator[] returning a LAB, optionally
+    // weighted by `weights`; warm-start state is used and refreshed only
+    // when `warmable` is set.
+    template <class Points, class Weights = UnitWeights>
+    std::vector<Swatch> clusterPoints(const Points &points,
+                                      std::span<const Colour> lockedCols,
+                                      std::size_t want, bool warmable,
+                                      std::stop_token stop,
+                                      Weights weights = {});
     // Generate colours using the learned model.
     std::vector<Swatch> generateLearned(std::span<const Colour> lockedCols,
                                         std::size_t want);
-    // Generate colours by interpolating locked swatches.
+    // Generate colours evenly spaced along a spline through locked swatches.
     std::vector<Swatch> generateGradient(std::span<const Colour> lockedCols,
                                          std::size_t want);
+    // Generate colours that maximise the minimum pairwise OKLab distance.
+    std::vector<Swatch> generateDistinct(std::span<const Colour> lockedCols,
+                                         std::size_t want,
+                                         std::stop_token stop);
+
+    // Clustering left behind by the previous k-means run on an image. The
+    // next run on an image with the same fingerprint and cluster count
+    // perturbs these centres and reuses the Hamerly bounds instead of
+    // reseeding with k-means++.
+    struct KMeansWarmState {
+        std::uint64_t fingerprint{0};
+        Clustering clustering;
+    };
+    // Warm-start state shared by every copy of a generator, so a run on a
+    // background copy still leaves its clustering behind for the next one.
+    // One entry is kept per slot and cluster count, so palettes generated in
+    // parallel each warm-start from their own previous run; entries for
+    // other images are dropped.
+    struct KMeansWarmCache {
+        std::mutex mutex;
+        std::map<std::pair<std::size_t, std::size_t>, KMeansWarmState>
+            bySlot;
+    };
+
+    // The most recent downsampled k-means image and what it was made from,
+    // along with the superpixels last cut from a k-means image.
+    struct KMeansSampleCache {
+        std::mutex mutex;
+        std::uint64_t source{0}; //< Fingerprint of the full image
+        std::size_t budget{0};
+        SharedImage image;
+        std::uint64_t regionSource{0}; //< Fingerprint of the clustered image
+        std::size_t regionCount{0};
+        std::shared_ptr<const Superpixels> regions;
+    };
 
     std::mt19937_64 _rng;
     Algorithm _algorithm{Algorithm::RandomOffset};
     int _kMeansIterations{5};
-    Model _model;
-    std::vector<LAB> _kMeansImage;
+    std::size_t _kMeansBudget{kDefaultPixelBudget};
+    std::size_t _kMeansSuperpixels{0};
+    DistinctSettings _distinct;
+    // Shared with copies of the generator instead of duplicated for each
+    // palette generated in parallel; each copy samples it with _modelRng.
+    std::shared_ptr<const Model> _model{std::make_shared<Model>()};
+    std::mt19937_64 _modelRng;
+    SharedImage _kMeansImage; //< Image clustered in place
+    std::shared_ptr<const Superpixels>
+        _kMeansRegions; //< Superpixels of the image, clustered instead
+    RandomLabSource _kMeansRandom; //< Random samples, made as they are read
+    std::shared_ptr<const WeightedColours>
+        _kMeansColours; //< Weighted colours, clustered instead of an image
+    std::uint64_t _kMeansFingerprint{0};
+    std::size_t _kMeansSlot{0};
+    std::shared_ptr<KMeansWarmCache> _kMeansWarm{
+        std::make_shared<KMeansWarmCache>()};
+    std::shared_ptr<KMeansSampleCache> _kMeansSample{
+        std::make_shared<KMeansSampleCache>()};
+    int _kMeansLastIters{0};
 };
 } // namespace uc
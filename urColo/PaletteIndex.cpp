@@ -0,0 +1,179 @@
+// urColo - nearest-neighbour index over training palettes
+#include "PaletteIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <unordered_set>
+
+using json = nlohmann::json;
+
+namespace {
+using namespace uc;
+
+// Nearest swatches gathered per query colour and per wanted palette. Several
+// nearby swatches often belong to the same palette, so more are fetched
+// than palettes are wanted.
+constexpr std::size_t CANDIDATES_PER_MATCH = 4;
+
+double channel(const LAB &c, std::uint8_t axis) {
+    return axis == 0 ? c.L : axis == 1 ? c.a : c.b;
+}
+
+double distance2(const LAB &a, const LAB &b) {
+    double dL = a.L - b.L;
+    double da = a.a - b.a;
+    double db = a.b - b.b;
+    return dL * dL + da * da + db * db;
+}
+} // namespace
+
+namespace uc {
+
+void PaletteIndex::add(std::span<const LAB> colours) {
+    _colours.insert(_colours.end(), colours.begin(), colours.end());
+    _start.push_back(static_cast<std::uint32_t>(_colours.size()));
+}
+
+void PaletteIndex::build() {
+    _tree.clear();
+    _tree.reserve(_colours.size());
+    for (std::size_t p = 0; p < size(); ++p)
+        for (const auto &c : palette(p))
+            _tree.push_back({c, static_cast<std::uint32_t>(p), 0});
+    build(0, _tree.size());
+}
+
+// Split [lo, hi) at its median along the channel with the widest spread.
+void PaletteIndex::build(std::size_t lo, std::size_t hi) {
+    if (hi - lo <= 1)
+        return;
+    LAB min = _tree[lo].colour;
+    LAB max = min;
+    for (std::size_t i = lo + 1; i < hi; ++i) {
+        const LAB &c = _tree[i].colour;
+        min = {std::min(min.L, c.L), std::min(min.a, c.a),
+               std::min(min.b, c.b)};
+        max = {std::max(max.L, c.L), std::max(max.a, c.a),
+               std::max(max.b, c.b)};
+    }
+    double sL = max.L - min.L;
+    double sa = max.a - min.a;
+    double sb = max.b - min.b;
+    std::uint8_t axis = sL >= sa && sL >= sb ? 0 : sa >= sb ? 1 : 2;
+
+    std::size_t mid = lo + (hi - lo) / 2;
+    auto first = _tree.begin() + static_cast<std::ptrdiff_t>(lo);
+    std::nth_element(first,
+                     _tree.begin() + static_cast<std::ptrdiff_t>(mid),
+                     _tree.begin() + static_cast<std::ptrdiff_t>(hi),
+                     [axis](const Node &x, const Node &y) {
+                         return channel(x.colour, axis) <
+                                channel(y.colour, axis);
+                     });
+    _tree[mid].axis = axis;
+    build(lo, mid);
+    build(mid + 1, hi);
+}
+
+// Standard branch-and-bound k-nearest search. `best` is a max-heap on
+// squared distance holding at most `k` entries.
+void PaletteIndex::search(
+    const LAB &q, std::size_t lo, std::size_t hi, std::size_t k,
+    std::vector<std::pair<double, std::uint32_t>> &best) const {
+    if (lo >= hi)
+        return;
+    std::size_t mid = lo + (hi - lo) / 2;
+    const Node &n = _tree[mid];
+    double d2 = distance2(q, n.colour);
+    if (best.size() < k) {
+        best.emplace_back(d2, static_cast<std::uint32_t>(mid));
+        std::push_heap(best.begin(), best.end());
+    } else if (d2 < best.front().first) {
+        std::pop_heap(best.begin(), best.end());
+        best.back() = {d2, static_cast<std::uint32_t>(mid)};
+        std::push_heap(best.begin(), best.end());
+    }
+    if (hi - lo == 1)
+        return;
+
+    double diff = channel(q, n.axis) - channel(n.colour, n.axis);
+    bool left = diff < 0.0;
+    if (left)
+        search(q, lo, mid, k, best);
+    else
+        search(q, mid + 1, hi, k, best);
+    if (best.size() < k || diff * diff < best.front().first) {
+        if (left)
+            search(q, mid + 1, hi, k, best);
+        else
+            search(q, lo, mid, k, best);
+    }
+}
+
+std::vector<PaletteIndex::Match>
+PaletteIndex::nearest(std::span<const LAB> query, std::size_t k) const {
+    std::vector<Match> out;
+    if (query.empty() || k == 0 || _tree.empty())
+        return out;
+
+    std::unordered_set<std::uint32_t> candidates;
+    std::vector<std::pair<double, std::uint32_t>> best;
+    for (const auto &q : query) {
+        best.clear();
+        search(q, 0, _tree.size(), k * CANDIDATES_PER_MATCH, best);
+        for (const auto &b : best)
+            candidates.insert(_tree[b.second].palette);
+    }
+
+    for (auto p : candidates) {
+        auto cols = palette(p);
+        double total = 0.0;
+        for (const auto &q : query) {
+            double d2 = std::numeric_limits<double>::infinity();
+            for (const auto &c : cols)
+                d2 = std::min(d2, distance2(q, c));
+            total += std::sqrt(d2);
+        }
+        out.push_back({p, total / static_cast<double>(query.size())});
+    }
+    // Ties are broken by position so results do not depend on hash order.
+    std::sort(out.begin(), out.end(), [](const Match &x, const Match &y) {
+        return x.score != y.score ? x.score < y.score
+                                  : x.palette < y.palette;
+    });
+    if (out.size() > k)
+        out.resize(k);
+    return out;
+}
+
+// Palettes are stored as offsets plus one flat list of L, a, b values,
+// which keeps large corpora compact on disk. Single precision is plenty
+// for matching and roughly halves the text written per value.
+void to_json(json &j, const PaletteIndex &idx) {
+    std::vector<float> lab;
+    lab.reserve(idx._colours.size() * 3);
+    for (const auto &c : idx._colours) {
+        lab.push_back(static_cast<float>(c.L));
+        lab.push_back(static_cast<float>(c.a));
+        lab.push_back(static_cast<float>(c.b));
+    }
+    j = json{{"starts", idx._start}, {"lab", lab}};
+}
+
+void from_json(const json &j, PaletteIndex &idx) {
+    auto lab = j.at("lab").get<std::vector<double>>();
+    j.at("starts").get_to(idx._start);
+    if (idx._start.empty() || idx._start.front() != 0 ||
+        idx._start.back() * 3 != lab.size() ||
+        !std::is_sorted(idx._start.begin(), idx._start.end()))
+        throw std::out_of_range("palette index offsets do not match colours");
+    idx._colours.resize(lab.size() / 3);
+    for (std::size_t i = 0; i < idx._colours.size(); ++i)
+        idx._colours[i] = {lab[i * 3], lab[i * 3 + 1], lab[i * 3 + 2]};
+    idx.build();
+}
+
+} // namespace uc
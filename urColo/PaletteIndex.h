@@ -0,0 +1,73 @@
+// urColo - nearest-neighbour index over training palettes
+#pragma once
+#include "Colour.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace uc {
+// The OKLab swatches of a set of palettes, with a KD-tree over every swatch
+// so the palettes closest to a handful of query colours can be found
+// without scanning the whole collection.
+//
+// Palettes are appended with add(); the tree is rebuilt by build() and
+// must be current before nearest() is called.
+class PaletteIndex {
+  public:
+    // A palette returned by nearest().
+    //
+    // Member variables:
+    // - `palette` Position of the palette in the order it was added.
+    // - `score`   Mean OKLab distance from each query colour to the closest
+    //             swatch of the palette. Lower is more similar.
+    struct Match {
+        std::size_t palette;
+        double score;
+    };
+
+    // Append a palette given by its swatch colours.
+    void add(std::span<const LAB> colours);
+    // Rebuild the tree over every swatch added so far.
+    void build();
+
+    // Number of palettes added.
+    [[nodiscard]] std::size_t size() const { return _start.size() - 1; }
+    // Swatch colours of palette `i`.
+    [[nodiscard]] std::span<const LAB> palette(std::size_t i) const {
+        return std::span(_colours).subspan(_start[i],
+                                           _start[i + 1] - _start[i]);
+    }
+
+    // Find up to `k` palettes most similar to the `query` colours, best
+    // first. Candidates are the palettes owning the swatches nearest to
+    // each query colour, so the cost grows with the logarithm of the
+    // number of swatches rather than linearly.
+    [[nodiscard]] std::vector<Match> nearest(std::span<const LAB> query,
+                                             std::size_t k) const;
+
+    // Serialise the palettes to JSON; the tree is rebuilt on load.
+    friend void to_json(nlohmann::json &j, const PaletteIndex &idx);
+    // Restore the palettes from JSON and rebuild the tree.
+    friend void from_json(const nlohmann::json &j, PaletteIndex &idx);
+
+  private:
+    // One swatch in tree order. The median of each range splits it along
+    // `axis`; the halves either side form the subtrees.
+    struct Node {
+        LAB colour;
+        std::uint32_t palette;
+        std::uint8_t axis;
+    };
+
+    void build(std::size_t lo, std::size_t hi);
+    void search(const LAB &q, std::size_t lo, std::size_t hi,
+                std::size_t k, std::vector<std::pair<double, std::uint32_t>>
+                                   &best) const;
+
+    std::vector<LAB> _colours;             //< Swatches of every palette
+    std::vector<std::uint32_t> _start{0};  //< Offset of each palette
+    std::vector<Node> _tree;
+};
+} // namespace uc
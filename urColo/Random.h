@@ -0,0 +1,29 @@
+// urColo - seed derivation helpers
+#pragma once
+#include <cstdint>
+
+namespace uc {
+// SplitMix64 finaliser. Turns consecutive or otherwise correlated inputs into
+// well-mixed 64-bit values suitable for seeding independent generators.
+constexpr std::uint64_t splitmix64(std::uint64_t x) noexcept {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Derive the seed for stream `stream` of a master seed so parallel workers get
+// reproducible, non-overlapping random sequences.
+constexpr std::uint64_t deriveSeed(std::uint64_t master,
+                                   std::uint64_t stream) noexcept {
+    return splitmix64(master ^ splitmix64(stream + 1));
+}
+
+// Counter-based random bits: element `index` of the SplitMix64 stream keyed
+// by `key`. Every element is computed directly from its index, so parallel
+// loops can fill buffers reproducibly without sharing generator state.
+constexpr std::uint64_t randomBits(std::uint64_t key,
+                                   std::uint64_t index) noexcept {
+    return splitmix64(key + index * 0x9E3779B97F4A7C15ull);
+}
+} // namespace uc
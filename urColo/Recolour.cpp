@@ -0,0 +1,203 @@
+// urColo - palette-mapped image recolouring
+#include "Recolour.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+namespace {
+using namespace uc;
+
+// Range of a and b covered by the table grid. Nearly every sRGB colour lies
+// within it.
+constexpr double AB_RANGE = 0.4;
+
+// Pixels per task when mapping without error diffusion.
+constexpr std::size_t TILE_PIXELS = std::size_t{1} << 16;
+
+// Rows diffused together by Floyd-Steinberg. Error does not cross from one
+// band to the next, which lets bands run in parallel; at this height the
+// seams are not visible.
+constexpr std::size_t BAND_ROWS = 32;
+
+// Blue-noise offsets span this fraction of the mean distance from each
+// palette colour to its nearest neighbour. Enough to mix two neighbouring
+// colours in a gradient without speckling flat regions.
+constexpr double NOISE_SPREAD = 0.5;
+
+int cellOf(double v, double lo, double hi) {
+    double t = (v - lo) / (hi - lo) * PaletteLut::kCells;
+    return std::clamp(static_cast<int>(t), 0, PaletteLut::kCells - 1);
+}
+
+double distance2(const LAB &x, const LAB &y) {
+    double dL = x.L - y.L;
+    double da = x.a - y.a;
+    double db = x.b - y.b;
+    return dL * dL + da * da + db * db;
+}
+
+// Interleaved gradient noise: a per-pixel threshold in [0, 1) whose energy
+// sits at high frequencies, like a blue-noise mask, computed instead of
+// stored.
+double gradientNoise(std::size_t x, std::size_t y) {
+    double f = 0.06711056 * static_cast<double>(x) +
+               0.00583715 * static_cast<double>(y);
+    double g = 52.9829189 * (f - std::floor(f));
+    return g - std::floor(g);
+}
+
+// Mean distance from each palette colour to its nearest neighbour.
+double paletteSpacing(std::span<const LAB> palette) {
+    if (palette.size() < 2)
+        return 0.0;
+    double total = 0.0;
+    for (std::size_t i = 0; i < palette.size(); ++i) {
+        double best = std::numeric_limits<double>::infinity();
+        for (std::size_t j = 0; j < palette.size(); ++j)
+            if (j != i)
+                best = std::min(best, distance2(palette[i], palette[j]));
+        total += std::sqrt(best);
+    }
+    return total / static_cast<double>(palette.size());
+}
+} // namespace
+
+namespace uc {
+
+PaletteLut::PaletteLut(std::span<const LAB> palette) {
+    const std::size_t n = std::min<std::size_t>(
+        palette.size(), std::numeric_limits<std::uint16_t>::max() + 1u);
+    _palette.assign(palette.begin(), palette.begin() + n);
+    if (_palette.empty())
+        return;
+    constexpr auto cells = static_cast<std::size_t>(kCells);
+    _cells.resize(cells * cells * cells);
+    const double abStep = 2.0 * AB_RANGE / kCells;
+    ThreadPool::shared().parallelFor(cells, [&](std::size_t l) {
+        for (std::size_t a = 0; a < cells; ++a) {
+            for (std::size_t b = 0; b < cells; ++b) {
+                LAB centre{(static_cast<double>(l) + 0.5) / kCells,
+                           -AB_RANGE + (static_cast<double>(a) + 0.5) * abStep,
+                           -AB_RANGE + (static_cast<double>(b) + 0.5) * abStep};
+                std::size_t best = 0;
+                double bestD = std::numeric_limits<double>::infinity();
+                for (std::size_t p = 0; p < _palette.size(); ++p) {
+                    double d = distance2(centre, _palette[p]);
+                    if (d < bestD) {
+                        bestD = d;
+                        best = p;
+                    }
+                }
+                _cells[(l * cells + a) * cells + b] =
+                    static_cast<std::uint16_t>(best);
+            }
+        }
+    });
+}
+
+std::uint16_t PaletteLut::nearest(const LAB &c) const {
+    const int l = cellOf(c.L, 0.0, 1.0);
+    const int a = cellOf(c.a, -AB_RANGE, AB_RANGE);
+    const int b = cellOf(c.b, -AB_RANGE, AB_RANGE);
+    return _cells[static_cast<std::size_t>((l * kCells + a) * kCells + b)];
+}
+
+ImageData recolourImage(const ImageData &img, std::span<const LAB> palette,
+                        Dither dither, std::stop_token stop) {
+    ImageData out;
+    if (img.empty() || palette.empty())
+        return out;
+    const PaletteLut lut(palette);
+    std::vector<std::array<unsigned char, 3>> srgb;
+    srgb.reserve(lut.palette().size());
+    for (const auto &p : lut.palette()) {
+        Colour c;
+        c.lab = p;
+        srgb.push_back(c.toSRGB8());
+    }
+
+    auto planes = img.lab();
+    const LabPlanes &px = *planes;
+    const auto w = static_cast<std::size_t>(img.width);
+    const std::size_t n = img.pixelCount();
+    out.width = img.width;
+    out.height = img.height;
+    out.rgba.resize(n * 4);
+    auto write = [&](std::size_t i, std::uint16_t idx) {
+        const auto &c = srgb[idx];
+        out.rgba[i * 4 + 0] = c[0];
+        out.rgba[i * 4 + 1] = c[1];
+        out.rgba[i * 4 + 2] = c[2];
+        out.rgba[i * 4 + 3] = img.rgba[i * 4 + 3];
+    };
+    auto &pool = ThreadPool::shared();
+
+    if (dither == Dither::FloydSteinberg) {
+        const auto h = static_cast<std::size_t>(img.height);
+        const std::size_t bands = (h + BAND_ROWS - 1) / BAND_ROWS;
+        pool.parallelFor(bands, [&](std::size_t band) {
+            // Error carried into the current and the next row, with a
+            // pixel of padding either side.
+            std::vector<LAB> cur(w + 2), next(w + 2);
+            const std::size_t y1 = std::min((band + 1) * BAND_ROWS, h);
+            for (std::size_t y = band * BAND_ROWS; y < y1; ++y) {
+                if (stop.stop_requested())
+                    return;
+                // Serpentine order keeps the error from drifting sideways.
+                const bool reverse = y % 2 == 1;
+                for (std::size_t k = 0; k < w; ++k) {
+                    const std::size_t x = reverse ? w - 1 - k : k;
+                    const std::size_t i = y * w + x;
+                    const LAB &e = cur[x + 1];
+                    LAB want{px.L[i] + e.L, px.a[i] + e.a, px.b[i] + e.b};
+                    std::uint16_t idx = lut.nearest(want);
+                    write(i, idx);
+                    const LAB &got = lut.palette()[idx];
+                    LAB err{want.L - got.L, want.a - got.a, want.b - got.b};
+                    auto spread = [&err](LAB &to, double f) {
+                        to.L += err.L * f;
+                        to.a += err.a * f;
+                        to.b += err.b * f;
+                    };
+                    const std::size_t ahead = reverse ? x : x + 2;
+                    const std::size_t behind = reverse ? x + 2 : x;
+                    spread(cur[ahead], 7.0 / 16.0);
+                    spread(next[behind], 3.0 / 16.0);
+                    spread(next[x + 1], 5.0 / 16.0);
+                    spread(next[ahead], 1.0 / 16.0);
+                }
+                std::swap(cur, next);
+                std::fill(next.begin(), next.end(), LAB{});
+            }
+        });
+    } else {
+        const double amp = dither == Dither::BlueNoise
+                               ? NOISE_SPREAD * paletteSpacing(lut.palette())
+                               : 0.0;
+        const std::size_t tiles = (n + TILE_PIXELS - 1) / TILE_PIXELS;
+        pool.parallelFor(tiles, [&](std::size_t t) {
+            if (stop.stop_requested())
+                return;
+            const std::size_t last = std::min((t + 1) * TILE_PIXELS, n);
+            for (std::size_t i = t * TILE_PIXELS; i < last; ++i) {
+                LAB c{px.L[i], px.a[i], px.b[i]};
+                if (amp > 0.0) {
+                    // Shifted copies of the mask decorrelate the channels.
+                    const std::size_t x = i % w, y = i / w;
+                    c.L += (gradientNoise(x, y) - 0.5) * amp;
+                    c.a += (gradientNoise(x + 17, y + 31) - 0.5) * amp;
+                    c.b += (gradientNoise(x + 59, y + 7) - 0.5) * amp;
+                }
+                write(i, lut.nearest(c));
+            }
+        });
+    }
+    if (stop.stop_requested())
+        return {};
+    out.fingerprint = fingerprintImage(out);
+    return out;
+}
+
+} // namespace uc
@@ -0,0 +1,49 @@
+// urColo - palette-mapped image recolouring
+#pragma once
+#include "Colour.h"
+#include "ImageUtils.h"
+#include <cstdint>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+namespace uc {
+// Dithering applied when an image is reduced to a palette.
+enum class Dither { None, FloydSteinberg, BlueNoise };
+
+// Nearest palette colour for every cell of a regular grid over OKLab, so
+// mapping a pixel costs one table read instead of a search of the palette.
+// Colours outside the grid use its edge cells.
+class PaletteLut {
+  public:
+    // Cells along each axis of the grid.
+    static constexpr int kCells = 32;
+
+    PaletteLut() = default;
+    // Build the table for `palette`, one slice of L per thread-pool task.
+    // At most 65536 colours are used.
+    explicit PaletteLut(std::span<const LAB> palette);
+
+    [[nodiscard]] bool empty() const { return _palette.empty(); }
+    [[nodiscard]] std::span<const LAB> palette() const { return _palette; }
+    // Index of the palette colour nearest to the centre of the cell holding
+    // `c`.
+    [[nodiscard]] std::uint16_t nearest(const LAB &c) const;
+
+  private:
+    std::vector<LAB> _palette;
+    std::vector<std::uint16_t> _cells; //< Palette index per cell, b fastest
+};
+
+// Reduce an image to the colours of `palette`, keeping its alpha. Pixels
+// are mapped through a PaletteLut in parallel tiles. Floyd-Steinberg
+// diffuses the OKLab error within independent bands of rows so the bands
+// can run in parallel; blue noise offsets each pixel by a per-pixel
+// threshold scaled to the spacing of the palette.
+//
+// \return The recoloured image, or an empty one when `palette` is empty or
+//         `stop` was requested.
+ImageData recolourImage(const ImageData &img, std::span<const LAB> palette,
+                        Dither dither = Dither::None,
+                        std::stop_token stop = {});
+} // namespace uc
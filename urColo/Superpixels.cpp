@@ -0,0 +1,201 @@
+// urColo - SLIC superpixel segmentation in OKLab
+#include "Superpixels.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+using namespace uc;
+
+// A superpixel seed: mean colour and position of its pixels.
+struct Seed {
+    double L, a, b, x, y;
+};
+
+// Running sums over the pixels assigned to one seed.
+struct Sums {
+    double L{0.0}, a{0.0}, b{0.0}, x{0.0}, y{0.0};
+    double squares{0.0}; //< Sum of squared OKLab magnitudes
+    double count{0.0};
+
+    void add(const Sums &o) {
+        L += o.L;
+        a += o.a;
+        b += o.b;
+        x += o.x;
+        y += o.y;
+        squares += o.squares;
+        count += o.count;
+    }
+};
+
+double colourDist2(const LabPlanes &p, std::size_t i, const Seed &s) {
+    double dL = p.L[i] - s.L;
+    double da = p.a[i] - s.a;
+    double db = p.b[i] - s.b;
+    return dL * dL + da * da + db * db;
+}
+
+double pixelDist2(const LabPlanes &p, std::size_t i, std::size_t j) {
+    double dL = p.L[i] - p.L[j];
+    double da = p.a[i] - p.a[j];
+    double db = p.b[i] - p.b[j];
+    return dL * dL + da * da + db * db;
+}
+} // namespace
+
+namespace uc {
+
+Superpixels segmentSuperpixels(const ImageData &img,
+                               const SuperpixelSettings &settings) {
+    Superpixels out;
+    if (img.empty() || settings.count == 0)
+        return out;
+    auto planes = img.lab();
+    const LabPlanes &p = *planes;
+    const auto w = static_cast<std::size_t>(img.width);
+    const auto h = static_cast<std::size_t>(img.height);
+    const std::size_t n = w * h;
+
+    // Grid of gx by gy cells of roughly `step` pixels square.
+    const double step =
+        std::sqrt(static_cast<double>(n) /
+                  static_cast<double>(std::min(settings.count, n)));
+    auto cells = [step](std::size_t len) {
+        auto c = static_cast<std::size_t>(
+            std::lround(static_cast<double>(len) / step));
+        return std::clamp<std::size_t>(c, 1, len);
+    };
+    const std::size_t gx = cells(w);
+    const std::size_t gy = cells(h);
+    const double spatial = settings.compactness / step;
+    const double spatial2 = spatial * spatial;
+
+    // Cell column of every pixel column, and the first pixel row of every
+    // row of cells.
+    std::vector<std::size_t> cellX(w);
+    for (std::size_t x = 0; x < w; ++x)
+        cellX[x] = x * gx / w;
+    std::vector<std::size_t> rowStart(gy + 1);
+    for (std::size_t cy = 0; cy <= gy; ++cy)
+        rowStart[cy] = (cy * h + gy - 1) / gy;
+
+    // Start each seed at the centre of its cell, moved to the pixel with
+    // the smallest colour gradient in its 3x3 neighbourhood so it does not
+    // sit on an edge.
+    auto gradient = [&](std::size_t x, std::size_t y) {
+        std::size_t l = x > 0 ? x - 1 : x;
+        std::size_t r = x + 1 < w ? x + 1 : x;
+        std::size_t u = y > 0 ? y - 1 : y;
+        std::size_t d = y + 1 < h ? y + 1 : y;
+        return pixelDist2(p, y * w + r, y * w + l) +
+               pixelDist2(p, d * w + x, u * w + x);
+    };
+    std::vector<Seed> seeds(gx * gy);
+    for (std::size_t cy = 0; cy < gy; ++cy) {
+        for (std::size_t cx = 0; cx < gx; ++cx) {
+            std::size_t sx = (2 * cx + 1) * w / (2 * gx);
+            std::size_t sy = (2 * cy + 1) * h / (2 * gy);
+            std::size_t bx = sx, by = sy;
+            double best = gradient(sx, sy);
+            for (std::size_t y = sy > 0 ? sy - 1 : sy;
+                 y <= std::min(sy + 1, h - 1); ++y) {
+                for (std::size_t x = sx > 0 ? sx - 1 : sx;
+                     x <= std::min(sx + 1, w - 1); ++x) {
+                    double g = gradient(x, y);
+                    if (g < best) {
+                        best = g;
+                        bx = x;
+                        by = y;
+                    }
+                }
+            }
+            std::size_t i = by * w + bx;
+            seeds[cy * gx + cx] = {p.L[i], p.a[i], p.b[i],
+                                   static_cast<double>(bx),
+                                   static_cast<double>(by)};
+        }
+    }
+
+    // Each row of cells keeps sums for the seeds its pixels can reach: the
+    // row of seeds above it, its own and the one below.
+    std::vector<std::vector<Sums>> partial(gy, std::vector<Sums>(3 * gx));
+    std::vector<Sums> totals(seeds.size());
+    auto &pool = ThreadPool::shared();
+    for (int it = 0; it < std::max(settings.iterations, 1); ++it) {
+        pool.parallelFor(gy, [&](std::size_t cy) {
+            auto &sums = partial[cy];
+            std::fill(sums.begin(), sums.end(), Sums{});
+            const std::size_t r0 = cy > 0 ? cy - 1 : 0;
+            const std::size_t r1 = std::min(cy + 1, gy - 1);
+            for (std::size_t y = rowStart[cy]; y < rowStart[cy + 1]; ++y) {
+                const auto fy = static_cast<double>(y);
+                for (std::size_t x = 0; x < w; ++x) {
+                    const std::size_t i = y * w + x;
+                    const auto fx = static_cast<double>(x);
+                    const std::size_t c0 = cellX[x] > 0 ? cellX[x] - 1 : 0;
+                    const std::size_t c1 = std::min(cellX[x] + 1, gx - 1);
+                    double best = std::numeric_limits<double>::infinity();
+                    std::size_t slot = 0;
+                    for (std::size_t r = r0; r <= r1; ++r) {
+                        for (std::size_t c = c0; c <= c1; ++c) {
+                            const Seed &s = seeds[r * gx + c];
+                            double dx = fx - s.x;
+                            double dy = fy - s.y;
+                            double d = colourDist2(p, i, s) +
+                                       (dx * dx + dy * dy) * spatial2;
+                            if (d < best) {
+                                best = d;
+                                slot = (r + 1 - cy) * gx + c;
+                            }
+                        }
+                    }
+                    Sums &acc = sums[slot];
+                    const double L = p.L[i], a = p.a[i], b = p.b[i];
+                    acc.L += L;
+                    acc.a += a;
+                    acc.b += b;
+                    acc.x += fx;
+                    acc.y += fy;
+                    acc.squares += L * L + a * a + b * b;
+                    acc.count += 1.0;
+                }
+            }
+        });
+        // Gather each seed's sums from the rows of cells around it and move
+        // it to the mean of its pixels.
+        pool.parallelFor(gy, [&](std::size_t r) {
+            const std::size_t b0 = r > 0 ? r - 1 : 0;
+            const std::size_t b1 = std::min(r + 1, gy - 1);
+            for (std::size_t c = 0; c < gx; ++c) {
+                Sums t;
+                for (std::size_t band = b0; band <= b1; ++band)
+                    t.add(partial[band][(r + 1 - band) * gx + c]);
+                totals[r * gx + c] = t;
+                if (t.count > 0.0)
+                    seeds[r * gx + c] = {t.L / t.count, t.a / t.count,
+                                         t.b / t.count, t.x / t.count,
+                                         t.y / t.count};
+            }
+        });
+    }
+
+    out.colours.reserve(seeds.size());
+    out.weights.reserve(seeds.size());
+    out.variance.reserve(seeds.size());
+    for (std::size_t s = 0; s < seeds.size(); ++s) {
+        const Sums &t = totals[s];
+        if (t.count <= 0.0)
+            continue;
+        const Seed &m = seeds[s];
+        out.colours.push_back({m.L, m.a, m.b});
+        out.weights.push_back(t.count);
+        out.variance.push_back(
+            std::max(0.0, t.squares / t.count -
+                              (m.L * m.L + m.a * m.a + m.b * m.b)));
+    }
+    return out;
+}
+
+} // namespace uc
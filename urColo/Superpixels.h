@@ -0,0 +1,57 @@
+// urColo - SLIC superpixel segmentation in OKLab
+#pragma once
+#include "Colour.h"
+#include "ImageUtils.h"
+#include <cstddef>
+#include <vector>
+
+namespace uc {
+// Superpixels cut from an image before clustering by default. Enough to
+// keep small but distinct regions while k-means stays instant.
+inline constexpr std::size_t kDefaultSuperpixels = 2048;
+
+// Parameters of the superpixel segmentation.
+//
+// Member variables:
+// - `count`       Approximate number of superpixels to cut the image into.
+// - `compactness` OKLab distance that weighs as much as one grid step of
+//                 spatial distance. Larger values give more regular
+//                 regions, smaller ones follow colour edges more closely.
+// - `iterations`  Assignment and update passes to run.
+struct SuperpixelSettings {
+    std::size_t count{kDefaultSuperpixels};
+    double compactness{0.05};
+    int iterations{4};
+};
+
+// Regions of similar colour found by segmentSuperpixels(). Colours and
+// weights are kept in separate arrays so they can be handed straight to a
+// ClusterEngine as points and per-point weights.
+//
+// Member variables:
+// - `colours`  Mean OKLab colour of each region.
+// - `weights`  Number of pixels in each region.
+// - `variance` Mean squared OKLab distance of a region's pixels from its
+//              mean colour.
+struct Superpixels {
+    std::vector<LAB> colours;
+    std::vector<double> weights;
+    std::vector<double> variance;
+
+    [[nodiscard]] std::size_t size() const { return colours.size(); }
+    [[nodiscard]] LAB operator[](std::size_t i) const { return colours[i]; }
+};
+
+// Segment an image into compact regions of similar colour with SLIC.
+//
+// Seeds start on a regular grid, nudged to the flattest spot nearby. Each
+// pass assigns every pixel to the closest seed of the 3x3 grid cells
+// around it, by OKLab distance plus spatial distance scaled by
+// `compactness`, then moves the seeds to the means of their pixels. Rows of
+// grid cells are processed in parallel on the shared thread pool and each
+// keeps its own partial sums, so results do not depend on scheduling.
+// Regions left without pixels are dropped.
+[[nodiscard]] Superpixels
+segmentSuperpixels(const ImageData &img,
+                   const SuperpixelSettings &settings = {});
+} // namespace uc
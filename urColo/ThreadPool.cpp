@@ -0,0 +1,109 @@
+// urColo - fixed-size worker thread pool
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace {
+// Bookkeeping for one parallelFor call. Shared with the helper tasks so a
+// helper that only gets to run after the loop has finished still finds
+// valid state; it then sees no indices left and returns.
+struct ForState {
+    std::size_t count{0};
+    const std::function<void(std::size_t)> *body{nullptr};
+    std::atomic<std::size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t done{0};        //< Guarded by mutex
+    std::exception_ptr failure; //< Guarded by mutex
+};
+
+// Claim and run indices until none remain.
+void drain(ForState &st) {
+    for (;;) {
+        std::size_t i = st.next.fetch_add(1);
+        if (i >= st.count)
+            return;
+        std::exception_ptr err;
+        try {
+            (*st.body)(i);
+        } catch (...) {
+            err = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(st.mutex);
+        if (err && !st.failure)
+            st.failure = err;
+        if (++st.done == st.count)
+            st.cv.notify_all();
+    }
+}
+} // namespace
+
+namespace uc {
+
+ThreadPool::ThreadPool()
+    : ThreadPool(std::max(1u, std::thread::hardware_concurrency()) - 1) {}
+
+ThreadPool::ThreadPool(unsigned workers) {
+    _workers.reserve(workers);
+    for (unsigned i = 0; i < workers; ++i)
+        _workers.emplace_back([this](std::stop_token stop) { run(stop); });
+}
+
+ThreadPool::~ThreadPool() {
+    for (auto &w : _workers)
+        w.request_stop();
+    _wake.notify_all();
+    _workers.clear();
+}
+
+ThreadPool &ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::parallelFor(std::size_t count,
+                             const std::function<void(std::size_t)> &body) {
+    if (count == 0)
+        return;
+    auto st = std::make_shared<ForState>();
+    st->count = count;
+    st->body = &body;
+
+    // One helper per worker is enough: each keeps claiming indices until
+    // the range is exhausted.
+    std::size_t helpers = std::min(count - 1, _workers.size());
+    if (helpers > 0) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (std::size_t h = 0; h < helpers; ++h)
+                _tasks.emplace_back([st] { drain(*st); });
+        }
+        _wake.notify_all();
+    }
+
+    drain(*st);
+    std::unique_lock<std::mutex> lock(st->mutex);
+    st->cv.wait(lock, [&] { return st->done == st->count; });
+    if (st->failure)
+        std::rethrow_exception(st->failure);
+}
+
+// Worker loop: run queued tasks until the pool is destroyed.
+void ThreadPool::run(std::stop_token stop) {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!_wake.wait(lock, stop, [this] { return !_tasks.empty(); }))
+                return;
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace uc
@@ -0,0 +1,52 @@
+// urColo - fixed-size worker thread pool interface
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace uc {
+// A fixed set of worker threads sharing one task queue.
+//
+// parallelFor() lets the calling thread work through the range alongside
+// the workers. The call completes even when every worker is busy, so it is
+// safe to call from inside another parallelFor body.
+class ThreadPool {
+  public:
+    // Create a pool with one worker fewer than the hardware thread count,
+    // leaving a core for the caller that participates in parallelFor.
+    ThreadPool();
+    // Create a pool with `workers` background threads. Zero is allowed and
+    // makes parallelFor run everything on the calling thread.
+    explicit ThreadPool(unsigned workers);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Process-wide pool for work started from the UI thread, such as model
+    // training. Created on first use.
+    static ThreadPool &shared();
+
+    // Number of background worker threads.
+    [[nodiscard]] std::size_t workers() const { return _workers.size(); }
+
+    // Call `body(i)` for every i in [0, count), spread across the workers
+    // and the calling thread. Returns once every call has finished. If any
+    // call throws, the first exception is rethrown here after the rest
+    // complete.
+    void parallelFor(std::size_t count,
+                     const std::function<void(std::size_t)> &body);
+
+  private:
+    void run(std::stop_token stop);
+
+    std::mutex _mutex;
+    std::condition_variable_any _wake;
+    std::deque<std::function<void()>> _tasks;
+    std::vector<std::jthread> _workers; //< Declared last, stopped first
+};
+} // namespace uc
@@ -0,0 +1,241 @@
+// urColo - palette-order transition model
+#include "TransitionModel.h"
+
+#include <algorithm>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+
+using json = nlohmann::json;
+
+namespace {
+using namespace uc;
+
+// Range of a and b covered by the bin grid. Nearly every sRGB colour lies
+// within it; anything outside is clamped into the edge bins.
+constexpr double AB_RANGE = 0.4;
+
+// Weight of a transition between adjacent swatches.
+constexpr double NEXT_WEIGHT = 1.0;
+
+// Weight of a pair that shares a palette without being adjacent. Keeps
+// colours that belong together reachable without drowning out the order.
+constexpr double CO_OCCURRENCE_WEIGHT = 0.25;
+
+// Draws made when the chosen bin is already in the palette before
+// accepting a repeat.
+constexpr int REPEAT_RETRIES = 4;
+
+std::uint32_t binOf(const LAB &c) {
+    auto cell = [](double v, double lo, double hi, int bins) {
+        double t = std::clamp((v - lo) / (hi - lo), 0.0, 1.0);
+        int i = std::min(static_cast<int>(t * bins), bins - 1);
+        return static_cast<std::uint32_t>(i);
+    };
+    std::uint32_t l = cell(c.L, 0.0, 1.0, TransitionModel::kBinsL);
+    std::uint32_t a =
+        cell(c.a, -AB_RANGE, AB_RANGE, TransitionModel::kBinsAB);
+    std::uint32_t b =
+        cell(c.b, -AB_RANGE, AB_RANGE, TransitionModel::kBinsAB);
+    return (l * TransitionModel::kBinsAB + a) * TransitionModel::kBinsAB + b;
+}
+
+std::uint64_t pairKey(std::uint32_t from, std::uint32_t to) {
+    return (static_cast<std::uint64_t>(from) << 32) | to;
+}
+
+// Map ordered by key, so tables and saved files do not depend on hash
+// iteration order.
+template <typename K>
+std::map<K, double> sorted(const std::unordered_map<K, double> &m) {
+    return {m.begin(), m.end()};
+}
+} // namespace
+
+namespace uc {
+
+// Vose's construction: columns with less than the average weight are
+// topped up from one with more, which then becomes their alias.
+AliasTable::AliasTable(std::span<const double> weights) {
+    const std::size_t n = weights.size();
+    double total = 0.0;
+    for (double w : weights)
+        total += w;
+    if (n == 0 || total <= 0.0)
+        throw std::invalid_argument("alias table needs a positive weight");
+
+    _prob.resize(n);
+    _alias.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<std::uint32_t> small, large;
+    for (std::size_t i = 0; i < n; ++i) {
+        scaled[i] = weights[i] * static_cast<double>(n) / total;
+        (scaled[i] < 1.0 ? small : large)
+            .push_back(static_cast<std::uint32_t>(i));
+    }
+    while (!small.empty() && !large.empty()) {
+        std::uint32_t s = small.back();
+        small.pop_back();
+        std::uint32_t l = large.back();
+        _prob[s] = scaled[s];
+        _alias[s] = l;
+        scaled[l] -= 1.0 - scaled[s];
+        if (scaled[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left is within rounding of exactly one column.
+    for (auto i : large) {
+        _prob[i] = 1.0;
+        _alias[i] = i;
+    }
+    for (auto i : small) {
+        _prob[i] = 1.0;
+        _alias[i] = i;
+    }
+}
+
+std::size_t AliasTable::sample(std::mt19937_64 &rng) const {
+    std::uniform_real_distribution<double> u(0.0,
+                                             static_cast<double>(size()));
+    double x = u(rng);
+    auto col = std::min(static_cast<std::size_t>(x), size() - 1);
+    return x - static_cast<double>(col) < _prob[col] ? col : _alias[col];
+}
+
+void TransitionModel::add(std::span<const LAB> palette) {
+    if (palette.empty())
+        return;
+    std::vector<std::uint32_t> bins;
+    bins.reserve(palette.size());
+    for (const auto &c : palette) {
+        std::uint32_t bin = binOf(c);
+        auto &st = _bins[bin];
+        st.sum = {st.sum.L + c.L, st.sum.a + c.a, st.sum.b + c.b};
+        st.count += 1.0;
+        bins.push_back(bin);
+    }
+    _starts[bins.front()] += 1.0;
+    for (std::size_t i = 0; i < bins.size(); ++i) {
+        for (std::size_t j = 0; j < bins.size(); ++j) {
+            if (i == j)
+                continue;
+            double w = j == i + 1 ? NEXT_WEIGHT : CO_OCCURRENCE_WEIGHT;
+            _counts[pairKey(bins[i], bins[j])] += w;
+        }
+    }
+}
+
+void TransitionModel::build() {
+    _rows.clear();
+    _startTable = {};
+    if (_starts.empty())
+        return;
+
+    std::vector<double> weights;
+    for (const auto &[bin, w] : sorted(_starts)) {
+        _startTable.bins.push_back(bin);
+        weights.push_back(w);
+    }
+    _startTable.table = AliasTable(weights);
+
+    // Keys sort by source bin first, so each row is one contiguous run.
+    std::map<std::uint32_t, std::vector<double>> rowWeights;
+    for (const auto &[key, w] : sorted(_counts)) {
+        auto from = static_cast<std::uint32_t>(key >> 32);
+        _rows[from].bins.push_back(static_cast<std::uint32_t>(key));
+        rowWeights[from].push_back(w);
+    }
+    for (auto &[from, w] : rowWeights)
+        _rows[from].table = AliasTable(w);
+}
+
+LAB TransitionModel::binColour(std::uint32_t bin) const {
+    const auto &st = _bins.at(bin);
+    return {st.sum.L / st.count, st.sum.a / st.count, st.sum.b / st.count};
+}
+
+std::uint32_t TransitionModel::draw(const Row &row,
+                                    std::mt19937_64 &rng) const {
+    return row.bins[row.table.sample(rng)];
+}
+
+std::vector<LAB> TransitionModel::walk(std::size_t count,
+                                       std::span<const LAB> locked,
+                                       std::mt19937_64 &rng) const {
+    std::vector<LAB> out;
+    if (empty())
+        return out;
+    out.reserve(count);
+
+    std::vector<std::uint32_t> used;
+    for (const auto &c : locked)
+        used.push_back(binOf(c));
+    bool hasCurrent = !locked.empty() && _rows.contains(used.back());
+    std::uint32_t current = hasCurrent ? used.back() : 0;
+
+    for (std::size_t i = 0; i < count; ++i) {
+        auto row = hasCurrent ? _rows.find(current) : _rows.end();
+        const Row &from = row != _rows.end() ? row->second : _startTable;
+        auto seen = [&](std::uint32_t bin) {
+            return std::find(used.begin(), used.end(), bin) != used.end();
+        };
+        std::uint32_t next = draw(from, rng);
+        for (int r = 0; r < REPEAT_RETRIES && seen(next); ++r)
+            next = draw(from, rng);
+        used.push_back(next);
+        out.push_back(binColour(next));
+        current = next;
+        hasCurrent = true;
+    }
+    return out;
+}
+
+// Bins are saved as [bin, count, L sum, a sum, b sum] runs, starts as
+// [bin, weight] and transitions as [from, to, weight].
+void to_json(json &j, const TransitionModel &m) {
+    std::map<std::uint32_t, TransitionModel::BinStats> bins(m._bins.begin(),
+                                                           m._bins.end());
+    std::vector<double> binArr, startArr, countArr;
+    for (const auto &[bin, st] : bins) {
+        binArr.insert(binArr.end(), {static_cast<double>(bin), st.count,
+                                     st.sum.L, st.sum.a, st.sum.b});
+    }
+    for (const auto &[bin, w] : sorted(m._starts))
+        startArr.insert(startArr.end(), {static_cast<double>(bin), w});
+    for (const auto &[key, w] : sorted(m._counts))
+        countArr.insert(countArr.end(),
+                        {static_cast<double>(key >> 32),
+                         static_cast<double>(key & 0xffffffffu), w});
+    j = json{{"bins", binArr}, {"starts", startArr}, {"transitions", countArr}};
+}
+
+void from_json(const json &j, TransitionModel &m) {
+    auto binArr = j.at("bins").get<std::vector<double>>();
+    auto startArr = j.at("starts").get<std::vector<double>>();
+    auto countArr = j.at("transitions").get<std::vector<double>>();
+    if (binArr.size() % 5 || startArr.size() % 2 || countArr.size() % 3)
+        throw std::out_of_range("transition model arrays are truncated");
+
+    auto bin = [](double v) { return static_cast<std::uint32_t>(v); };
+    m = {};
+    for (std::size_t i = 0; i < binArr.size(); i += 5)
+        m._bins[bin(binArr[i])] = {
+            {binArr[i + 2], binArr[i + 3], binArr[i + 4]}, binArr[i + 1]};
+    for (std::size_t i = 0; i < startArr.size(); i += 2)
+        m._starts[bin(startArr[i])] = startArr[i + 1];
+    for (std::size_t i = 0; i < countArr.size(); i += 3)
+        m._counts[pairKey(bin(countArr[i]), bin(countArr[i + 1]))] =
+            countArr[i + 2];
+    // Every referenced bin needs a colour for walk() to return.
+    for (const auto &[key, w] : m._counts)
+        if (!m._bins.contains(static_cast<std::uint32_t>(key)))
+            throw std::out_of_range("transition to a bin with no colour");
+    for (const auto &[b, w] : m._starts)
+        if (!m._bins.contains(b))
+            throw std::out_of_range("start bin with no colour");
+    m.build();
+}
+
+} // namespace uc
@@ -0,0 +1,88 @@
+// urColo - palette-order transition model interface
+#pragma once
+#include "Colour.h"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace uc {
+// Walker's alias method: after an O(n) build, draws an index with
+// probability proportional to its weight in O(1) using one uniform number.
+class AliasTable {
+  public:
+    AliasTable() = default;
+    // Build from non-negative weights; at least one must be positive.
+    explicit AliasTable(std::span<const double> weights);
+
+    [[nodiscard]] bool empty() const { return _prob.empty(); }
+    [[nodiscard]] std::size_t size() const { return _prob.size(); }
+    // Draw an index in [0, size()).
+    [[nodiscard]] std::size_t sample(std::mt19937_64 &rng) const;
+
+  private:
+    std::vector<double> _prob;         //< Chance of keeping each column
+    std::vector<std::uint32_t> _alias; //< Index used otherwise
+};
+
+// First-order Markov model over palette order.
+//
+// OKLab is cut into a grid of bins. Training counts how often a swatch in
+// one bin is followed by a swatch in another, and, with a lower weight, how
+// often two bins appear together anywhere in the same palette. Each bin's
+// outgoing counts become an alias table so a walk draws every next colour
+// in constant time.
+class TransitionModel {
+  public:
+    // Grid resolution along L and along each of a and b.
+    static constexpr int kBinsL = 16;
+    static constexpr int kBinsAB = 16;
+
+    // Count the transitions of one palette, in swatch order.
+    void add(std::span<const LAB> palette);
+    // Rebuild the alias tables from the counts gathered so far.
+    void build();
+
+    // True until a palette with at least one swatch has been built.
+    [[nodiscard]] bool empty() const { return _startTable.table.empty(); }
+    // Number of bins that training colours fell into.
+    [[nodiscard]] std::size_t binsUsed() const { return _bins.size(); }
+
+    // Generate `count` colours by walking the chain. The walk continues
+    // from the last `locked` colour when its bin has been seen, otherwise it
+    // starts from a bin drawn by how often palettes began there. Each
+    // colour is the mean of the training colours in its bin.
+    [[nodiscard]] std::vector<LAB> walk(std::size_t count,
+                                        std::span<const LAB> locked,
+                                        std::mt19937_64 &rng) const;
+
+    // Serialise the counts as flat arrays; tables are rebuilt on load.
+    friend void to_json(nlohmann::json &j, const TransitionModel &m);
+    // Restore the counts from JSON and rebuild the tables.
+    friend void from_json(const nlohmann::json &j, TransitionModel &m);
+
+  private:
+    // Sum and count of the training colours that fell into a bin.
+    struct BinStats {
+        LAB sum{};
+        double count{0.0};
+    };
+    // Alias table over the bins reachable from one bin.
+    struct Row {
+        std::vector<std::uint32_t> bins;
+        AliasTable table;
+    };
+
+    [[nodiscard]] LAB binColour(std::uint32_t bin) const;
+    [[nodiscard]] std::uint32_t draw(const Row &row,
+                                     std::mt19937_64 &rng) const;
+
+    std::unordered_map<std::uint32_t, BinStats> _bins;
+    std::unordered_map<std::uint32_t, double> _starts;
+    std::unordered_map<std::uint64_t, double> _counts; //< (from << 32) | to
+    Row _startTable;
+    std::unordered_map<std::uint32_t, Row> _rows;
+};
+} // namespace uc
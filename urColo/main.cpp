@@ -26,16 +26,28 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam,
 #include <GLFW/glfw3.h>
 #endif
 #include <print>
+#include <span>
+#include <string>
+#include <vector>
 
+#include "BatchExtract.h"
 #include "Gui.h"
 #include "Gui/WindowManager.h"
 #include "Logger.h"
 
-int main(int, char **) {
+int main(int argc, char **argv) {
 
     // start logger
     auto logger = uc::Logger();
 
+    // Headless palette extraction runs without creating a window.
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--extract") {
+        int code = uc::runBatchCommand(std::span(args).subspan(1));
+        logger.shutdown();
+        return code;
+    }
+
 #ifdef _WIN32
     // Create the Win32 window and OpenGL context. ImGui will use this handle
     // for rendering on Windows.